@@ -0,0 +1,272 @@
+# Runs the shootout benchmarks and reports warm-up and steady state
+# separately.
+#
+# Usage: tools/Rscript benchmarks/harness.r [options] [program ...]
+#
+#   --iterations n    in process iterations per program and mode (30)
+#   --modes m,...     PIR_ENABLE modes to run under (off,on,force)
+#   --out prefix      writes prefix.json, prefix.csv and
+#                     prefix-iterations.csv (harness)
+#   --baseline file   csv of an earlier run. Exits with status 1 if a program
+#                     got slower in any mode
+#   --threshold x     slowdown tolerated by the regression check (0.05)
+#   --timeout s       per program and mode (600)
+#   --compile-time    also measures the PIR compile time per iteration (uses
+#                     the PassStatistics debug flag, which adds some overhead)
+#
+# Programs are paths relative to benchmarks/ (where they also run) and default
+# to all of shootout/*/*.r. Every program and mode runs in a fresh R process,
+# such that the peak RSS is per program and the compiler caches start cold.
+#
+# For every iteration the elapsed time, the time spent in the GC and the
+# number of collections are recorded. The warm-up ends at the first iteration
+# from which on a window of iterations stays within a band around the median
+# of the second half of the run. The steady state is summarized by its median
+# and a distribution free 95% confidence interval of the median.
+
+warmupWindow <- 5
+confidence <- 0.95
+
+# ---------------------------------------------------------------- worker ----
+
+# Counts collections with an object that is resurrected by its own finalizer.
+# Finalizers run shortly after the collection, therefore the count is exact
+# up to the last iteration boundary.
+gcCounter <- local({
+    count <- 0
+    sentinel <- function() {
+        reg.finalizer(new.env(), function(e) {
+            count <<- count + 1
+            sentinel()
+        })
+        invisible(NULL)
+    }
+    sentinel()
+    function() count
+})
+
+peakRss <- function() {
+    status <- "/proc/self/status"
+    if (!file.exists(status))
+        return(NA_real_)
+    line <- grep("^VmHWM:", readLines(status), value = TRUE)
+    if (length(line) == 0)
+        return(NA_real_)
+    # in kB
+    as.numeric(gsub("[^0-9]", "", line)) * 1024
+}
+
+pirCompileTime <- function(first) {
+    s <- pir.passStatistics()
+    if (nrow(s) < first)
+        return(0)
+    sum(s$ms[first:nrow(s)]) / 1000
+}
+
+runWorker <- function(program, iterations, compileTime, out) {
+    gc.time(TRUE)
+    e <- new.env()
+    sys.source(program, envir = e)
+    # the programs print their results
+    null <- file("/dev/null", "w")
+    sink(null)
+    if (compileTime)
+        pir.setDebugFlags(pir.debugFlags(PassStatistics = TRUE))
+
+    res <- data.frame(iteration = seq_len(iterations), time = NA_real_,
+                      gcTime = NA_real_, gcCount = NA_integer_,
+                      compileTime = NA_real_)
+    for (i in seq_len(iterations)) {
+        firstStatistic <- if (compileTime) nrow(pir.passStatistics()) + 1
+        gcTime <- gc.time()[[3]]
+        gcCount <- gcCounter()
+        time <- system.time(e$execute())[[3]]
+        res$time[[i]] <- time
+        res$gcTime[[i]] <- gc.time()[[3]] - gcTime
+        res$gcCount[[i]] <- gcCounter() - gcCount
+        if (compileTime)
+            res$compileTime[[i]] <- pirCompileTime(firstStatistic)
+    }
+    sink()
+    close(null)
+    saveRDS(list(iterations = res, peakRss = peakRss()), out)
+}
+
+# ------------------------------------------------------------ statistics ----
+
+# First iteration of the steady state
+steadyStart <- function(times) {
+    n <- length(times)
+    late <- times[(n %/% 2 + 1):n]
+    center <- median(late)
+    band <- max(3 * mad(late), 0.05 * center)
+    inBand <- abs(times - center) <= band
+    last <- max(1, n %/% 2 - warmupWindow + 1)
+    for (i in seq_len(last))
+        if (all(inBand[i:min(n, i + warmupWindow - 1)]))
+            return(i)
+    n %/% 2 + 1
+}
+
+# Order statistics bounding the median with the given confidence
+medianCi <- function(x) {
+    x <- sort(x)
+    n <- length(x)
+    k <- qbinom((1 - confidence) / 2, n, 0.5)
+    if (k < 1)
+        return(c(x[[1]], x[[n]]))
+    c(x[[k]], x[[n - k + 1]])
+}
+
+summarize <- function(program, mode, run) {
+    it <- run$iterations
+    start <- steadyStart(it$time)
+    steady <- it$time[start:nrow(it)]
+    ci <- medianCi(steady)
+    med <- median(steady)
+    data.frame(program = program, mode = mode, iterations = nrow(it),
+               warmupIterations = start - 1, firstIteration = it$time[[1]],
+               warmupOverhead = sum(it$time[seq_len(start - 1)]) -
+                   (start - 1) * med,
+               median = med, ciLow = ci[[1]], ciHigh = ci[[2]],
+               gcTime = sum(it$gcTime), gcCount = sum(it$gcCount),
+               compileTime = sum(it$compileTime), peakRss = run$peakRss,
+               stringsAsFactors = FALSE)
+}
+
+# -------------------------------------------------------------- output ----
+
+toJson <- function(x) {
+    quote <- function(s) paste0("\"", gsub("([\"\\\\])", "\\\\\\1", s), "\"")
+    if (is.data.frame(x))
+        x <- lapply(seq_len(nrow(x)), function(i) as.list(x[i, , drop = FALSE]))
+    if (is.list(x)) {
+        items <- vapply(x, toJson, "")
+        if (is.null(names(x)))
+            return(paste0("[", paste(items, collapse = ","), "]"))
+        return(paste0("{", paste(quote(names(x)), items, sep = ":",
+                                 collapse = ","), "}"))
+    }
+    values <- if (is.character(x)) quote(x) else
+        if (is.logical(x)) tolower(as.character(x)) else
+            format(x, digits = 15, scientific = FALSE, trim = TRUE)
+    values[is.na(x)] <- "null"
+    if (length(x) == 1) values else
+        paste0("[", paste(values, collapse = ","), "]")
+}
+
+checkRegressions <- function(summary, baseline, threshold) {
+    old <- read.csv(baseline, stringsAsFactors = FALSE)
+    both <- merge(summary, old, by = c("program", "mode"),
+                  suffixes = c("", ".baseline"))
+    # Only significant slowdowns count, i.e. the confidence intervals do not
+    # overlap and the medians differ by more than the threshold
+    slower <- both$ciLow > both$ciHigh.baseline &
+        both$median > both$median.baseline * (1 + threshold)
+    for (i in which(slower))
+        cat(sprintf("REGRESSION %-45s %-6s %.3fs -> %.3fs (%+.1f%%)\n",
+                    both$program[[i]], both$mode[[i]],
+                    both$median.baseline[[i]], both$median[[i]],
+                    100 * (both$median[[i]] / both$median.baseline[[i]] - 1)))
+    missing <- setdiff(paste(old$program, old$mode),
+                       paste(summary$program, summary$mode))
+    for (m in missing)
+        cat("not measured:", m, "\n")
+    !any(slower)
+}
+
+# ---------------------------------------------------------------- driver ----
+
+runDriver <- function(args) {
+    iterations <- 30
+    modes <- c("off", "on", "force")
+    out <- "harness"
+    baseline <- NULL
+    threshold <- 0.05
+    timeout <- 600
+    compileTime <- FALSE
+    programs <- c()
+    i <- 1
+    while (i <= length(args)) {
+        arg <- args[[i]]
+        value <- if (i < length(args)) args[[i + 1]] else NA
+        switch(arg,
+            "--iterations" = { iterations <- as.integer(value); i <- i + 1 },
+            "--modes" = { modes <- strsplit(value, ",")[[1]]; i <- i + 1 },
+            "--out" = { out <- value; i <- i + 1 },
+            "--baseline" = { baseline <- value; i <- i + 1 },
+            "--threshold" = { threshold <- as.numeric(value); i <- i + 1 },
+            "--timeout" = { timeout <- as.numeric(value); i <- i + 1 },
+            "--compile-time" = { compileTime <- TRUE },
+            programs <- c(programs, arg))
+        i <- i + 1
+    }
+    if (iterations < 2 * warmupWindow)
+        stop("need at least ", 2 * warmupWindow, " iterations")
+    out <- normalizePath(out, mustWork = FALSE)
+    if (!is.null(baseline))
+        baseline <- normalizePath(baseline)
+    setwd(benchmarks)
+    if (length(programs) == 0)
+        programs <- Sys.glob("shootout/*/*.r")
+
+    rscript <- file.path(R.home("bin"), "Rscript")
+    summaries <- list()
+    raw <- list()
+    for (program in programs) {
+        for (mode in modes) {
+            cat(sprintf("%-45s %-6s ", program, mode))
+            tmp <- tempfile(fileext = ".rds")
+            status <- system2(rscript,
+                              c(self, "--worker", program, iterations,
+                                compileTime, tmp),
+                              env = paste0("PIR_ENABLE=", mode),
+                              stdout = FALSE, stderr = FALSE,
+                              timeout = timeout)
+            if (status != 0 || !file.exists(tmp)) {
+                cat("FAILED\n")
+                next
+            }
+            run <- readRDS(tmp)
+            unlink(tmp)
+            s <- summarize(program, mode, run)
+            cat(sprintf("%.3fs [%.3f, %.3f] warm-up %d\n", s$median, s$ciLow,
+                        s$ciHigh, s$warmupIterations))
+            summaries[[length(summaries) + 1]] <- s
+            raw[[length(raw) + 1]] <- cbind(program = program, mode = mode,
+                                            run$iterations,
+                                            stringsAsFactors = FALSE)
+        }
+    }
+    if (length(summaries) == 0)
+        stop("all benchmarks failed")
+
+    summary <- do.call(rbind, summaries)
+    curves <- do.call(rbind, raw)
+    write.csv(summary, paste0(out, ".csv"), row.names = FALSE)
+    write.csv(curves, paste0(out, "-iterations.csv"), row.names = FALSE)
+    json <- list(
+        commit = tryCatch(system2("git", c("rev-parse", "HEAD"),
+                                  stdout = TRUE), error = function(e) NA),
+        date = format(Sys.time(), "%Y-%m-%dT%H:%M:%S"),
+        confidence = confidence,
+        summary = summary,
+        warmup = lapply(split(curves$time, paste(curves$program, curves$mode)),
+                        as.list))
+    writeLines(toJson(json), paste0(out, ".json"))
+
+    if (!is.null(baseline) && !checkRegressions(summary, baseline, threshold))
+        quit(status = 1)
+}
+
+self <- normalizePath(sub("^--file=", "", grep("^--file=", commandArgs(FALSE),
+                                               value = TRUE)[[1]]))
+benchmarks <- dirname(self)
+args <- commandArgs(trailingOnly = TRUE)
+if (length(args) > 0 && args[[1]] == "--worker") {
+    setwd(benchmarks)
+    runWorker(args[[2]], as.integer(args[[3]]), as.logical(args[[4]]),
+              args[[5]])
+} else {
+    runDriver(args)
+}
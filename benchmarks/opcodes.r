@@ -0,0 +1,30 @@
+# Measures the cost of single interpreter instructions (see
+# rir.microbenchmarks) and optionally compares them to an earlier run.
+#
+# Usage: tools/Rscript benchmarks/opcodes.r [out.csv [baseline.csv]]
+#
+# Every benchmark is repeated and the median is reported. Run it on two
+# revisions and pass the csv of the first as baseline to the second.
+
+args <- commandArgs(trailingOnly = TRUE)
+out <- if (length(args) > 0) args[[1]] else "opcodes.csv"
+baseline <- if (length(args) > 1) args[[2]] else NULL
+repeats <- 7
+iterations <- 20000L
+
+runs <- lapply(1:repeats, function(i) rir.microbenchmarks(iterations))
+res <- runs[[1]][c("opcode", "operands")]
+res$ns <- apply(sapply(runs, function(r) r$ns), 1, median)
+res$commit <- tryCatch(system2("git", c("rev-parse", "--short", "HEAD"),
+                                stdout = TRUE), error = function(e) NA)
+write.csv(res, out, row.names = FALSE)
+
+if (!is.null(baseline)) {
+    old <- read.csv(baseline, stringsAsFactors = FALSE)
+    res <- merge(res, old[c("opcode", "operands", "ns")],
+                 by = c("opcode", "operands"), all.x = TRUE,
+                 suffixes = c("", ".baseline"))
+    res$change <- sprintf("%+.1f%%", 100 * (res$ns / res$ns.baseline - 1))
+}
+res$commit <- NULL
+print(res, digits = 3, row.names = FALSE)
@@ -0,0 +1,31 @@
+# Measures the time pir.compile takes for all closures of some packages.
+#
+# Usage: tools/Rscript benchmarks/pir_compile_time.r [package ...]
+#
+# Translation to rir is done upfront and not measured. Run it on two
+# revisions to compare the compile time of the PIR pipeline, or let
+# tools/pir-compile-time-revisions.sh build and measure both.
+
+args <- commandArgs(trailingOnly = TRUE)
+packages <- if (length(args) > 0) args else c("base", "stats", "utils")
+repeats <- 5
+
+closures <- function(package) {
+    ns <- getNamespace(package)
+    fs <- mget(ls(ns, all.names = TRUE), envir = ns)
+    Filter(function(f) typeof(f) == "closure", fs)
+}
+
+for (package in packages) {
+    fs <- closures(package)
+    times <- numeric(repeats)
+    for (i in 1:repeats) {
+        # pir.compile does nothing on already optimized closures, so every
+        # run needs fresh copies
+        rfs <- lapply(fs, function(f) rir.compile(f))
+        times[[i]] <- system.time(
+            for (f in rfs) pir.compile(f))[[3]]
+    }
+    cat(sprintf("%-10s %5d closures: median %.3fs (min %.3fs, max %.3fs)\n",
+                package, length(fs), median(times), min(times), max(times)))
+}
@@ -0,0 +1,39 @@
+# Reports how many closures of the shootout benchmarks translate to PIR and
+# which opcodes make the others fail.
+#
+# Usage: tools/Rscript benchmarks/pir_coverage.r [program ...]
+#
+# Programs are paths relative to benchmarks/ and default to all of
+# shootout/*/*.r. They are only sourced, not run.
+
+args <- commandArgs(trailingOnly = TRUE)
+dir <- dirname(sub("^--file=", "",
+                   grep("^--file=", commandArgs(), value = TRUE)[[1]]))
+programs <- if (length(args) > 0) args else
+    file.path("shootout", list.files(file.path(dir, "shootout"),
+                                     pattern = "\\.r$", recursive = TRUE))
+
+compiled <- 0
+failed <- 0
+unsupported <- integer(0)
+for (program in programs) {
+    env <- new.env(parent = globalenv())
+    sys.source(file.path(dir, program), envir = env)
+    r <- pir.coverage(env)
+    cat(sprintf("%-45s %3d compiled %3d failed %s\n", program, r$compiled,
+                r$failed, paste(names(r$unsupported), collapse = " ")))
+    compiled <- compiled + r$compiled
+    failed <- failed + r$failed
+    for (op in names(r$unsupported))
+        unsupported[[op]] <- (if (is.na(unsupported[op])) 0L
+                              else unsupported[[op]]) + r$unsupported[[op]]
+}
+
+cat(sprintf("\ntotal: %d of %d closures compiled (%.1f%%)\n", compiled,
+            compiled + failed, 100 * compiled / max(1, compiled + failed)))
+if (length(unsupported) > 0) {
+    cat("failing opcodes:\n")
+    unsupported <- sort(unsupported, decreasing = TRUE)
+    for (op in names(unsupported))
+        cat(sprintf("  %-20s %d\n", op, unsupported[[op]]))
+}
@@ -9,8 +9,12 @@
 #include "compiler/pir_tests.h"
 #include "compiler/translations/pir_2_rir.h"
 #include "compiler/translations/rir_2_pir/rir_2_pir.h"
+#include "compiler/util/pass_statistics.h"
+#include "interpreter/deoptimizer.h"
 #include "interpreter/interp.h"
 #include "interpreter/interp_context.h"
+#include "interpreter/microbenchmarks.h"
+#include "interpreter/template_jit.h"
 #include "ir/BC.h"
 #include "ir/Compiler.h"
 
@@ -137,12 +141,15 @@ SEXP pirCompile(SEXP what, pir::DebugOptions debug) {
     if (!DispatchTable::check(BODY(what))) {
         Rf_error("Cannot optimize compiled expression, only closure");
     }
-    assert(DispatchTable::unpack(BODY(what))->capacity() == 2 &&
+    auto table = DispatchTable::unpack(BODY(what));
+    assert(table->capacity() == 2 &&
            "fix, support for more than 2 slots needed...");
-    if (DispatchTable::unpack(BODY(what))->available(1))
+    // A deoptimized version is replaced
+    if (table->available(1) && !table->at(1)->deopt)
         return what;
 
     Protect p(what);
+    size_t firstStatistic = pir::PassStatistics::entries().size();
 
     // compile to pir
     pir::Module* m = new pir::Module;
@@ -160,6 +167,9 @@ SEXP pirCompile(SEXP what, pir::DebugOptions debug) {
                                std::cerr << "Compilation failed\n";
                        });
 
+    if (debug.includes(pir::DebugFlag::PassStatistics))
+        pir::PassStatistics::print(std::cout, firstStatistic);
+
     delete m;
     return what;
 }
@@ -170,6 +180,153 @@ REXPORT SEXP pir_compile(SEXP what, SEXP debugFlags) {
     return pirCompile(what, pir::DebugOptions(INTEGER(debugFlags)[0]));
 }
 
+REXPORT SEXP pir_coverage(SEXP what) {
+    if (TYPEOF(what) != VECSXP)
+        Rf_error("pir_coverage expects a list of closures");
+
+    pir::Module* m = new pir::Module;
+    pir::Rir2PirCompiler cmp(m, PirDebug);
+    int compiled = 0;
+    int failed = 0;
+    for (int i = 0; i < Rf_length(what); ++i) {
+        SEXP fun = VECTOR_ELT(what, i);
+        if (TYPEOF(fun) != CLOSXP)
+            continue;
+        Protect p;
+        fun = p(rir_compile(fun, CLOENV(fun)));
+        cmp.compileClosure(fun, [&](pir::Closure*) { compiled++; },
+                           [&]() { failed++; });
+    }
+    delete m;
+
+    auto& unsupported = cmp.unsupportedOpcodes();
+    Protect p;
+    SEXP opcodes = p(Rf_allocVector(INTSXP, unsupported.size()));
+    SEXP opcodeNames = p(Rf_allocVector(STRSXP, unsupported.size()));
+    size_t pos = 0;
+    for (auto& e : unsupported) {
+        INTEGER(opcodes)[pos] = e.second;
+        SET_STRING_ELT(opcodeNames, pos, Rf_mkChar(BC::name(e.first)));
+        pos++;
+    }
+    Rf_setAttrib(opcodes, R_NamesSymbol, opcodeNames);
+
+    SEXP res = p(Rf_allocVector(VECSXP, 3));
+    SEXP resNames = p(Rf_allocVector(STRSXP, 3));
+    SET_VECTOR_ELT(res, 0, Rf_ScalarInteger(compiled));
+    SET_STRING_ELT(resNames, 0, Rf_mkChar("compiled"));
+    SET_VECTOR_ELT(res, 1, Rf_ScalarInteger(failed));
+    SET_STRING_ELT(resNames, 1, Rf_mkChar("failed"));
+    SET_VECTOR_ELT(res, 2, opcodes);
+    SET_STRING_ELT(resNames, 2, Rf_mkChar("unsupported"));
+    Rf_setAttrib(res, R_NamesSymbol, resNames);
+    return res;
+}
+
+REXPORT SEXP pir_passStatistics(SEXP reset) {
+    auto& entries = pir::PassStatistics::entries();
+    size_t n = entries.size();
+
+    Protect p;
+    SEXP pass = p(Rf_allocVector(STRSXP, n));
+    SEXP closure = p(Rf_allocVector(STRSXP, n));
+    SEXP ms = p(Rf_allocVector(REALSXP, n));
+    SEXP instrsBefore = p(Rf_allocVector(INTSXP, n));
+    SEXP instrsAfter = p(Rf_allocVector(INTSXP, n));
+    SEXP bbsBefore = p(Rf_allocVector(INTSXP, n));
+    SEXP bbsAfter = p(Rf_allocVector(INTSXP, n));
+    for (size_t i = 0; i < n; ++i) {
+        auto& e = entries[i];
+        SET_STRING_ELT(pass, i, Rf_mkChar(e.pass.c_str()));
+        SET_STRING_ELT(closure, i, Rf_mkChar(e.closure.c_str()));
+        REAL(ms)[i] = e.ms;
+        INTEGER(instrsBefore)[i] = e.instrsBefore;
+        INTEGER(instrsAfter)[i] = e.instrsAfter;
+        INTEGER(bbsBefore)[i] = e.bbsBefore;
+        INTEGER(bbsAfter)[i] = e.bbsAfter;
+    }
+
+    const char* names[] = {"pass",         "closure",     "ms",
+                           "instrsBefore", "instrsAfter", "bbsBefore",
+                           "bbsAfter"};
+    SEXP columns[] = {pass,         closure,     ms,       instrsBefore,
+                      instrsAfter,  bbsBefore,   bbsAfter};
+    size_t ncol = sizeof(columns) / sizeof(SEXP);
+    SEXP res = p(Rf_allocVector(VECSXP, ncol));
+    SEXP resNames = p(Rf_allocVector(STRSXP, ncol));
+    for (size_t i = 0; i < ncol; ++i) {
+        SET_VECTOR_ELT(res, i, columns[i]);
+        SET_STRING_ELT(resNames, i, Rf_mkChar(names[i]));
+    }
+    Rf_setAttrib(res, R_NamesSymbol, resNames);
+
+    if (Rf_asLogical(reset))
+        pir::PassStatistics::clear();
+    return res;
+}
+
+REXPORT SEXP rir_enableDeoptLog(SEXP enable) {
+    return Rf_ScalarLogical(Reoptimizer::enableLog(Rf_asLogical(enable)));
+}
+
+REXPORT SEXP rir_deoptLog(SEXP reset) {
+    auto& entries = Reoptimizer::entries();
+    size_t n = entries.size();
+
+    Protect p;
+    SEXP event = p(Rf_allocVector(STRSXP, n));
+    SEXP function = p(Rf_allocVector(STRSXP, n));
+    SEXP deopt = p(Rf_allocVector(INTSXP, n));
+    SEXP count = p(Rf_allocVector(INTSXP, n));
+    SEXP invocations = p(Rf_allocVector(INTSXP, n));
+    for (size_t i = 0; i < n; ++i) {
+        auto& e = entries[i];
+        SET_STRING_ELT(event, i, Rf_mkChar(e.event.c_str()));
+        SET_STRING_ELT(function, i, Rf_mkChar(e.function.c_str()));
+        INTEGER(deopt)[i] = e.id == NO_DEOPT_INFO ? NA_INTEGER : (int)e.id;
+        INTEGER(count)[i] = e.count;
+        INTEGER(invocations)[i] = e.invocations;
+    }
+
+    const char* names[] = {"event", "function", "deopt", "count",
+                           "invocations"};
+    SEXP columns[] = {event, function, deopt, count, invocations};
+    size_t ncol = sizeof(columns) / sizeof(SEXP);
+    SEXP res = p(Rf_allocVector(VECSXP, ncol));
+    SEXP resNames = p(Rf_allocVector(STRSXP, ncol));
+    for (size_t i = 0; i < ncol; ++i) {
+        SET_VECTOR_ELT(res, i, columns[i]);
+        SET_STRING_ELT(resNames, i, Rf_mkChar(names[i]));
+    }
+    Rf_setAttrib(res, R_NamesSymbol, resNames);
+
+    if (Rf_asLogical(reset))
+        Reoptimizer::clear();
+    return res;
+}
+
+REXPORT SEXP rir_microbenchmarks(SEXP iterations, SEXP filter) {
+    if (TYPEOF(filter) != STRSXP || Rf_length(filter) != 1)
+        Rf_error("rir_microbenchmarks expects a string as filter");
+    int n = Rf_asInteger(iterations);
+    if (n == NA_INTEGER || n < 1)
+        Rf_error("rir_microbenchmarks expects a positive number of iterations");
+    return Microbenchmarks::run(n, CHAR(STRING_ELT(filter, 0)));
+}
+
+REXPORT SEXP rir_jit(SEXP what) {
+    if (!isValidClosureSEXP(what))
+        Rf_error("Not a valid rir compiled function");
+    // The optimized version, if calls dispatch to it
+    auto table = DispatchTable::unpack(BODY(what));
+    ::Function* f = table->at(0);
+    if (table->capacity() > 1 && table->available(1) && !table->at(1)->deopt)
+        f = table->at(1);
+    if (!f->native())
+        TemplateJit::compile(f);
+    return Rf_ScalarLogical(TYPEOF(f->native()) == EXTPTRSXP);
+}
+
 REXPORT SEXP pir_tests() {
     PirTests::run();
     return R_NilValue;
@@ -10,6 +10,7 @@
 extern int R_ENABLE_JIT;
 
 REXPORT SEXP rir_eval(SEXP, SEXP);
+REXPORT SEXP rir_compile(SEXP, SEXP);
 REXPORT SEXP pir_compile(SEXP, SEXP);
 SEXP pirCompile(SEXP, const rir::pir::DebugOptions);
 
@@ -10,6 +10,11 @@ bool Query::noEnv(Code* c) {
                           [](Instruction* i) { return !MkEnv::Cast(i); });
 }
 
+bool Query::noDeopt(Code* c) {
+    return Visitor::check(c->entry,
+                          [](Instruction* i) { return !Deopt::Cast(i); });
+}
+
 bool Query::pure(Code* c) {
     return Visitor::check(c->entry, [](Instruction* i) {
         return !i->mightIO() && !i->changesEnv();
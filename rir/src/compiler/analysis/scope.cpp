@@ -122,6 +122,11 @@ void TheScopeAnalysis::apply(AS& envs, Instruction* i) const {
         if (i->leaksEnv()) {
             envs[i->env()].leaked = true;
         }
+        // The callers a deopt continues in see all their variables
+        if (auto deopt = Deopt::Cast(i)) {
+            for (size_t f = 1; f < deopt->frames.size(); ++f)
+                envs[deopt->frameEnv(f)].leaked = true;
+        }
         if (i->changesEnv()) {
             envs[i->env()].taint();
         }
@@ -187,6 +192,11 @@ ScopeAnalysis::ScopeAnalysis(Closure* function) {
                 for (auto env : envs.potentialParents(i->env()))
                     allStoresObserved.insert(env);
             }
+            if (auto deopt = Deopt::Cast(i)) {
+                for (size_t f = 1; f < deopt->frames.size(); ++f)
+                    for (auto env : envs.potentialParents(deopt->frameEnv(f)))
+                        allStoresObserved.insert(env);
+            }
         });
 }
 }
@@ -24,7 +24,8 @@ namespace pir {
     V(DryRun)                                                                  \
     V(PreserveVersions)                                                        \
     V(DebugAllocator)                                                          \
-    LIST_OF_PIR_PRINT_DEBUGGING_FLAGS(V)
+    LIST_OF_PIR_PRINT_DEBUGGING_FLAGS(V)                                       \
+    V(PassStatistics)
 
 enum class DebugFlag {
 #define V(n) n,
@@ -32,7 +33,7 @@ enum class DebugFlag {
 #undef V
 
         FIRST = ShowWarnings,
-    LAST = PrintFinalRir
+    LAST = PassStatistics
 };
 
 typedef EnumSet<DebugFlag> DebugOptions;
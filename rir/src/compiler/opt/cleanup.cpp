@@ -66,6 +66,10 @@ class TheCleanup {
             }
         });
 
+        // Default arguments are only referenced from the prologue, but
+        // Closure::defaultArgs points to them, so they have to stay around
+        function->eachDefaultArg([&](Promise* p) { used_p.insert(p->id); });
+
         // Recursively serach promises for referencs to other promises
         std::deque<Promise*> todo;
         for (size_t i = 0; i < function->promises.size(); ++i) {
@@ -0,0 +1,271 @@
+#include "constant_fold.h"
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+#include "R/r.h"
+#include "utils/Pool.h"
+
+#include <climits>
+#include <cmath>
+#include <unordered_set>
+#include <vector>
+
+namespace {
+
+using namespace rir;
+using namespace rir::pir;
+
+// Scalars without attributes, the builtins never dispatch on them
+SEXP plainScalar(Value* v) {
+    auto ld = LdConst::Cast(v);
+    if (!ld)
+        return nullptr;
+    SEXP c = ld->c;
+    if ((TYPEOF(c) != LGLSXP && TYPEOF(c) != INTSXP && TYPEOF(c) != REALSXP) ||
+        XLENGTH(c) != 1 || ATTRIB(c) != R_NilValue)
+        return nullptr;
+    return c;
+}
+
+// NA or NaN
+bool isNA(SEXP c) {
+    if (TYPEOF(c) == REALSXP)
+        return ISNAN(REAL(c)[0]);
+    return INTEGER(c)[0] == NA_INTEGER;
+}
+
+double asReal(SEXP c) {
+    if (TYPEOF(c) == REALSXP)
+        return REAL(c)[0];
+    return INTEGER(c)[0] == NA_INTEGER ? NA_REAL : INTEGER(c)[0];
+}
+
+// The truth value of a number, NA_LOGICAL for NA and NaN
+int truth(SEXP c) {
+    if (isNA(c))
+        return NA_LOGICAL;
+    return asReal(c) != 0;
+}
+
+SEXP logicalConst(int l) {
+    if (l == NA_LOGICAL)
+        return R_LogicalNAValue;
+    return l ? R_TrueValue : R_FalseValue;
+}
+
+SEXP intConst(int i) { return Pool::get(Pool::getInt(i)); }
+
+// The pool keys the numbers by value, which does not work for NaN and does
+// not tell 0 and -0 apart. Such results are left to the runtime.
+SEXP realConst(double d) {
+    if (ISNAN(d) || (d == 0 && std::signbit(d)))
+        return nullptr;
+    return Pool::get(Pool::getNum(d));
+}
+
+SEXP foldArith(Instruction* i, SEXP a, SEXP b) {
+    // Integer division gives a double
+    if (TYPEOF(a) != REALSXP && TYPEOF(b) != REALSXP && !Div::Cast(i)) {
+        if (isNA(a) || isNA(b))
+            return intConst(NA_INTEGER);
+        double x = INTEGER(a)[0], y = INTEGER(b)[0], r;
+        switch (i->tag) {
+        case Tag::Add:
+            r = x + y;
+            break;
+        case Tag::Sub:
+            r = x - y;
+            break;
+        default:
+            r = x * y;
+            break;
+        }
+        // Overflows give NA with a warning
+        if (r > INT_MAX || r < -INT_MAX)
+            return nullptr;
+        return intConst(r);
+    }
+    double x = asReal(a), y = asReal(b);
+    switch (i->tag) {
+    case Tag::Add:
+        return realConst(x + y);
+    case Tag::Sub:
+        return realConst(x - y);
+    case Tag::Mul:
+        return realConst(x * y);
+    case Tag::Div:
+        return realConst(x / y);
+    default:
+        return nullptr;
+    }
+}
+
+SEXP foldRelop(Instruction* i, SEXP a, SEXP b) {
+    if (isNA(a) || isNA(b))
+        return R_LogicalNAValue;
+    double x = asReal(a), y = asReal(b);
+    switch (i->tag) {
+    case Tag::Lt:
+        return logicalConst(x < y);
+    case Tag::Lte:
+        return logicalConst(x <= y);
+    case Tag::Gt:
+        return logicalConst(x > y);
+    case Tag::Gte:
+        return logicalConst(x >= y);
+    case Tag::Eq:
+        return logicalConst(x == y);
+    case Tag::Neq:
+        return logicalConst(x != y);
+    default:
+        return nullptr;
+    }
+}
+
+// The constant value of i, or nullptr
+SEXP foldConstant(Instruction* i) {
+    switch (i->tag) {
+    case Tag::Add:
+    case Tag::Sub:
+    case Tag::Mul:
+    case Tag::Div: {
+        SEXP a = plainScalar(i->arg(0).val());
+        SEXP b = plainScalar(i->arg(1).val());
+        if (!a || !b)
+            return nullptr;
+        return foldArith(i, a, b);
+    }
+    case Tag::Lt:
+    case Tag::Lte:
+    case Tag::Gt:
+    case Tag::Gte:
+    case Tag::Eq:
+    case Tag::Neq: {
+        SEXP a = plainScalar(i->arg(0).val());
+        SEXP b = plainScalar(i->arg(1).val());
+        if (!a || !b)
+            return nullptr;
+        return foldRelop(i, a, b);
+    }
+    case Tag::Not: {
+        SEXP a = plainScalar(i->arg(0).val());
+        if (!a)
+            return nullptr;
+        int t = truth(a);
+        return logicalConst(t == NA_LOGICAL ? NA_LOGICAL : !t);
+    }
+    case Tag::AsLogical: {
+        SEXP a = plainScalar(i->arg(0).val());
+        if (!a)
+            return nullptr;
+        return logicalConst(truth(a));
+    }
+    default:
+        return nullptr;
+    }
+}
+
+// A simpler value equal to i, or nullptr
+Value* simplify(Instruction* i) {
+    static const PirType plainLogical =
+        PirType(RType::logical).scalar().noAttribs();
+    if (auto n = Not::Cast(i)) {
+        auto inner = Not::Cast(n->arg<0>().val());
+        if (inner && inner->arg<0>().val()->type.isA(plainLogical))
+            return inner->arg<0>().val();
+    } else if (auto l = AsLogical::Cast(i)) {
+        if (l->arg<0>().val()->type.isA(plainLogical))
+            return l->arg<0>().val();
+    }
+    return nullptr;
+}
+
+// The value of a test, -1 if it is not known at compile time
+int knownTest(Value* v) {
+    // Branches test for R_FalseValue (see brfalse_)
+    if (auto ld = LdConst::Cast(v)) {
+        if (ld->c == R_TrueValue || ld->c == R_FalseValue)
+            return ld->c == R_TrueValue;
+    } else if (auto t = AsTest::Cast(v)) {
+        auto ld = LdConst::Cast(t->arg<0>().val());
+        if (ld && TYPEOF(ld->c) == LGLSXP && XLENGTH(ld->c) == 1 &&
+            LOGICAL(ld->c)[0] != NA_LOGICAL)
+            return LOGICAL(ld->c)[0] != 0;
+    } else if (auto id = Identical::Cast(v)) {
+        // identical_ compares pointers and constants are not copied
+        Value* a = id->arg<0>().val();
+        Value* b = id->arg<1>().val();
+        if (a == b)
+            return 1;
+        auto la = LdConst::Cast(a);
+        auto lb = LdConst::Cast(b);
+        if (la && lb)
+            return la->c == lb->c;
+    }
+    return -1;
+}
+
+} // namespace
+
+namespace rir {
+namespace pir {
+
+void ConstantFold::apply(Closure* function) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        std::vector<BB*> blocks;
+        Visitor::run(function->entry, [&](BB* bb) {
+            blocks.push_back(bb);
+            auto ip = bb->begin();
+            while (ip != bb->end()) {
+                Instruction* i = *ip;
+                auto next = ip + 1;
+                if (SEXP c = foldConstant(i)) {
+                    auto ld = new LdConst(c);
+                    i->replaceUsesWith(ld);
+                    bb->replace(ip, ld);
+                    changed = true;
+                } else if (Value* v = simplify(i)) {
+                    i->replaceUsesWith(v);
+                    next = bb->remove(ip);
+                    changed = true;
+                }
+                ip = next;
+            }
+        });
+
+        bool jumps = false;
+        for (auto bb : blocks) {
+            if (bb->isEmpty() || !Branch::Cast(bb->last()))
+                continue;
+            int test = knownTest(bb->last()->arg(0).val());
+            if (test == -1)
+                continue;
+            bb->remove(bb->end() - 1);
+            if (test)
+                bb->next0 = bb->next1;
+            bb->next1 = nullptr;
+            jumps = true;
+        }
+        if (!jumps)
+            continue;
+        changed = true;
+
+        std::unordered_set<BB*> reachable;
+        Visitor::run(function->entry, [&](BB* bb) { reachable.insert(bb); });
+        std::unordered_set<BB*> dead;
+        for (auto bb : blocks)
+            if (!reachable.count(bb))
+                dead.insert(bb);
+        for (auto bb : reachable)
+            for (auto i : *bb)
+                if (auto phi = Phi::Cast(i))
+                    phi->removeInputs(dead);
+        for (auto bb : dead) {
+            bb->next0 = bb->next1 = nullptr;
+            delete bb;
+        }
+    }
+}
+}
+}
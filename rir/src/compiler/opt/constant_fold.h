@@ -0,0 +1,27 @@
+#ifndef PIR_CONSTANT_FOLD_H
+#define PIR_CONSTANT_FOLD_H
+
+#include "../translations/pir_translator.h"
+
+namespace rir {
+namespace pir {
+
+/*
+ * Evaluates arithmetic, relational and logical operations on constant plain
+ * scalars (which cannot dispatch) with R semantics, and simplifies !!x of a
+ * logical scalar. Branches on tests known at compile time (AsTest of a
+ * constant, Identical of the same value or of two constants) become jumps,
+ * and the blocks that are no longer reachable are removed.
+ *
+ */
+class Closure;
+class ConstantFold : public PirTranslator {
+  public:
+    ConstantFold() : PirTranslator("constant fold"){};
+
+    void apply(Closure* function) override;
+};
+}
+}
+
+#endif
@@ -11,6 +11,16 @@ namespace pir {
 
 void DelayEnv::apply(Closure* function) {
     std::vector<MkEnv*> envs;
+    CFG cfg(function);
+
+    // No instruction reachable from start uses the env e
+    auto unusedFrom = [](BB* start, MkEnv* e) {
+        return Visitor::check(start, [&](Instruction* i) {
+            bool used = false;
+            i->eachArg([&](Value* v) { used = used || v == e; });
+            return !used;
+        });
+    };
 
     Visitor::run(function->entry, [&](BB* bb) {
         std::unordered_set<MkEnv*> done;
@@ -58,7 +68,8 @@ void DelayEnv::apply(Closure* function) {
 
                 {
                     auto st = StVar::Cast(next);
-                    if (st && st->env() == e) {
+                    // MkEnv cannot mark a binding as missing
+                    if (st && st->env() == e && !st->isStArg) {
                         consumeStVar(st);
                         it = bb->remove(it + 1);
                         it--;
@@ -76,6 +87,7 @@ void DelayEnv::apply(Closure* function) {
             if (it != bb->end() && (it + 1) != bb->end()) {
                 auto b = Branch::Cast(*(it + 1));
                 if (e && b) {
+                    bool moved = false;
                     if (!bb->next0->isEmpty()) {
                         auto d = Deopt::Cast(bb->next0->last());
                         if (d) {
@@ -86,8 +98,23 @@ void DelayEnv::apply(Closure* function) {
                             Replace::usesOfValue(newE, e, newE);
                             it = bb->moveToBegin(it, bb->next0);
                             it = bb->moveToBegin(it, bb->next1);
+                            moved = true;
                         }
                     }
+                    // If only one of the branches needs the env, it is only
+                    // created there. Its bindings stay in the args of the
+                    // MkEnv until then.
+                    if (!moved) {
+                        BB* target = nullptr;
+                        if (cfg.hasSinglePred(bb->next1) &&
+                            unusedFrom(bb->next0, e))
+                            target = bb->next1;
+                        else if (cfg.hasSinglePred(bb->next0) &&
+                                 unusedFrom(bb->next1, e))
+                            target = bb->next0;
+                        if (target)
+                            bb->moveToBegin(it, target);
+                    }
                 }
             }
         }
@@ -9,7 +9,12 @@ namespace pir {
 /*
  * The DelayEnv pass tries to delay the scheduling of `MkEnv` instructions as
  * much as possible. In case an environment is only necessary in some traces,
- * the goal is to move it out of the others.
+ * the goal is to move it out of the others: past branches whose other side
+ * deoptimizes or never uses the environment. On the traces without the MkEnv
+ * the bindings stay in its arguments, i.e. in locals after pir2rir.
+ *
+ * This only covers optimized code. Lazy baseline frames are still to be done,
+ * see the TODO at closureArgumentAdaptor.
  *
  */
 
@@ -0,0 +1,212 @@
+#include "elide_bounds_checks.h"
+#include "../pir/pir_impl.h"
+#include "../transform/bb.h"
+#include "../util/cfg.h"
+#include "../util/visitor.h"
+#include "R/r.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace {
+
+using namespace rir::pir;
+
+// The value of a is computed before b on every path to b
+bool availableAt(Value* a, Instruction* b, const DominanceGraph& dom) {
+    auto i = Instruction::Cast(a);
+    if (!i)
+        return true;
+    if (i->bb() == b->bb())
+        return i->bb()->indexOf(i) < b->bb()->indexOf(b);
+    return dom.dominates(i->bb(), b->bb());
+}
+
+bool inBlockOrDominated(BB* a, Instruction* b, const DominanceGraph& dom) {
+    return a == b->bb() || dom.dominates(a, b->bb());
+}
+
+bool isNonNegativeInt(Value* v) {
+    auto ld = LdConst::Cast(v);
+    if (!ld || TYPEOF(ld->c) != INTSXP || XLENGTH(ld->c) != 1)
+        return false;
+    int i = INTEGER(ld->c)[0];
+    return i != NA_INTEGER && i >= 0;
+}
+
+// The counter of a for loop starts at 0 and is only ever incremented
+bool isLoopCounter(Inc* inc) {
+    auto phi = Phi::Cast(inc->arg<0>().val());
+    if (!phi)
+        return false;
+    bool res = true;
+    phi->eachArg([&](BB*, Value* v) {
+        if (v != inc && !isNonNegativeInt(v))
+            res = false;
+    });
+    return res;
+}
+
+// The vector an element was extracted from
+Value* extractedFrom(Value* v) {
+    if (auto e = Extract2_1D::Cast(v))
+        return e->arg<0>().val();
+    if (auto e = Extract2_1DUnchecked::Cast(v))
+        return e->arg<0>().val();
+    return nullptr;
+}
+
+// In `body`, which is only entered if `!(size < counter)`, the counter is a
+// valid index into the loop sequence
+struct LoopBody {
+    ForSeqSize* size;
+    Inc* counter;
+    BB* body;
+};
+
+struct Versioned {
+    Extract2_1D* extract;
+    ForSeqSize* loop;
+    Value* guarded;
+};
+
+void replaceUnchecked(Extract2_1D* e) {
+    auto unchecked =
+        new Extract2_1DUnchecked(e->arg<0>().val(), e->arg<1>().val());
+    unchecked->type = e->type;
+    e->replaceUsesWith(unchecked);
+    BB* bb = e->bb();
+    bb->replace(std::find(bb->begin(), bb->end(), e), unchecked);
+}
+
+// Splits the block at e into
+//
+//   if (guard) Extract2_1DUnchecked else e
+//
+// and merges the results with a phi
+void version(Closure* function, Extract2_1D* e, InBounds* guard) {
+    BB* bb = e->bb();
+    BB* cont = BBTransform::split(function->nextBBId++, bb,
+                                  std::find(bb->begin(), bb->end(), e),
+                                  function);
+    BB* fast = new BB(function, function->nextBBId++);
+    BB* slow = new BB(function, function->nextBBId++);
+
+    auto phi = new Phi();
+    e->replaceUsesWith(phi);
+    cont->moveToEnd(cont->begin(), slow);
+
+    auto unchecked =
+        new Extract2_1DUnchecked(e->arg<0>().val(), e->arg<1>().val());
+    unchecked->type = e->type;
+    fast->append(unchecked);
+
+    phi->addInput(fast, unchecked);
+    phi->addInput(slow, e);
+    phi->type = e->type;
+    cont->insert(cont->begin(), phi);
+
+    bb->append(new Branch(guard));
+    bb->next0 = slow;
+    bb->next1 = fast;
+    fast->next0 = cont;
+    slow->next0 = cont;
+}
+
+} // namespace
+
+namespace rir {
+namespace pir {
+
+void ElideBoundsChecks::apply(Closure* function) {
+    std::vector<ForSeqSize*> loops;
+    std::vector<LoopBody> bodies;
+    std::vector<Extract2_1D*> extracts;
+    {
+        CFG cfg(function);
+        Visitor::run(function->entry, [&](Instruction* i) {
+            if (auto size = ForSeqSize::Cast(i)) {
+                loops.push_back(size);
+            } else if (auto e = Extract2_1D::Cast(i)) {
+                extracts.push_back(e);
+            } else if (auto branch = Branch::Cast(i)) {
+                Value* test = branch->arg<0>().val();
+                while (AsTest::Cast(test) || AsLogical::Cast(test))
+                    test = Instruction::Cast(test)->arg(0).val();
+                auto lt = Lt::Cast(test);
+                if (!lt)
+                    return;
+                auto size = ForSeqSize::Cast(lt->arg<0>().val());
+                auto counter = Inc::Cast(lt->arg<1>().val());
+                BB* body = branch->bb()->next0;
+                if (size && counter && isLoopCounter(counter) &&
+                    cfg.hasSinglePred(body))
+                    bodies.push_back({size, counter, body});
+            }
+        });
+    }
+    if (loops.empty())
+        return;
+
+    DominanceGraph dom(function);
+
+    // The element extracts of the loops themselves
+    std::vector<Extract2_1D*> user;
+    for (auto e : extracts) {
+        bool proven = false;
+        for (auto& l : bodies) {
+            if (e->arg<0>().val() == l.size->arg<0>().val() &&
+                e->arg<1>().val() == l.counter &&
+                inBlockOrDominated(l.body, e, dom))
+                proven = true;
+        }
+        if (proven)
+            replaceUnchecked(e);
+        else
+            user.push_back(e);
+    }
+
+    // Extracts indexed by an element of the sequence of a surrounding loop
+    std::vector<Versioned> versioned;
+    for (auto e : user) {
+        Value* seq = extractedFrom(e->arg<1>().val());
+        if (!seq)
+            continue;
+        for (auto loop : loops) {
+            if (loop->arg<0>().val() != seq || !availableAt(loop, e, dom))
+                continue;
+            Value* vec = e->arg<0>().val();
+            if (!availableAt(vec, loop, dom)) {
+                // x is forced in the loop, but it might be forced already
+                auto force = Force::Cast(vec);
+                if (!force || !availableAt(force->arg<0>().val(), loop, dom))
+                    continue;
+                vec = force->arg<0>().val();
+            }
+            versioned.push_back({e, loop, vec});
+            break;
+        }
+    }
+
+    std::map<std::pair<ForSeqSize*, Value*>, InBounds*> guards;
+    for (auto& v : versioned) {
+        InBounds*& guard = guards[{v.loop, v.guarded}];
+        if (!guard) {
+            // For from:to all elements are between the bounds
+            Value* seq = v.loop->arg<0>().val();
+            Value* from = seq;
+            Value* to = seq;
+            if (auto colon = Colon::Cast(seq)) {
+                from = colon->arg<0>().val();
+                to = colon->arg<1>().val();
+            }
+            guard = new InBounds(v.guarded, from, to);
+            BB* bb = v.loop->bb();
+            bb->insert(std::find(bb->begin(), bb->end(), v.loop) + 1, guard);
+        }
+        version(function, v.extract, guard);
+    }
+}
+}
+}
@@ -0,0 +1,33 @@
+#ifndef PIR_ELIDE_BOUNDS_CHECKS_H
+#define PIR_ELIDE_BOUNDS_CHECKS_H
+
+namespace rir {
+namespace pir {
+
+/*
+ * Removes the index checks of x[[i]] in for loops. In
+ *
+ *   for (i in seq) ... x[[i]] ...
+ *
+ * the loop itself extracts seq[[k]] for a counter k, which starts at 0 and is
+ * incremented until it exceeds ForSeqSize(seq). Where the loop condition
+ * holds, k is a valid index and the extract is replaced by an
+ * Extract2_1DUnchecked.
+ *
+ * The user extract x[[i]], where i is an element of seq and x is computed
+ * before the loop, is versioned on a single InBounds guard placed before the
+ * loop. It checks that x is a plain vector and that every element of seq is a
+ * valid index into x. For seq = from:to only the bounds of the range are
+ * checked. If x is forced in the loop, the guard checks the value of the
+ * promise, i.e. it only succeeds if the promise was forced before the loop.
+ *
+ */
+class Closure;
+class ElideBoundsChecks {
+  public:
+    static void apply(Closure* function);
+};
+}
+}
+
+#endif
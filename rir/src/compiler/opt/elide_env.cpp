@@ -16,6 +16,10 @@ void ElideEnv::apply(Closure* function) {
     Visitor::run(function->entry, [&](Instruction* i) {
         if (i->hasEnv() && !StVar::Cast(i))
             envNeeded.insert(i->env());
+        // The callers a deopt continues in
+        if (auto deopt = Deopt::Cast(i))
+            for (size_t f = 1; f < deopt->frames.size(); ++f)
+                envNeeded.insert(deopt->frameEnv(f));
         if (!Env::isPirEnv(i) && i->hasEnv())
             envDependency[i] = i->env();
     });
@@ -1,5 +1,6 @@
 #include "force_dominance.h"
 #include "../analysis/generic_static_analysis.h"
+#include "../analysis/query.h"
 #include "../pir/pir_impl.h"
 #include "../transform/bb.h"
 #include "../transform/replace.h"
@@ -174,7 +175,10 @@ void ForceDominance::apply(Closure* cls) {
                             f->replaceUsesWith(strict);
                             next = bb->remove(ip);
                             inlinedPromise[f] = strict;
-                        } else if (analysis.isSafeToInline(mkarg)) {
+                        } else if (analysis.isSafeToInline(mkarg) &&
+                                   // a deopt in the promise would need the
+                                   // frame state at the force to continue
+                                   Query::noDeopt(mkarg->prom)) {
                             Promise* prom = mkarg->prom;
                             BB* split = BBTransform::split(cls->nextBBId++, bb,
                                                            ip, cls);
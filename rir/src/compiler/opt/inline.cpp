@@ -1,10 +1,14 @@
 #include "inline.h"
+#include "../analysis/query.h"
 #include "../pir/pir_impl.h"
 #include "../transform/bb.h"
 #include "../transform/replace.h"
 #include "../util/cfg.h"
 #include "../util/visitor.h"
+#include "R/Symbols.h"
 #include "R/r.h"
+#include "interpreter/runtime.h"
+#include "runtime/Function.h"
 
 #include <algorithm>
 #include <unordered_map>
@@ -13,6 +17,52 @@ namespace {
 
 using namespace rir::pir;
 
+// Whether the expression needs the closure context of the function it is
+// evaluated in, e.g. to return from it or to inspect its call.
+static bool usesContext(SEXP e) {
+    static const std::vector<SEXP> reflective = {
+        rir::symbol::Return,       Rf_install("sys.call"),
+        Rf_install("sys.function"), Rf_install("sys.frame"),
+        Rf_install("sys.nframe"),  Rf_install("sys.calls"),
+        Rf_install("sys.frames"),  Rf_install("sys.parent"),
+        Rf_install("sys.parents"), Rf_install("sys.on.exit"),
+        Rf_install("sys.status"),  Rf_install("parent.frame"),
+        Rf_install("on.exit"),     Rf_install("match.call"),
+        Rf_install("match.arg"),   Rf_install("nargs"),
+        Rf_install("Recall"),      Rf_install("UseMethod"),
+        Rf_install("NextMethod"),  rir::symbol::standardGeneric};
+
+    if (TYPEOF(e) != LANGSXP)
+        return false;
+    SEXP fun = CAR(e);
+    // Inner closures get a context of their own when called
+    if (fun == rir::symbol::Function)
+        return false;
+    if (std::find(reflective.begin(), reflective.end(), fun) !=
+        reflective.end())
+        return true;
+    for (; e != R_NilValue; e = CDR(e))
+        if (usesContext(CAR(e)))
+            return true;
+    return false;
+}
+
+// A deopt of inlined code resumes the baseline code of the callee without a
+// closure context (see deoptimize in interp.cpp). Such callees must not need
+// one.
+static bool deoptsNeedContext(Closure* inlinee) {
+    return !Visitor::check(inlinee->entry, [](Instruction* i) {
+        if (auto deopt = Deopt::Cast(i)) {
+            for (auto& frame : deopt->frames) {
+                auto body = frame.code->function()->body();
+                if (usesContext(src_pool_at(globalContext(), body->src)))
+                    return false;
+            }
+        }
+        return true;
+    });
+}
+
 class TheInliner {
   public:
     Closure* function;
@@ -43,11 +93,32 @@ class TheInliner {
                     staticEnv = cls->env();
                 } else if (auto call = StaticCall::Cast(*it)) {
                     inlinee = call->cls();
-                    staticEnv = inlinee->closureEnv();
+                    staticEnv = call->closureEnv();
                 } else {
                     continue;
                 }
 
+                // Arguments are substituted for LdArg positionally, therefore
+                // we cannot inline if they need to be matched first
+                if (inlinee->argNames.size() != call->nCallArgs())
+                    continue;
+                bool needsMatching = std::any_of(
+                    inlinee->argNames.begin(), inlinee->argNames.end(),
+                    [](SEXP n) { return n == R_DotsSymbol; });
+                call->eachCallArg([&](Value* v) {
+                    if (LdDots::Cast(v))
+                        needsMatching = true;
+                });
+                if (needsMatching)
+                    continue;
+
+                // A deopt in the inlinee continues in the caller, which needs
+                // a known frame state at the call
+                if (!call->callerCode && !Query::noDeopt(inlinee))
+                    continue;
+                if (deoptsNeedContext(inlinee))
+                    continue;
+
                 fuel--;
 
                 BB* split =
@@ -92,6 +163,21 @@ class TheInliner {
 
                 bb->next0 = copy;
 
+                // Deopts in the inlinee get the frame of the caller. The frame
+                // states of the calls within the inlinee are not complete
+                // anymore, therefore they cannot inline deopts.
+                Visitor::run(copy, [&](Instruction* i) {
+                    if (auto deopt = Deopt::Cast(i)) {
+                        deopt->pushCaller(
+                            {theCallInstruction->callerCode,
+                             theCallInstruction->callerPc, 0},
+                            theCall->env(), {});
+                    } else if (auto inner = CallInstruction::CastCall(i)) {
+                        inner->callerCode = nullptr;
+                        inner->callerPc = nullptr;
+                    }
+                });
+
                 // Copy over promises used by the inner function
                 std::vector<bool> copiedPromise;
                 std::vector<size_t> newPromId;
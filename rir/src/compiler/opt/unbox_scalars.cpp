@@ -0,0 +1,88 @@
+#include "unbox_scalars.h"
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+
+namespace {
+
+using namespace rir::pir;
+
+bool isArithmetic(Instruction* i) {
+    return Add::Cast(i) || Sub::Cast(i) || Mul::Cast(i);
+}
+
+bool isRelop(Instruction* i) {
+    return Lt::Cast(i) || Gt::Cast(i) || Lte::Cast(i) || Gte::Cast(i) ||
+           Eq::Cast(i) || Neq::Cast(i);
+}
+
+} // namespace
+
+namespace rir {
+namespace pir {
+
+void UnboxScalars::apply(Closure* function) {
+    PirType scalarInt = PirType(RType::integer).scalar().noAttribs();
+    PirType scalarNum = Unbox::boxed();
+
+    Visitor::run(function->entry, [&](BB* bb) {
+        for (auto it = bb->begin(); it != bb->end(); ++it) {
+            Instruction* i = *it;
+            if (!(isArithmetic(i) || isRelop(i)) || i->env() != Env::elided())
+                continue;
+            Value* lhs = i->arg(0).val();
+            Value* rhs = i->arg(1).val();
+            if (!lhs->type.isA(scalarNum) || !rhs->type.isA(scalarNum))
+                continue;
+
+            // int operands are converted, if the other one is real
+            NativeType type =
+                lhs->type.isA(scalarInt) && rhs->type.isA(scalarInt)
+                    ? NativeType::integer
+                    : NativeType::real;
+            for (size_t a = 0; a < 2; ++a) {
+                auto unbox = new Unbox(i->arg(a).val(), type);
+                it = bb->insert(it, unbox) + 1;
+                i->arg(a).val() = unbox;
+                i->arg(a).type() = type;
+            }
+
+            // Comparisons result in a boxed logical
+            if (isArithmetic(i)) {
+                i->type = type;
+                auto box = new Box(i);
+                i->replaceUsesWith(box);
+                it = bb->insert(it + 1, box);
+            }
+        }
+    });
+
+    // Unbox(Box(x)) is x, unless x has to be converted
+    Visitor::run(function->entry, [&](BB* bb) {
+        auto it = bb->begin();
+        while (it != bb->end()) {
+            auto next = it + 1;
+            if (auto unbox = Unbox::Cast(*it)) {
+                if (auto box = Box::Cast(unbox->arg<0>().val())) {
+                    Value* native = box->arg<0>().val();
+                    if (native->type == unbox->type) {
+                        unbox->replaceUsesWith(native);
+                        next = bb->remove(it);
+                    }
+                }
+            }
+            it = next;
+        }
+    });
+
+    Visitor::run(function->entry, [&](BB* bb) {
+        auto it = bb->begin();
+        while (it != bb->end()) {
+            if (Box::Cast(*it) && (*it)->unused())
+                it = bb->remove(it);
+            else
+                it++;
+        }
+    });
+}
+}
+}
@@ -0,0 +1,32 @@
+#ifndef PIR_UNBOX_SCALARS_H
+#define PIR_UNBOX_SCALARS_H
+
+namespace rir {
+namespace pir {
+
+/*
+ * Unboxes the operands of arithmetic and comparisons on int and real scalars
+ * without attributes, i.e. of those which do not need an env (see
+ * Env::elided). The results of arithmetic are boxed again for their uses,
+ * such that a later operation unboxes a boxed value. These Unbox(Box(x)) are
+ * replaced by x and the boxes without uses are removed, which keeps chains of
+ * arithmetic unboxed.
+ *
+ * Native values cannot be merged by phis, cannot be stored in environments
+ * and cannot be part of a deopt frame. The pass runs after all other
+ * optimizations, such that none of them has to deal with native values.
+ *
+ * Only builds with TYPED_STACK run the pass. Without the typed node stack
+ * unbox_ and box_ keep the values boxed and every result of the n*_
+ * arithmetic is a fresh scalar, whereas the boxed binops reuse an operand.
+ *
+ */
+class Closure;
+class UnboxScalars {
+  public:
+    static void apply(Closure* function);
+};
+}
+}
+
+#endif
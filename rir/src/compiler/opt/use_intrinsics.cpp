@@ -0,0 +1,26 @@
+#include "use_intrinsics.h"
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+
+namespace rir {
+namespace pir {
+
+void UseIntrinsics::apply(Closure* function) {
+    Visitor::run(function->entry, [&](BB* bb) {
+        for (auto it = bb->begin(); it != bb->end(); ++it) {
+            auto extract = Extract1_1D::Cast(*it);
+            if (!extract)
+                continue;
+            Value* vec = extract->arg<0>().val();
+            Value* idx = extract->arg<1>().val();
+            if (!vec->type.isA(PirType::val().noAttribs()))
+                continue;
+            auto call = new CallIntrinsic(Intrinsic::subset1Plain, {vec, idx},
+                                          Env::elided());
+            extract->replaceUsesWith(call);
+            bb->replace(it, call);
+        }
+    });
+}
+}
+}
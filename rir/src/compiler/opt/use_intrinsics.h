@@ -0,0 +1,26 @@
+#ifndef PIR_USE_INTRINSICS_H
+#define PIR_USE_INTRINSICS_H
+
+#include "../translations/pir_translator.h"
+
+namespace rir {
+namespace pir {
+
+/*
+ * Replaces instructions by calls to intrinsics with narrower effects, where
+ * the types of the arguments allow it. Currently x[i] of a vector without
+ * attributes, which cannot dispatch, becomes a call to subset1Plain, which
+ * does not need the environment.
+ *
+ */
+class Closure;
+class UseIntrinsics : public PirTranslator {
+  public:
+    UseIntrinsics() : PirTranslator("use intrinsics"){};
+
+    void apply(Closure* function) override;
+};
+}
+}
+
+#endif
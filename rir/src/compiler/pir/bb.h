@@ -1,8 +1,11 @@
 #ifndef COMPILER_BB_H
 #define COMPILER_BB_H
 
+#include "../util/arena.h"
 #include "pir.h"
 
+#include <vector>
+
 namespace rir {
 namespace pir {
 
@@ -36,6 +39,8 @@ class BB {
     BB(Code* fun, unsigned id);
     ~BB();
 
+    PIR_ARENA_ALLOCATED
+
     static BB* cloneInstrs(BB* src, unsigned id, Code* target);
 
     void unsafeSetId(unsigned newId) { *const_cast<unsigned*>(&id) = newId; }
@@ -59,7 +64,7 @@ class BB {
     bool isJmp() { return next0 && !next1; }
     bool isEmpty() { return instrs.size() == 0; }
 
-    typedef std::vector<Instruction*> Instrs;
+    typedef std::vector<Instruction*, ArenaAllocator<Instruction*>> Instrs;
 
     void append(Instruction* i);
 
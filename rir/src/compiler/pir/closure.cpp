@@ -28,12 +28,11 @@ Promise* Closure::createProm(unsigned srcPoolIdx) {
 Closure::~Closure() {
     for (auto p : promises)
         delete p;
-    for (auto p : defaultArgs)
-        delete p;
 }
 
 Closure* Closure::clone() {
     Closure* c = new Closure(argNames, env);
+    c->rirFunction = rirFunction;
 
     // clone code
     c->entry = BBTransform::clone(entry, c);
@@ -48,6 +47,10 @@ Closure* Closure::clone() {
         clonedP->entry = BBTransform::clone(p->entry, clonedP);
         promMap[p] = clonedP;
     }
+    c->defaultArgs.resize(defaultArgs.size(), nullptr);
+    for (size_t i = 0; i < defaultArgs.size(); ++i)
+        if (defaultArgs[i])
+            c->defaultArgs[i] = promMap.at(defaultArgs[i]);
 
     // fix promise references in body code and promise code
     Visitor::run(c->entry, [&](Instruction* i) {
@@ -8,6 +8,8 @@
 #include <functional>
 
 namespace rir {
+struct Function;
+
 namespace pir {
 
 /*
@@ -29,7 +31,12 @@ class Closure : public Code {
   public:
     Env* closureEnv() { return env; }
 
+    // The baseline version this closure is compiled from
+    rir::Function* rirFunction = nullptr;
+
     std::vector<SEXP> argNames;
+    // Default arguments by formal position (nullptr if there is none). They
+    // are owned by `promises`, this is just an index into them.
     std::vector<Promise*> defaultArgs;
 
     std::vector<Promise*> promises;
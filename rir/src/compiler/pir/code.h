@@ -1,6 +1,7 @@
 #ifndef COMPILER_CODE_H
 #define COMPILER_CODE_H
 
+#include "../util/arena.h"
 #include "pir.h"
 
 namespace rir {
@@ -21,6 +22,8 @@ class Code {
     Code() {}
     void print(std::ostream&);
     ~Code();
+
+    PIR_ARENA_ALLOCATED
 };
 
 }
@@ -17,6 +17,10 @@ void Env::printRef(std::ostream& out) {
         out << "nil";
         return;
     }
+    if (this == elided()) {
+        out << "elided";
+        return;
+    }
     assert(rho);
     std::string val;
     {
@@ -28,7 +32,8 @@ void Env::printRef(std::ostream& out) {
 }
 
 bool Env::isStaticEnv(Value* v) {
-    return Env::Cast(v) && v != Env::notClosed() && v != Env::nil();
+    return Env::Cast(v) && v != Env::notClosed() && v != Env::nil() &&
+           v != Env::elided();
 }
 
 bool Env::isPirEnv(Value* v) {
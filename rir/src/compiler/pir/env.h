@@ -36,6 +36,13 @@ class Env : public Value {
         return &u;
     }
 
+    // The env of instructions which do not actually access it, e.g.
+    // arithmetic on values without attributes, which cannot dispatch
+    static Env* elided() {
+        static Env u(nullptr, nullptr);
+        return &u;
+    }
+
     void printRef(std::ostream& out);
 
     static Env* Cast(Value* v) {
@@ -162,11 +162,23 @@ void LdFun::printArgs(std::ostream& out) {
 
 void LdArg::printArgs(std::ostream& out) { out << id; }
 
+void LdDDVar::printArgs(std::ostream& out) {
+    out << CHAR(PRINTNAME(varName)) << ", ";
+    env()->printRef(out);
+}
+
+void IsMissing::printArgs(std::ostream& out) {
+    out << CHAR(PRINTNAME(varName)) << ", ";
+    env()->printRef(out);
+}
+
 void StVar::printArgs(std::ostream& out) {
     out << CHAR(PRINTNAME(varName)) << ", ";
     val()->printRef(out);
     out << ", ";
     env()->printRef(out);
+    if (isStArg)
+        out << ", missing";
 }
 
 void StVarSuper::printArgs(std::ostream& out) {
@@ -191,11 +203,34 @@ void MkEnv::printArgs(std::ostream& out) {
     parent()->printRef(out);
 }
 
+void NamedCall::printArgs(std::ostream& out) {
+    cls()->printRef(out);
+    out << "(";
+    for (size_t i = 0; i < nCallArgs(); ++i) {
+        if (i > 0)
+            out << ", ";
+        if (names[i] != R_NilValue)
+            out << CHAR(PRINTNAME(names[i])) << "=";
+        arg(i + CallArgOffset).val()->printRef(out);
+    }
+    out << "), ";
+    env()->printRef(out);
+}
+
 void Is::printArgs(std::ostream& out) {
     arg<0>().val()->printRef(out);
     out << ", " << Rf_type2char(sexpTag);
 }
 
+void IsType::printArgs(std::ostream& out) {
+    arg<0>().val()->printRef(out);
+    out << ", " << Rf_type2char(expected.sexptype);
+    if (expected.scalar)
+        out << "$";
+    if (!expected.attribs)
+        out << "'";
+}
+
 bool Phi::updateType() {
     auto old = type;
     type = arg(0).val()->type;
@@ -203,6 +238,19 @@ bool Phi::updateType() {
     return type != old;
 }
 
+void Phi::removeInputs(const std::unordered_set<BB*>& del) {
+    size_t j = 0;
+    for (size_t i = 0; i < nargs(); ++i) {
+        if (del.count(input[i]))
+            continue;
+        input[j] = input[i];
+        args_[j] = args_[i];
+        j++;
+    }
+    input.erase(input.begin() + j, input.end());
+    args_.erase(args_.begin() + j, args_.end());
+}
+
 void Phi::printArgs(std::ostream& out) {
     if (nargs() > 0) {
         for (size_t i = 0; i < nargs(); ++i) {
@@ -253,15 +301,106 @@ void CallSafeBuiltin::printArgs(std::ostream& out) {
     Instruction::printArgs(out);
 }
 
+namespace {
+
+enum class IntrinsicResult { val, any, env };
+
+struct IntrinsicEffects {
+    Effect effect;
+    EnvAccess env;
+    IntrinsicResult result;
+};
+
+IntrinsicEffects intrinsicEffects(Intrinsic i) {
+    switch (i) {
+#define V(name, nargs, effect, env, result, args)                              \
+    case Intrinsic::name:                                                      \
+        return {Effect::effect, EnvAccess::env, IntrinsicResult::result};
+        RIR_INTRINSICS(V)
+#undef V
+    default:
+        assert(false);
+        return {Effect::Any, EnvAccess::Leak, IntrinsicResult::any};
+    }
+}
+
+PirType intrinsicResultType(Intrinsic i) {
+    switch (intrinsicEffects(i).result) {
+    case IntrinsicResult::val:
+        return PirType::val();
+    case IntrinsicResult::env:
+        return RType::env;
+    case IntrinsicResult::any:
+        break;
+    }
+    return PirType::any();
+}
+
+} // namespace
+
+CallIntrinsic::CallIntrinsic(Intrinsic intrinsic,
+                             const std::vector<Value*>& args, Value* env)
+    : VarLenInstruction(intrinsicResultType(intrinsic), env),
+      intrinsic(intrinsic) {
+    assert(args.size() == Intrinsics::info(intrinsic).nargs);
+    assert(Intrinsics::info(intrinsic).hasEnv || env == Env::elided());
+    for (auto a : args)
+        pushArg(a, PirType::val());
+}
+
+bool CallIntrinsic::mightIO() const {
+    return intrinsicEffects(intrinsic).effect > Effect::None;
+}
+
+bool CallIntrinsic::changesEnv() const {
+    return intrinsicEffects(intrinsic).env >= EnvAccess::Write;
+}
+
+bool CallIntrinsic::leaksEnv() const {
+    return intrinsicEffects(intrinsic).env == EnvAccess::Leak;
+}
+
+bool CallIntrinsic::accessesEnv() const {
+    return intrinsicEffects(intrinsic).env > EnvAccess::Capture;
+}
+
+void CallIntrinsic::printArgs(std::ostream& out) {
+    out << Intrinsics::info(intrinsic).name << ", ";
+    Instruction::printArgs(out);
+}
+
+void Deopt::pushCaller(const Frame& caller, Value* callerEnv,
+                       const std::vector<Value*>& callerStack) {
+    assert(caller.stackSize == callerStack.size());
+    frames.push_back(caller);
+    args_.insert(args_.begin(), InstrArg(callerEnv, RType::env));
+    for (auto v = callerStack.rbegin(); v != callerStack.rend(); ++v)
+        args_.insert(args_.begin(), InstrArg(*v, PirType::any()));
+}
+
+Value* Deopt::frameEnv(size_t frame) const {
+    assert(frame < frames.size());
+    size_t pos = 0;
+    for (size_t f = frames.size() - 1; f > frame; --f)
+        pos += frames[f].stackSize + 1;
+    return arg(pos + frames[frame].stackSize).val();
+}
+
 void Deopt::printArgs(std::ostream& out) {
-    out << "@" << pc << ", stack=[";
-    for (size_t i = 1; i < nargs(); ++i) {
-        arg(i).val()->printRef(out);
-        if (i + 1 < nargs())
-            out << ", ";
+    size_t pos = 0;
+    for (size_t f = frames.size(); f-- > 0;) {
+        auto& frame = frames[f];
+        out << "@" << frame.pc << ", stack=[";
+        for (size_t i = 0; i < frame.stackSize; ++i) {
+            arg(pos++).val()->printRef(out);
+            if (i + 1 < frame.stackSize)
+                out << ", ";
+        }
+        out << "], env=";
+        arg(pos++).val()->printRef(out);
+        if (f > 0)
+            out << "; ";
     }
-    out << "], env=";
-    env()->printRef(out);
 }
 
 MkFunCls::MkFunCls(Closure* fun, Value* parent, SEXP fml, SEXP code, SEXP src)
@@ -287,6 +426,8 @@ CallInstruction* CallInstruction::CastCall(Value* v) {
     switch (v->tag) {
     case Tag::Call:
         return Call::Cast(v);
+    case Tag::NamedCall:
+        return NamedCall::Cast(v);
     case Tag::StaticCall:
         return StaticCall::Cast(v);
     case Tag::CallBuiltin:
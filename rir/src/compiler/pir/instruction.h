@@ -1,7 +1,10 @@
 #ifndef COMPILER_INSTRUCTION_H
 #define COMPILER_INSTRUCTION_H
 
+#include "../util/arena.h"
 #include "R/r.h"
+#include "interpreter/intrinsics.h"
+#include "ir/RuntimeFeedback.h"
 #include "instruction_list.h"
 #include "pir.h"
 #include "singleton_values.h"
@@ -14,6 +17,7 @@
 #include <deque>
 #include <functional>
 #include <iostream>
+#include <unordered_set>
 
 /*
  * This file provides implementations for all instructions
@@ -45,6 +49,7 @@
 
 namespace rir {
 enum class Opcode : uint8_t;
+struct Code;
 
 namespace pir {
 
@@ -95,6 +100,8 @@ class Instruction : public Value {
     Instruction(Tag tag, PirType t, unsigned srcIdx)
         : Value(t, tag), srcIdx(srcIdx) {}
 
+    PIR_ARENA_ALLOCATED
+
     virtual bool mightIO() const = 0;
     virtual bool changesEnv() const = 0;
     virtual bool leaksEnv() const = 0;
@@ -203,11 +210,13 @@ class InstructionImplementation : public Instruction {
         EFFECT > Effect::None, ENV >= EnvAccess::Write, ENV == EnvAccess::Leak,
         ENV > EnvAccess::None, ENV > EnvAccess::Capture};
 
-    bool mightIO() const final { return Description.MightIO; }
-    bool changesEnv() const final { return Description.ChangesEnv; }
-    bool leaksEnv() const final { return Description.LeaksEnv; }
+    // The effects can be refined per instance (see CallIntrinsic), the env
+    // slot cannot
+    bool mightIO() const override { return Description.MightIO; }
+    bool changesEnv() const override { return Description.ChangesEnv; }
+    bool leaksEnv() const override { return Description.LeaksEnv; }
     bool hasEnv() const final { return Description.HasEnv; }
-    bool accessesEnv() const final { return Description.AccessesEnv; }
+    bool accessesEnv() const override { return Description.AccessesEnv; }
 
     static const Base* Cast(const Value* i) {
         if (i->tag == ITAG)
@@ -343,14 +352,14 @@ class FixedLenInstruction
     };
 };
 
+typedef std::vector<InstrArg, ArenaAllocator<InstrArg>> VarLenArgs;
+
 template <Tag ITAG, class Base, Effect EFFECT, EnvAccess ENV>
 class VarLenInstruction
-    : public InstructionImplementation<ITAG, Base, EFFECT, ENV,
-                                       std::vector<InstrArg>> {
+    : public InstructionImplementation<ITAG, Base, EFFECT, ENV, VarLenArgs> {
 
   public:
-    typedef InstructionImplementation<ITAG, Base, EFFECT, ENV,
-                                      std::vector<InstrArg>>
+    typedef InstructionImplementation<ITAG, Base, EFFECT, ENV, VarLenArgs>
         Super;
     using Super::arg;
     using Super::args_;
@@ -453,6 +462,19 @@ class FLI(ForSeqSize, 1, Effect::Error, EnvAccess::None) {
                               {{PirType::val()}}, {{val}}) {}
 };
 
+// Runs an element-wise for loop over seq as a whole (see VectorKernel). The
+// result is the new value of the target vector, or nil if the scalar loop has
+// to run. The kernel reads arbitrary variables from the environment.
+class FLI(ForKernel, 2, Effect::Any, EnvAccess::Leak) {
+  public:
+    SEXP kernel;
+
+    ForKernel(SEXP kernel, Value* seq, Value* env)
+        : FixedLenInstruction(PirType::val(), {{PirType::val()}}, {{seq}},
+                              env),
+          kernel(kernel) {}
+};
+
 class FLI(LdArg, 0, Effect::None, EnvAccess::None) {
   public:
     size_t id;
@@ -462,6 +484,41 @@ class FLI(LdArg, 0, Effect::None, EnvAccess::None) {
     void printArgs(std::ostream& out) override;
 };
 
+// Passes the `...` of the environment on to a call. The callee expands it
+// into the individual arguments, therefore this is only valid as a call arg.
+class FLI(LdDots, 1, Effect::None, EnvAccess::Read) {
+  public:
+    explicit LdDots(Value* env) : FixedLenInstruction(RType::sym, env) {}
+};
+
+// Loads `..n`. Like `ldddvar_` it forces the value, thus it can have
+// arbitrary effects.
+class FLI(LdDDVar, 1, Effect::Any, EnvAccess::Leak) {
+  public:
+    SEXP varName;
+
+    LdDDVar(SEXP name, Value* env)
+        : FixedLenInstruction(PirType::val(), env), varName(name) {
+        assert(TYPEOF(name) == SYMSXP && DDVAL(name));
+    }
+
+    void printArgs(std::ostream& out) override;
+};
+
+// Implements `missing(varName)`. Errors if varName is not an argument.
+class FLI(IsMissing, 1, Effect::Error, EnvAccess::Read) {
+  public:
+    SEXP varName;
+
+    IsMissing(SEXP name, Value* env)
+        : FixedLenInstruction(PirType(RType::logical).scalar(), env),
+          varName(name) {
+        assert(TYPEOF(name) == SYMSXP);
+    }
+
+    void printArgs(std::ostream& out) override;
+};
+
 class FLI(ChkMissing, 1, Effect::Warn, EnvAccess::None) {
   public:
     ChkMissing(Value* in)
@@ -519,6 +576,9 @@ class FLI(StVar, 2, Effect::None, EnvAccess::Write) {
           varName(Rf_install(name)) {}
 
     SEXP varName;
+    // Binds the default argument of a missing formal, the binding stays
+    // marked as missing (see closureArgumentAdaptor)
+    bool isStArg = false;
     Value* val() { return arg<0>().val(); }
 
     void printArgs(std::ostream& out) override;
@@ -606,6 +666,32 @@ class FLI(CastType, 1, Effect::None, EnvAccess::None) {
         : FixedLenInstruction(to, {{from}}, {{in}}) {}
 };
 
+// Unboxed scalars, see opt/unbox_scalars.h
+class FLI(Unbox, 1, Effect::None, EnvAccess::None) {
+  public:
+    Unbox(Value* v, NativeType t)
+        : FixedLenInstruction(t, {{boxed()}}, {{v}}) {
+        assert(t == NativeType::integer || t == NativeType::real);
+    }
+    static PirType boxed() {
+        return (PirType(RType::integer) | RType::real).scalar().noAttribs();
+    }
+};
+
+class FLI(Box, 1, Effect::None, EnvAccess::None) {
+  public:
+    explicit Box(Value* v)
+        : FixedLenInstruction(v->type == NativeType::integer
+                                  ? RType::integer
+                                  : RType::real,
+                              {{unboxed()}}, {{v}}) {
+        type = type.scalar().noAttribs();
+    }
+    static PirType unboxed() {
+        return PirType(NativeType::integer) | NativeType::real;
+    }
+};
+
 class FLI(AsLogical, 1, Effect::Warn, EnvAccess::None) {
   public:
     AsLogical(Value* in, unsigned srcIdx)
@@ -655,6 +741,16 @@ class FLI(Extract2_1D, 3, Effect::None, EnvAccess::Leak) {
                               env, srcIdx) {}
 };
 
+// Extract2_1D with an index, which is known to be a non-NA int or real
+// scalar in bounds of the vector (see ElideBoundsChecks)
+class FLI(Extract2_1DUnchecked, 2, Effect::None, EnvAccess::None) {
+  public:
+    Extract2_1DUnchecked(Value* vec, Value* idx)
+        : FixedLenInstruction(PirType::val(),
+                              {{PirType::val(), PirType::val()}},
+                              {{vec, idx}}) {}
+};
+
 class FLI(Extract1_2D, 4, Effect::None, EnvAccess::Leak) {
   public:
     Extract1_2D(Value* vec, Value* idx1, Value* idx2, Value* env,
@@ -699,6 +795,30 @@ class FLI(IsObject, 1, Effect::None, EnvAccess::None) {
         : FixedLenInstruction(NativeType::test, {{PirType::val()}}, {{v}}) {}
 };
 
+// Type guard for speculation on type feedback: true if the value has exactly
+// the recorded type
+class FLI(IsType, 1, Effect::None, EnvAccess::None) {
+  public:
+    IsType(RecordedType expected, Value* v)
+        : FixedLenInstruction(NativeType::test, {{PirType::val()}}, {{v}}),
+          expected(expected) {}
+    RecordedType expected;
+
+    void printArgs(std::ostream& out) override;
+};
+
+// Guard for Extract2_1DUnchecked: true if vec is an int, real, logical or list
+// vector without attributes and all elements of from and to are valid
+// indices into it. A promise is checked by its value, if it was forced.
+class FLI(InBounds, 3, Effect::None, EnvAccess::None) {
+  public:
+    InBounds(Value* vec, Value* from, Value* to)
+        : FixedLenInstruction(
+              NativeType::test,
+              {{PirType::valOrLazy(), PirType::val(), PirType::val()}},
+              {{vec, from, to}}) {}
+};
+
 class FLI(LdFunctionEnv, 0, Effect::None, EnvAccess::None) {
   public:
     LdFunctionEnv() : FixedLenInstruction(RType::env) {}
@@ -789,6 +909,12 @@ class CallInstruction {
     virtual void eachCallArg(Instruction::ArgumentValueIterator it) = 0;
     virtual void eachCallArgRev(Instruction::ArgumentValueIterator it) = 0;
     static CallInstruction* CastCall(Value* v);
+
+    // Where the caller continues in its baseline code with the result of the
+    // call, if an inlined callee deoptimizes. Only recorded if the caller has
+    // no other values on its stack, see Deopt.
+    rir::Code* callerCode = nullptr;
+    Opcode* callerPc = nullptr;
 };
 
 template <Tag ITAG, class Base, Effect EFFECT, EnvAccess ENV,
@@ -848,21 +974,47 @@ class ACallInstructionImplementation(Call, Effect::Any, EnvAccess::Leak, true) {
     }
 };
 
+// Same as Call, but with named arguments. Names are R_NilValue for unnamed
+// args. Argument matching is left to the callee.
+class ACallInstructionImplementation(NamedCall, Effect::Any, EnvAccess::Leak,
+                                     true) {
+  public:
+    constexpr static size_t clsIdx = 0;
+    std::vector<SEXP> names;
+
+    Value* cls() { return arg(clsIdx).val(); }
+
+    NamedCall(Value * e, Value * fun, const std::vector<Value*>& args,
+              const std::vector<SEXP>& names, unsigned srcIdx)
+        : CallInstructionImplementation(PirType::valOrLazy(), e, srcIdx),
+          names(names) {
+        assert(names.size() == args.size());
+        pushArg(fun, RType::closure);
+        for (unsigned i = 0; i < args.size(); ++i)
+            pushArg(args[i], PirType::val());
+    }
+
+    void printArgs(std::ostream& out) override;
+};
+
 // Call instruction for lazy, but staticatlly resolved calls. Closure is
-// specified as `cls_`, args passed as promises.
+// specified as `cls_`, args passed as promises. `closureEnv_` is the env of
+// the `origin_` closure, which the body of `cls_` is inlined into.
 class ACallInstructionImplementation(StaticCall, Effect::Any, EnvAccess::Leak,
                                      false) {
     Closure* cls_;
     SEXP origin_;
+    Env* closureEnv_;
 
   public:
     Closure* cls() { return cls_; }
     SEXP origin() { return origin_; }
+    Env* closureEnv() { return closureEnv_; }
 
     StaticCall(Value * e, Closure * cls, const std::vector<Value*>& args,
-               SEXP origin, unsigned srcIdx)
+               SEXP origin, Env * closureEnv, unsigned srcIdx)
         : CallInstructionImplementation(PirType::valOrLazy(), e, srcIdx),
-          cls_(cls), origin_(origin) {
+          cls_(cls), origin_(origin), closureEnv_(closureEnv) {
         for (unsigned i = 0; i < args.size(); ++i)
             pushArg(args[i], PirType::val());
     }
@@ -898,6 +1050,24 @@ class ACallInstructionImplementation(CallSafeBuiltin, Effect::None,
     void printArgs(std::ostream & out) override;
 };
 
+// Calls an intrinsic with its arguments as values. Unlike CallBuiltin, the
+// effects are the ones declared by the intrinsic (see intrinsics.h). Intrinsics
+// without env access get the elided env.
+class VLI(CallIntrinsic, Effect::Any, EnvAccess::Leak) {
+  public:
+    Intrinsic intrinsic;
+
+    CallIntrinsic(Intrinsic intrinsic, const std::vector<Value*>& args,
+                  Value* env);
+
+    bool mightIO() const override;
+    bool changesEnv() const override;
+    bool leaksEnv() const override;
+    bool accessesEnv() const override;
+
+    void printArgs(std::ostream& out) override;
+};
+
 class VLI(MkEnv, Effect::None, EnvAccess::Capture) {
   public:
     std::vector<SEXP> varName;
@@ -958,6 +1128,8 @@ class VLI(Phi, Effect::None, EnvAccess::None) {
         input.push_back(in);
         VarLenInstruction::pushArg(arg);
     }
+    // Drops the inputs from the given blocks, e.g. when they were removed
+    void removeInputs(const std::unordered_set<BB*>& del);
     typedef std::function<void(BB* bb, Value*)> PhiArgumentIterator;
 
     void eachArg(PhiArgumentIterator it) const {
@@ -966,16 +1138,38 @@ class VLI(Phi, Effect::None, EnvAccess::None) {
     }
 };
 
+/*
+ * Continues in the baseline rir code. Besides its own frame, the deopt
+ * describes the frames of all the calls it was inlined into, which continue
+ * with its result. The arguments are the stack and env of every frame,
+ * starting with the outermost. The env of the innermost frame is the env of
+ * the instruction.
+ */
 class VLI(Deopt, Effect::Any, EnvAccess::Leak) {
   public:
-    Opcode* pc;
+    struct Frame {
+        rir::Code* code;
+        Opcode* pc;
+        size_t stackSize;
+    };
+    // innermost first
+    std::vector<Frame> frames;
 
-    Deopt(Value* env, Opcode* pc, const std::deque<Value*>& stack)
-        : VarLenInstruction(PirType::voyd(), env), pc(pc) {
+    Deopt(Value* env, rir::Code* code, Opcode* pc,
+          const std::deque<Value*>& stack)
+        : VarLenInstruction(PirType::voyd(), env) {
+        frames.push_back({code, pc, stack.size()});
         for (unsigned i = 0; i < stack.size(); ++i)
             pushArg(stack[i], PirType::any());
     }
 
+    // Adds the frame of a caller, into which the code of this deopt was
+    // inlined
+    void pushCaller(const Frame& caller, Value* callerEnv,
+                    const std::vector<Value*>& callerStack);
+
+    Value* frameEnv(size_t frame) const;
+
     void printArgs(std::ostream& out) override;
 };
 
@@ -9,6 +9,9 @@
     V(LdVar)                                                                   \
     V(LdConst)                                                                 \
     V(LdArg)                                                                   \
+    V(LdDots)                                                                  \
+    V(LdDDVar)                                                                 \
+    V(IsMissing)                                                               \
     V(StVarSuper)                                                              \
     V(LdVarSuper)                                                              \
     V(StVar)                                                                   \
@@ -17,6 +20,10 @@
     V(AsLogical)                                                               \
     V(AsTest)                                                                  \
     V(IsObject)                                                                \
+    V(IsType)                                                                  \
+    V(InBounds)                                                                \
+    V(Box)                                                                     \
+    V(Unbox)                                                                   \
     V(Return)                                                                  \
     V(MkArg)                                                                   \
     V(MkFunCls)                                                                \
@@ -24,9 +31,11 @@
     V(ChkMissing)                                                              \
     V(ChkClosure)                                                              \
     V(Call)                                                                    \
+    V(NamedCall)                                                               \
     V(StaticCall)                                                              \
     V(CallBuiltin)                                                             \
     V(CallSafeBuiltin)                                                         \
+    V(CallIntrinsic)                                                           \
     V(MkEnv)                                                                   \
     V(LdFunctionEnv)                                                           \
     V(Lte)                                                                     \
@@ -55,10 +64,12 @@
     V(Extract1_1D)                                                             \
     V(Extract1_2D)                                                             \
     V(Extract2_1D)                                                             \
+    V(Extract2_1DUnchecked)                                                    \
     V(Extract2_2D)                                                             \
     V(Subassign1_1D)                                                           \
     V(Subassign2_1D)                                                           \
     V(ForSeqSize)                                                              \
+    V(ForKernel)                                                               \
     V(Deopt)                                                                   \
     V(Force)                                                                   \
     V(CastType)                                                                \
@@ -8,6 +8,7 @@
 #include <vector>
 
 #include "../../runtime/Function.h"
+#include "../util/arena.h"
 
 namespace rir {
 namespace pir {
@@ -16,6 +17,9 @@ class Closure;
 class Env;
 
 class Module {
+    // Backs all IR objects of this module, see arena.h
+    Arena arena;
+
     std::unordered_map<SEXP, Env*> environments;
 
   public:
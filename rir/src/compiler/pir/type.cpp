@@ -78,6 +78,8 @@ PirType::PirType(SEXP e) : flags_(defaultRTypeFlags()), t_(RTypeSet()) {
     if (PirType::vecs().isSuper(*this)) {
         if (Rf_length(e) == 1)
             flags_.set(TypeFlags::is_scalar);
+        if (ATTRIB(e) == R_NilValue)
+            flags_.set(TypeFlags::no_attribs);
     }
 }
 }
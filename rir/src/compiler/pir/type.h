@@ -30,6 +30,9 @@ namespace pir {
  *  - flags_ : ()
  *  - t_.n   : NativeType::test
  *
+ * Unboxed scalars (see Box and Unbox) have the native types integer and real.
+ * NA is represented as in R.
+ *
  * An R value (not a promise), has:
  *
  *  - flags_ : TypeFlag::rtype
@@ -70,9 +73,11 @@ enum class NativeType : uint8_t {
     _UNUSED_,
 
     test,
+    integer,
+    real,
 
     FIRST = test,
-    LAST = test
+    LAST = real
 };
 
 enum class TypeFlags : uint8_t {
@@ -81,6 +86,7 @@ enum class TypeFlags : uint8_t {
     lazy,
     missing,
     is_scalar,
+    no_attribs,
     rtype,
 
     FIRST = lazy,
@@ -94,7 +100,9 @@ enum class TypeFlags : uint8_t {
  * by RType and NativeType respectively.
  *
  * TypeFlags are additional features. The element `rtype` of the type flags is
- * abused to store, if the type is an R type or native type.
+ * abused to store, if the type is an R type or native type. `is_scalar` and
+ * `no_attribs` restrict the type, they only hold for a union if they hold for
+ * all of its members.
  *
  * `a.flags_.includes(b.flags_)` is a necessary condition for `a :> b`.
  *
@@ -160,6 +168,9 @@ struct PirType {
     RIR_INLINE bool isScalar() const {
         return flags_.includes(TypeFlags::is_scalar);
     }
+    RIR_INLINE bool maybeHasAttribs() const {
+        return !flags_.includes(TypeFlags::no_attribs);
+    }
     RIR_INLINE bool isRType() const {
         return flags_.includes(TypeFlags::rtype);
     }
@@ -171,6 +182,14 @@ struct PirType {
         return t;
     }
 
+    // Values without attributes are never objects
+    RIR_INLINE PirType noAttribs() const {
+        assert(isRType());
+        PirType t = *this;
+        t.flags_.set(TypeFlags::no_attribs);
+        return t;
+    }
+
     RIR_INLINE PirType orMissing() const {
         assert(isRType());
         PirType t = *this;
@@ -208,6 +227,8 @@ struct PirType {
         r.flags_ = flags_ | o.flags_;
         if (!(isScalar() && o.isScalar()))
             r.flags_.reset(TypeFlags::is_scalar);
+        if (maybeHasAttribs() || o.maybeHasAttribs())
+            r.flags_.reset(TypeFlags::no_attribs);
 
         return r;
     }
@@ -234,7 +255,8 @@ struct PirType {
         }
         if ((!maybeLazy() && o.maybeLazy()) ||
             (!maybeMissing() && o.maybeMissing()) ||
-            (isScalar() && !o.isScalar())) {
+            (isScalar() && !o.isScalar()) ||
+            (!maybeHasAttribs() && o.maybeHasAttribs())) {
             return false;
         }
         return t_.r.includes(o.t_.r);
@@ -248,6 +270,12 @@ inline std::ostream& operator<<(std::ostream& out, NativeType t) {
     case NativeType::test:
         out << "t";
         break;
+    case NativeType::integer:
+        out << "i32";
+        break;
+    case NativeType::real:
+        out << "f64";
+        break;
     case NativeType::_UNUSED_:
         assert(false);
         break;
@@ -348,6 +376,8 @@ inline std::ostream& operator<<(std::ostream& out, PirType t) {
 
     if (t.isScalar())
         out << "$";
+    if (!t.maybeHasAttribs())
+        out << "'";
     if (t.maybeLazy())
         out << "^";
     if (t.maybeMissing())
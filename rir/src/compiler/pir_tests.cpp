@@ -150,6 +150,17 @@ bool canRemoveEnvironment(const std::string& input) {
     return t;
 }
 
+// The environment of theFun is not created before its first branch
+bool delaysEnvironment(const std::string& input) {
+    pir::Module m;
+    auto res = compile("", input, &m);
+    auto f = res["theFun"];
+    bool t = verify(&m);
+    for (auto i : *f->entry)
+        t = t && !MkEnv::Cast(i);
+    return t && !Query::noEnv(f);
+}
+
 extern "C" SEXP Rf_NewEnvironment(SEXP, SEXP, SEXP);
 bool testSuperAssign() {
     auto hasAssign = [](pir::Closure* f) {
@@ -302,6 +313,12 @@ static Test tests[] = {
     Test(
         "test_super_assign",
         []() { return test42("{x <- 0; f <- function() x <<- 42L; f(); x}"); }),
+    Test("constant_fold",
+         []() {
+             return test42("{x <- 40L + 2L; if (x == 42L) x else 1L}");
+         }),
+    Test("constant_fold_branch",
+         []() { return test42("{t <- !!TRUE; if (t) 42L else stop()}"); }),
     Test("return_cls",
          []() { return compileAndVerify("f <- function() 42L"); }),
     Test("index", []() { return compileAndVerify("f <- function(x) x[[2]]"); }),
@@ -314,6 +331,11 @@ static Test tests[] = {
          }),
     Test("context_load",
          []() { return canRemoveEnvironment("f <- function() 123"); }),
+    Test("delay_env_branch",
+         []() {
+             return delaysEnvironment(
+                 "theFun <- function(a) {x <- 1L; if (a) x else g(x)}");
+         }),
     Test("super_assign", &testSuperAssign),
     Test("loop",
          []() {
@@ -340,12 +362,43 @@ static Test tests[] = {
          []() { return testPir2Rir("foo", "function() 42L", ""); }),
     Test("PIR to RIR: simple argument",
          []() { return testPir2Rir("foo", "function(x) x", "16L"); }),
-    /*
-        fails because RIR to PIR doesn't support default args for now
-
-        Test("PIR to RIR: default arg",
-             []() { return testPir2Rir("foo", "function(x = 3) x", ""); }),
-    */
+    Test("PIR to RIR: default arg",
+         []() { return testPir2Rir("foo", "function(x = 3) x", ""); }),
+    Test("PIR to RIR: default arg supplied",
+         []() { return testPir2Rir("foo", "function(x = 3) x", "4"); }),
+    Test("PIR to RIR: default arg refers to other arg",
+         []() {
+             return testPir2Rir("foo", "function(a, b = a + 2) a * b", "3");
+         }),
+    Test("PIR to RIR: dots",
+         []() {
+             return testPir2Rir("foo", "function(...) c(...)", "1, 2, 3");
+         }),
+    Test("PIR to RIR: dots and named args",
+         []() {
+             return testPir2Rir("foo", "function(a, ..., b = 2) c(a, ..., b)",
+                                "1, 3, 4, b = 5");
+         }),
+    Test("named_call",
+         []() { return compileAndVerify("f <- function(x) list(a = x, 1)"); }),
+    Test("missing",
+         []() { return compileAndVerify("f <- function(x) missing(x)"); }),
+    Test("return", []() {
+        return compileAndVerify("f <- function(x) {if (x) return(1); 2}");
+    }),
+    Test("PIR to RIR: named call",
+         []() {
+             return testPir2Rir("foo", "function(x) list(a = x, b = 2)", "1");
+         }),
+    Test("PIR to RIR: missing",
+         []() { return testPir2Rir("foo", "function(a) missing(a)", ""); }),
+    Test("PIR to RIR: ..n",
+         []() { return testPir2Rir("foo", "function(...) ..2", "1, 2"); }),
+    Test("PIR to RIR: return",
+         []() {
+             return testPir2Rir("foo", "function(x) { if (x) return(1); 2 }",
+                                "TRUE");
+         }),
     Test("PIR to RIR: local binding",
          []() {
              return testPir2Rir("foo",
@@ -1,7 +1,9 @@
 #include "pir_2_rir.h"
 #include "../pir/pir_impl.h"
 #include "../util/cfg.h"
+#include "../util/pass_statistics.h"
 #include "../util/visitor.h"
+#include "interpreter/deoptimizer.h"
 #include "interpreter/runtime.h"
 #include "ir/CodeStream.h"
 #include "ir/CodeVerifier.h"
@@ -9,6 +11,7 @@
 
 #include <algorithm>
 #include <iomanip>
+#include <iterator>
 
 // #define DEBUGGING
 #define ALLOC_DEBUG 1
@@ -27,16 +30,62 @@ namespace pir {
 
 namespace {
 
+/*
+ * Dense bitset over instruction numbers, used for the liveness sets.
+ */
+class BitSet {
+    std::vector<uint64_t> words;
+
+  public:
+    explicit BitSet(size_t size = 0) : words((size + 63) / 64) {}
+
+    bool test(size_t i) const {
+        return words[i / 64] & ((uint64_t)1 << (i % 64));
+    }
+    void set(size_t i) { words[i / 64] |= (uint64_t)1 << (i % 64); }
+    void reset(size_t i) { words[i / 64] &= ~((uint64_t)1 << (i % 64)); }
+
+    // this |= other, returns true if this changed
+    bool merge(const BitSet& other) {
+        bool changed = false;
+        for (size_t i = 0; i < words.size(); ++i) {
+            uint64_t m = words[i] | other.words[i];
+            changed = changed || m != words[i];
+            words[i] = m;
+        }
+        return changed;
+    }
+
+    // this = a | (b & ~c)
+    void assign(const BitSet& a, const BitSet& b, const BitSet& c) {
+        for (size_t i = 0; i < words.size(); ++i)
+            words[i] = a.words[i] | (b.words[i] & ~c.words[i]);
+    }
+
+    template <typename F>
+    void each(F f) const {
+        for (size_t i = 0; i < words.size(); ++i) {
+            uint64_t w = words[i];
+            while (w) {
+                f(i * 64 + __builtin_ctzll(w));
+                w &= w - 1;
+            }
+        }
+    }
+};
+
 /*
  * SSAAllocator assigns each instruction to a local variable number, or the
  * stack. It uses the following algorithm:
  *
  * 1. Split phis with moves. This translates the IR to CSSA (see toCSSA).
  * 2. Compute liveness (see computeLiveness):
- *    Liveness intervals are stored as:
- *        Instruction* -> BB id -> { start : pos, end : pos, live : bool}
- *    Two Instructions interfere iff there is a BB where they are both live
- *    and the start-end overlap.
+ *    Instructions are numbered densely and the live out sets of every BB are
+ *    computed as bitsets. From those every instruction gets a sorted list of
+ *    live ranges in a global numbering of all positions. An instruction is
+ *    defined after its arguments are read, therefore an instruction can
+ *    reuse the slot of an argument, which dies there.
+ *    Two Instructions interfere iff any of their ranges overlap.
  * 3. Use simple heuristics to detect Instructions that can stay on the RIR
  *    stack (see computeStackAllocation):
  *    1. Use stack slots for instructions which are used
@@ -49,15 +98,17 @@ namespace {
  * 4. Assign the remaining Instructions to local RIR variable numbers
  *    (see computeAllocation):
  *    1. Coalesc all remaining phi with their inputs. This is save since we are
- *       already in CSSA. Directly allocate a register on the fly, such that.
- *    2. Traverse the dominance tree and eagerly allocate the remaining ones
+ *       already in CSSA.
+ *    2. Linear scan over the remaining instructions in order of their first
+ *       position. The slots remember their occupied ranges, such that holes
+ *       in the live ranges can be reused. Slots of copy targets and of the
+ *       first argument are tried first, to get rid of moves.
  * 5. For debugging, verify the assignment with a static analysis that simulates
  *    the variable and stack usage (see verify).
  */
 class SSAAllocator {
   public:
     CFG cfg;
-    DominanceGraph dom;
     Code* code;
     size_t bbsSize;
 
@@ -67,176 +118,174 @@ class SSAAllocator {
 
     std::unordered_map<Value*, SlotNumber> allocation;
 
-    struct BBLiveness {
-        uint8_t live = false;
-        unsigned begin = -1;
-        unsigned end = -1;
+    // Dense numbering of all instructions
+    std::unordered_map<Value*, size_t> number;
+    std::vector<Instruction*> values;
+
+    // Closed interval of positions. Positions are global over all BBs. Within
+    // a BB the instruction at index i reads its args at 2*i and writes its
+    // result at 2*i+1.
+    struct Range {
+        unsigned begin;
+        unsigned end;
     };
-    struct Liveness : public std::vector<BBLiveness> {
-        bool interfere(const Liveness& other) const {
-            assert(size() == other.size());
-            for (size_t i = 0; i < size(); ++i) {
-                const BBLiveness& mine = (*this)[i];
-                const BBLiveness& their = other[i];
-                if (mine.live && their.live) {
-                    if (mine.begin == their.begin ||
-                        (mine.begin < their.begin && mine.end >= their.begin) ||
-                        (mine.begin > their.begin && their.end >= mine.begin))
-                        return true;
-                }
+    // Sorted and non-overlapping
+    typedef std::vector<Range> Ranges;
+    std::vector<Ranges> liveRanges;
+
+    // Sorts the ranges and merges overlapping and adjacent ones
+    static void normalize(Ranges& ranges) {
+        std::sort(ranges.begin(), ranges.end(),
+                  [](const Range& a, const Range& b) {
+                      return a.begin < b.begin;
+                  });
+        size_t last = 0;
+        for (size_t i = 1; i < ranges.size(); ++i) {
+            if (ranges[i].begin <= ranges[last].end + 1) {
+                ranges[last].end = std::max(ranges[last].end, ranges[i].end);
+            } else {
+                ranges[++last] = ranges[i];
             }
-            return false;
         }
-    };
-    std::unordered_map<Value*, Liveness> livenessInterval;
+        if (!ranges.empty())
+            ranges.resize(last + 1);
+    }
+
+    bool isLive(Value* v) const {
+        return number.count(v) && !liveRanges[number.at(v)].empty();
+    }
+    const Ranges& rangesOf(Value* v) const { return liveRanges[number.at(v)]; }
 
     SSAAllocator(Code* code, bool verbose)
-        : cfg(code), dom(code), code(code), bbsSize(code->nextBBId) {
+        : cfg(code), code(code), bbsSize(code->nextBBId) {
         computeLiveness(verbose);
         computeStackAllocation();
         computeAllocation();
     }
 
-    // Run backwards analysis to compute livenessintervals
     void computeLiveness(bool verbose = 0) {
-        // temp list of live out sets for every BB
-        std::unordered_map<BB*, std::set<Value*>> liveAtEnd(bbsSize);
-
-        std::set<BB*> todo;
-        for (auto e : cfg.exits())
-            todo.insert(e);
-
-        while (!todo.empty()) {
-            BB* bb = *todo.begin();
-            todo.erase(todo.begin());
-
-            // keep track of currently live variables
-            std::set<Value*> accumulated;
-            std::map<BB*, std::set<Value*>> accumulatedPhiInput;
-
-            // Mark all (backwards) incoming live variables
-            for (auto v : liveAtEnd[bb]) {
-                assert(livenessInterval.count(v));
-                auto& liveRange = livenessInterval.at(v)[bb->id];
-                if (!liveRange.live || liveRange.end < bb->size()) {
-                    liveRange.live = true;
-                    liveRange.end = bb->size();
-                    accumulated.insert(v);
+        std::vector<BB*> bbs;
+        Visitor::run(code->entry, [&](BB* bb) {
+            bbs.push_back(bb);
+            for (auto i : *bb) {
+                number[i] = values.size();
+                values.push_back(i);
+            }
+        });
+        std::sort(bbs.begin(), bbs.end(),
+                  [](BB* a, BB* b) { return a->id < b->id; });
+
+        size_t n = values.size();
+        auto numbered = [&](Value* v) { return number.count(v) > 0; };
+
+        // Local summary of every BB: upward exposed uses, definitions and phi
+        // inputs (together with the BB they come from)
+        std::vector<BitSet> uses(bbsSize, BitSet(n));
+        std::vector<BitSet> defs(bbsSize, BitSet(n));
+        std::vector<std::vector<std::pair<BB*, size_t>>> phiInputs(bbsSize);
+        for (auto bb : bbs) {
+            auto& use = uses[bb->id];
+            auto& def = defs[bb->id];
+            for (auto i : *bb) {
+                if (auto phi = Phi::Cast(i)) {
+                    phi->eachArg([&](BB* in, Value* v) {
+                        if (numbered(v))
+                            phiInputs[bb->id].push_back({in, number.at(v)});
+                    });
+                } else {
+                    i->eachArg([&](Value* v) {
+                        if (numbered(v) && !def.test(number.at(v)))
+                            use.set(number.at(v));
+                    });
                 }
+                def.set(number.at(i));
             }
+        }
 
-            // Run BB in reverse
-            size_t pos = bb->size();
-            if (!bb->isEmpty()) {
-                auto ip = bb->end();
-                do {
-                    --ip;
-                    --pos;
-                    Instruction* i = *ip;
-                    Phi* phi = Phi::Cast(i);
+        // Backwards dataflow to compute the live out sets. Phi inputs are
+        // only live out of the predecessors, which are reachable from the
+        // BB the input comes from.
+        std::vector<BitSet> liveOut(bbsSize, BitSet(n));
+        std::deque<BB*> todo(bbs.rbegin(), bbs.rend());
+        BitSet liveIn(n);
+        while (!todo.empty()) {
+            BB* bb = todo.front();
+            todo.pop_front();
 
-                    auto markIfNotSeen = [&](Value* v) {
-                        if (!livenessInterval.count(v)) {
-                            // First time we see this variable, need to allocate
-                            // vector of all livereanges
-                            livenessInterval[v].resize(bbsSize);
-                            assert(!livenessInterval[v][bb->id].live);
-                        }
-                        auto& liveRange = livenessInterval[v][bb->id];
-                        if (!liveRange.live) {
-                            liveRange.live = true;
-                            liveRange.end = pos;
-                            return true;
-                        }
-                        return false;
-                    };
-
-                    // First set all arguments to be live
-                    if (phi)
-                        phi->eachArg([&](BB* in, Value* v) {
-                            if (markIfNotSeen(v))
-                                accumulatedPhiInput[in].insert(v);
-                        });
-                    else
-                        i->eachArg([&](Value* v) {
-                            if (markIfNotSeen(v))
-                                accumulated.insert(v);
-                        });
-
-                    // Mark the end of the current instructions liveness
-                    if (accumulated.count(i)) {
-                        assert(livenessInterval.count(i));
-                        auto& liveRange = livenessInterval[i][bb->id];
-                        assert(liveRange.live);
-                        liveRange.begin = pos;
-                        accumulated.erase(accumulated.find(i));
+            liveIn.assign(uses[bb->id], liveOut[bb->id], defs[bb->id]);
+            for (auto pre : cfg.immediatePredecessors(bb)) {
+                bool changed = liveOut[pre->id].merge(liveIn);
+                for (auto& in : phiInputs[bb->id]) {
+                    if ((pre == in.first || cfg.isPredecessor(in.first, pre)) &&
+                        !liveOut[pre->id].test(in.second)) {
+                        liveOut[pre->id].set(in.second);
+                        changed = true;
                     }
-                } while (ip != bb->begin());
+                }
+                if (changed)
+                    todo.push_back(pre);
             }
-            assert(pos == 0);
-
-            // Mark everything that is live at the beginning of the BB.
-            auto markLiveEntry = [&](Value* v) {
-                assert(livenessInterval.count(v));
-                auto& liveRange = livenessInterval[v][bb->id];
-                assert(liveRange.live);
-                liveRange.begin = 0;
-            };
+        }
 
-            for (auto v : accumulated)
-                markLiveEntry(v);
-            for (auto pi : accumulatedPhiInput)
-                for (auto v : pi.second)
-                    markLiveEntry(v);
-
-            // Merge everything that is live at the beginning of the BB into the
-            // incoming vars of all predecessors
-            //
-            // Phi inputs should only be merged to BB that are successors of the
-            // input BBs
-            auto merge = [&](BB* bb, const std::set<Value*>& live) {
-                auto& liveOut = liveAtEnd[bb];
-                if (!std::includes(liveOut.begin(), liveOut.end(), live.begin(),
-                                   live.end())) {
-                    liveOut.insert(live.begin(), live.end());
-                    todo.insert(bb);
-                }
-            };
-            auto mergePhiInp = [&](BB* bb) {
-                for (auto in : accumulatedPhiInput) {
-                    auto inBB = in.first;
-                    auto inLive = in.second;
-                    if (bb == inBB || cfg.isPredecessor(inBB, bb)) {
-                        merge(bb, inLive);
+        // Run every BB in reverse to collect the live ranges
+        liveRanges.resize(n);
+        std::vector<unsigned> end(n);
+        BitSet live(n);
+        unsigned start = 0;
+        for (auto bb : bbs) {
+            unsigned pos = 2 * bb->size();
+            liveOut[bb->id].each([&](size_t v) {
+                live.set(v);
+                end[v] = start + pos;
+            });
+
+            for (auto ip = bb->end(); ip != bb->begin();) {
+                --ip;
+                pos -= 2;
+                Instruction* i = *ip;
+
+                auto markUse = [&](Value* v) {
+                    if (!numbered(v))
+                        return;
+                    size_t a = number.at(v);
+                    if (!live.test(a)) {
+                        live.set(a);
+                        end[a] = start + pos;
                     }
-                }
-            };
-            for (auto pre : cfg.immediatePredecessors(bb)) {
-                bool firstTime = !liveAtEnd.count(pre);
-                if (firstTime) {
-                    liveAtEnd[pre] = accumulated;
-                    mergePhiInp(pre);
-                    todo.insert(pre);
-                } else {
-                    merge(pre, accumulated);
-                    mergePhiInp(pre);
+                };
+                if (auto phi = Phi::Cast(i))
+                    phi->eachArg([&](BB*, Value* v) { markUse(v); });
+                else
+                    i->eachArg(markUse);
+
+                size_t d = number.at(i);
+                if (live.test(d)) {
+                    liveRanges[d].push_back({start + pos + 1, end[d]});
+                    live.reset(d);
                 }
             }
+
+            // Everything still live is live at the beginning of the BB
+            live.each([&](size_t v) {
+                liveRanges[v].push_back({start, end[v]});
+                live.reset(v);
+            });
+
+            start += 2 * bb->size() + 2;
         }
 
+        for (auto& r : liveRanges)
+            normalize(r);
+
         if (verbose) {
             std::cout << "======= Liveness ========\n";
-            for (auto ll : livenessInterval) {
-                auto& l = ll.second;
-                ll.first->printRef(std::cout);
+            for (size_t v = 0; v < n; ++v) {
+                if (liveRanges[v].empty())
+                    continue;
+                values[v]->printRef(std::cout);
                 std::cout << " is live : ";
-                for (size_t i = 0; i < bbsSize; ++i) {
-                    if (l[i].live) {
-                        std::cout << "BB" << i << " [";
-                        std::cout << l[i].begin << ",";
-                        std::cout << l[i].end << "]  ";
-                    }
-                }
+                for (auto& r : liveRanges[v])
+                    std::cout << "[" << r.begin << "," << r.end << "]  ";
                 std::cout << "\n";
             }
             std::cout << "======= End Liveness ========\n";
@@ -321,81 +370,111 @@ class SSAAllocator {
     }
 
     void computeAllocation() {
-        std::unordered_map<SlotNumber, std::unordered_set<Value*>> reverseAlloc;
-        auto slotIsAvailable = [&](SlotNumber slot, Value* i) {
-            for (auto other : reverseAlloc[slot])
-                if (livenessInterval.at(other).interfere(
-                        livenessInterval.at(i)))
+        // Occupied ranges of every slot (index 0 is unused) and the last
+        // position in use, for the common case of no overlap.
+        std::vector<Ranges> slotRanges(1);
+        std::vector<unsigned> slotEnd(1);
+
+        auto slotIsAvailable = [&](SlotNumber slot, const Ranges& ranges) {
+            if (ranges.front().begin > slotEnd[slot])
+                return true;
+            auto& occupied = slotRanges[slot];
+            for (auto& r : ranges) {
+                // first occupied range which does not end before r
+                auto o = std::lower_bound(
+                    occupied.begin(), occupied.end(), r.begin,
+                    [](const Range& a, unsigned pos) { return a.end < pos; });
+                if (o != occupied.end() && o->begin <= r.end)
                     return false;
+            }
             return true;
         };
 
+        auto assign = [&](SlotNumber slot, const Ranges& ranges) {
+            auto& occupied = slotRanges[slot];
+            Ranges merged;
+            merged.reserve(occupied.size() + ranges.size());
+            std::merge(occupied.begin(), occupied.end(), ranges.begin(),
+                       ranges.end(), std::back_inserter(merged),
+                       [](const Range& a, const Range& b) {
+                           return a.begin < b.begin;
+                       });
+            occupied.swap(merged);
+            slotEnd[slot] = std::max(slotEnd[slot], ranges.back().end);
+        };
+
+        auto findSlot = [&](const Ranges& ranges,
+                            const std::vector<SlotNumber>& hints) {
+            for (auto hint : hints)
+                if (hint != unassignedSlot && hint != stackSlot &&
+                    slotIsAvailable(hint, ranges))
+                    return hint;
+            for (SlotNumber slot = 1; slot < slotRanges.size(); ++slot)
+                if (slotIsAvailable(slot, ranges))
+                    return slot;
+            slotRanges.emplace_back();
+            slotEnd.push_back(0);
+            return slotRanges.size() - 1;
+        };
+
         // Precolor Phi
-        Visitor::run(code->entry, [&](Instruction* i) {
+        for (auto i : values) {
             auto p = Phi::Cast(i);
             if (!p || allocation.count(p))
-                return;
-            SlotNumber slot = unassignedSlot;
-            while (true) {
-                ++slot;
-                bool success = slotIsAvailable(slot, p);
-                if (success) {
-                    p->eachArg([&](BB*, Value* v) {
-                        if (!slotIsAvailable(slot, v))
-                            success = false;
-                    });
-                }
-                if (success)
-                    break;
-            }
-            allocation[i] = slot;
-            reverseAlloc[slot].insert(i);
-            p->eachArg([&](BB*, Value* v) {
-                allocation[v] = slot;
-                reverseAlloc[slot].insert(v);
-            });
-        });
-
-        // Traverse the dominance graph in preorder and eagerly assign slots.
-        // We assume that no critical paths exist, ie. we preprocessed the graph
-        // such that every phi input is only used exactly once (by the phi).
-        DominatorTreeVisitor<>(dom).run(code, [&](BB* bb) {
-            auto findFreeSlot = [&](Instruction* i) {
-                SlotNumber slot = unassignedSlot;
-                for (;;) {
-                    ++slot;
-                    if (slotIsAvailable(slot, i)) {
-                        allocation[i] = slot;
-                        reverseAlloc[slot].insert(i);
-                        break;
-                    }
-                };
+                continue;
+            Ranges group;
+            auto add = [&](Value* v) {
+                if (isLive(v))
+                    group.insert(group.end(), rangesOf(v).begin(),
+                                 rangesOf(v).end());
             };
+            add(p);
+            p->eachArg([&](BB*, Value* v) { add(v); });
+            normalize(group);
+            assert(!group.empty() && "phi inputs are live until the phi");
+
+            SlotNumber slot = findSlot(group, {});
+            assign(slot, group);
+            allocation[p] = slot;
+            p->eachArg([&](BB*, Value* v) { allocation[v] = slot; });
+        }
 
-            size_t pos = 0;
-            for (auto i : *bb) {
-                ++pos;
-
-                if (!allocation.count(i) && livenessInterval.count(i)) {
-                    // Try to reuse input slot, to reduce moving
-                    SlotNumber hint = unassignedSlot;
-                    if (i->nargs() > 0) {
-                        auto o = Instruction::Cast(i->arg(0).val());
-                        if (o && allocation.count(o))
-                            hint = allocation.at(o);
-                    }
-                    if (hint != unassignedSlot && hint != stackSlot &&
-                        slotIsAvailable(hint, i)) {
-                        allocation[i] = hint;
-                        reverseAlloc[hint].insert(i);
-                    } else {
-                        findFreeSlot(i);
-                    }
-                }
+        // Slots of copies of an instruction are a good hint, since the copy
+        // disappears if both share the slot.
+        std::unordered_map<Value*, SlotNumber> copyHint;
+        for (auto i : values) {
+            if (PirCopy::Cast(i) && allocation.count(i))
+                copyHint[i->arg(0).val()] = allocation.at(i);
+        }
+
+        // Linear scan over all remaining live instructions
+        std::vector<Instruction*> todo;
+        for (auto i : values)
+            if (!allocation.count(i) && isLive(i))
+                todo.push_back(i);
+        std::sort(todo.begin(), todo.end(),
+                  [&](Instruction* a, Instruction* b) {
+                      return rangesOf(a).front().begin <
+                             rangesOf(b).front().begin;
+                  });
+
+        for (auto i : todo) {
+            std::vector<SlotNumber> hints;
+            if (copyHint.count(i))
+                hints.push_back(copyHint.at(i));
+            if (i->nargs() > 0) {
+                auto o = Instruction::Cast(i->arg(0).val());
+                if (o && allocation.count(o))
+                    hints.push_back(allocation.at(o));
             }
-        });
+            auto& ranges = rangesOf(i);
+            SlotNumber slot = findSlot(ranges, hints);
+            assign(slot, ranges);
+            allocation[i] = slot;
+            if (PirCopy::Cast(i))
+                copyHint.emplace(i->arg(0).val(), slot);
+        }
     }
-
     void print(std::ostream& out = std::cout) {
         out << "======= Allocation ========\n";
         BreadthFirstVisitor::run(code->entry, [&](BB* bb) {
@@ -615,16 +694,24 @@ class Pir2Rir {
     Closure* cls;
     std::unordered_map<Promise*, BC::FunIdx> promises;
     std::unordered_map<Promise*, SEXP> argNames;
+    // Frames of every deoptimization point, indexed by the immediate of deopt_
+    std::vector<std::vector<DeoptFrame>> deopts;
 };
 
 size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
-    toCSSA(code);
+    bool statistics = compiler.debug.includes(DebugFlag::PassStatistics);
+    {
+        PassStatistics::Timer t(statistics, "cssa", cls, code);
+        toCSSA(code);
+    }
 
     if (compiler.debug.includes(DebugFlag::PrintCSSA))
         code->print(std::cout);
 
+    PassStatistics::Timer allocTimer(statistics, "allocation", cls, code);
     SSAAllocator alloc(code,
                        compiler.debug.includes(DebugFlag::DebugAllocator));
+    allocTimer.stop();
 
     if (compiler.debug.includes(DebugFlag::PrintLivenessIntervals))
         alloc.print();
@@ -634,6 +721,9 @@ size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
 
     alloc.verify();
 
+    // Measures the rest of this function
+    PassStatistics::Timer loweringTimer(statistics, "lowering", cls, code);
+
     // create labels for all bbs
     std::unordered_map<BB*, BC::Label> bbLabels;
     BreadthFirstVisitor::run(code->entry, [&](BB* bb) {
@@ -653,6 +743,18 @@ size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
         for (auto it = bb->begin(); it != bb->end(); ++it) {
             auto instr = *it;
 
+            // A copy between two locals is a single movloc_, or nothing if
+            // both ended up in the same slot
+            if (auto copy = PirCopy::Cast(instr)) {
+                Value* src = copy->arg(0).val();
+                if (alloc.hasSlot(copy) && !alloc.onStack(copy) &&
+                    alloc.hasSlot(src) && !alloc.onStack(src)) {
+                    if (alloc[src] != alloc[copy])
+                        cs << BC::copyloc(alloc[copy], alloc[src]);
+                    continue;
+                }
+            }
+
             bool hasResult =
                 instr->type != PirType::voyd() && !Phi::Cast(instr);
 
@@ -701,7 +803,8 @@ size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
 
                 // Step one: load and set env
                 if (!Phi::Cast(instr)) {
-                    if (instr->hasEnv() && !explicitEnvValue(instr)) {
+                    if (instr->hasEnv() && !explicitEnvValue(instr) &&
+                        instr->env() != Env::elided()) {
                         // If the env is passed on the stack, it needs
                         // to be TOS here. To relax this condition some
                         // stack shuffling would be needed.
@@ -724,6 +827,9 @@ size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
                         if (instr->hasEnv() && instr->env() == what) {
                             if (explicitEnvValue(instr))
                                 loadEnv(it, what);
+                        } else if (Deopt::Cast(instr) && Env::isAnyEnv(what)) {
+                            // env of a caller frame
+                            loadEnv(it, what);
                         } else {
                             loadArg(it, instr, what);
                         }
@@ -755,10 +861,31 @@ size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
                 cs << BC::swap() << BC::pop();
                 break;
             }
+            case Tag::ForKernel: {
+                cs << BC::forKernel(ForKernel::Cast(instr)->kernel);
+                // Like ForSeqSize, the sequence is popped
+                cs << BC::swap() << BC::pop();
+                break;
+            }
             case Tag::LdArg: {
                 cs << BC::ldarg(LdArg::Cast(instr)->id);
                 break;
             }
+            case Tag::LdDots: {
+                // The callee expands `...` from the caller env
+                cs << BC::push(R_DotsSymbol);
+                break;
+            }
+            case Tag::LdDDVar: {
+                auto ld = LdDDVar::Cast(instr);
+                cs << BC::ldddvar(ld->varName);
+                break;
+            }
+            case Tag::IsMissing: {
+                auto missing = IsMissing::Cast(instr);
+                cs << BC::missing(missing->varName);
+                break;
+            }
             case Tag::StVarSuper: {
                 auto stvar = StVarSuper::Cast(instr);
                 cs << BC::stvarSuper(stvar->varName);
@@ -771,7 +898,10 @@ size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
             }
             case Tag::StVar: {
                 auto stvar = StVar::Cast(instr);
-                cs << BC::stvar(stvar->varName);
+                if (stvar->isStArg)
+                    cs << BC::starg(stvar->varName);
+                else
+                    cs << BC::stvar(stvar->varName);
                 break;
             }
             case Tag::Branch: {
@@ -818,6 +948,15 @@ size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
                 cs << BC::is(is->sexpTag);
                 break;
             }
+            case Tag::IsType: {
+                cs << BC::isType(IsType::Cast(instr)->expected);
+                break;
+            }
+            case Tag::Unbox: {
+                cs << BC::unbox(instr->type == NativeType::integer ? INTSXP
+                                                                   : REALSXP);
+                break;
+            }
             case Tag::Subassign2_1D: {
                 auto res = Subassign2_1D::Cast(instr);
                 cs << BC::subassign2(res->sym);
@@ -859,6 +998,9 @@ size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
                 SIMPLE(Subassign1_1D, subassign1);
                 SIMPLE(IsObject, isObj);
                 SIMPLE(Int3, int3);
+                SIMPLE(Box, box);
+                SIMPLE(InBounds, inBounds);
+                SIMPLE(Extract2_1DUnchecked, extract2_1Unchecked);
 #undef SIMPLE
 
 #define SIMPLE_WITH_SRCIDX(Name, Factory)                                      \
@@ -867,19 +1009,10 @@ size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
         cs.addSrcIdx(instr->srcIdx);                                           \
         break;                                                                 \
     }
-                SIMPLE_WITH_SRCIDX(Add, add);
-                SIMPLE_WITH_SRCIDX(Sub, sub);
-                SIMPLE_WITH_SRCIDX(Mul, mul);
                 SIMPLE_WITH_SRCIDX(Div, div);
                 SIMPLE_WITH_SRCIDX(IDiv, idiv);
                 SIMPLE_WITH_SRCIDX(Mod, mod);
                 SIMPLE_WITH_SRCIDX(Pow, pow);
-                SIMPLE_WITH_SRCIDX(Lt, lt);
-                SIMPLE_WITH_SRCIDX(Gt, gt);
-                SIMPLE_WITH_SRCIDX(Lte, ge);
-                SIMPLE_WITH_SRCIDX(Gte, le);
-                SIMPLE_WITH_SRCIDX(Eq, eq);
-                SIMPLE_WITH_SRCIDX(Neq, ne);
                 SIMPLE_WITH_SRCIDX(Colon, colon);
                 SIMPLE_WITH_SRCIDX(AsLogical, asLogical);
                 SIMPLE_WITH_SRCIDX(Plus, uplus);
@@ -891,11 +1024,38 @@ size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
                 SIMPLE_WITH_SRCIDX(Extract2_2D, extract2_2);
 #undef SIMPLE_WITH_SRCIDX
 
+    // Type directed, the operands are either both boxed or both unboxed
+#define BINOP_WITH_SRCIDX(Name, Factory, Unboxed)                              \
+    case Tag::Name: {                                                          \
+        if (instr->arg(0).val()->type.isRType())                               \
+            cs << BC::Factory();                                               \
+        else                                                                   \
+            cs << BC::Unboxed();                                               \
+        cs.addSrcIdx(instr->srcIdx);                                           \
+        break;                                                                 \
+    }
+                BINOP_WITH_SRCIDX(Add, add, nadd);
+                BINOP_WITH_SRCIDX(Sub, sub, nsub);
+                BINOP_WITH_SRCIDX(Mul, mul, nmul);
+                BINOP_WITH_SRCIDX(Lt, lt, nlt);
+                BINOP_WITH_SRCIDX(Gt, gt, ngt);
+                BINOP_WITH_SRCIDX(Lte, ge, nge);
+                BINOP_WITH_SRCIDX(Gte, le, nle);
+                BINOP_WITH_SRCIDX(Eq, eq, neq);
+                BINOP_WITH_SRCIDX(Neq, ne, nne);
+#undef BINOP_WITH_SRCIDX
+
             case Tag::Call: {
                 auto call = Call::Cast(instr);
                 cs << BC::call(call->nCallArgs(), Pool::get(call->srcIdx));
                 break;
             }
+            case Tag::NamedCall: {
+                auto call = NamedCall::Cast(instr);
+                cs << BC::call(call->nCallArgs(), call->names,
+                               Pool::get(call->srcIdx));
+                break;
+            }
             case Tag::StaticCall: {
                 auto call = StaticCall::Cast(instr);
                 compiler.compile(call->cls(), call->origin());
@@ -917,6 +1077,10 @@ size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
                                      blt->blt);
                 break;
             }
+            case Tag::CallIntrinsic: {
+                cs << BC::callIntrinsic(CallIntrinsic::Cast(instr)->intrinsic);
+                break;
+            }
             case Tag::MkEnv: {
                 auto mkenv = MkEnv::Cast(instr);
 
@@ -946,9 +1110,14 @@ size_t Pir2Rir::compileCode(Context& ctx, Code* code) {
                 break;
             }
             case Tag::Deopt: {
-                Deopt::Cast(instr)->eachArg([&](Value*) { cs << BC::pop(); });
-                // TODO
-                cs << BC::int3() << BC::push(R_NilValue) << BC::ret();
+                // The frame states are on the stack, see DeoptTable
+                std::vector<DeoptFrame> frames;
+                for (auto& f : Deopt::Cast(instr)->frames)
+                    frames.push_back({f.code, f.pc, (unsigned)f.stackSize});
+                deopts.push_back(frames);
+                cs << BC::deopt(deopts.size() - 1);
+
+                // this is the end of this BB
                 return;
             }
             // values, not instructions
@@ -1032,17 +1201,22 @@ rir::Function* Pir2Rir::finalize() {
     FunctionWriter function = FunctionWriter::create();
     Context ctx(function);
 
-    size_t i = 0;
-    for (auto arg : cls->defaultArgs) {
+    for (size_t i = 0; i < cls->defaultArgs.size(); ++i) {
+        Promise* arg = cls->defaultArgs[i];
         if (!arg)
             continue;
-        getPromiseIdx(ctx, arg);
-        argNames[arg] = cls->argNames[i++];
+        ctx.pushDefaultArg(src_pool_at(globalContext(), arg->srcPoolIdx));
+        size_t localsCnt = compileCode(ctx, arg);
+        promises[arg] = ctx.finalizeCode(localsCnt);
+        argNames[arg] = cls->argNames[i];
     }
     ctx.pushBody(R_NilValue);
     size_t localsCnt = compileCode(ctx, cls);
     ctx.finalizeCode(localsCnt);
 
+    if (!deopts.empty())
+        function.function->deoptTable(DeoptTable::create(deopts));
+
 #ifdef ENABLE_SLOWASSERT
     CodeVerifier::verifyFunctionLayout(function.function->container(),
                                        globalContext());
@@ -1060,7 +1234,7 @@ void Pir2RirCompiler::compile(Closure* cls, SEXP origin) {
     done.insert(cls);
 
     auto table = DispatchTable::unpack(BODY(origin));
-    if (table->available(1))
+    if (table->available(1) && !table->at(1)->deopt)
         return;
 
     Pir2Rir pir2rir(*this, cls);
@@ -1073,6 +1247,7 @@ void Pir2RirCompiler::compile(Closure* cls, SEXP origin) {
             (*it)->print();
             ++it;
         }
+        DeoptTable::print(fun->deoptTable(), std::cout);
     }
 
     if (debug.includes(DebugFlag::DryRun))
@@ -1088,6 +1263,9 @@ void Pir2RirCompiler::compile(Closure* cls, SEXP origin) {
     fun->envChanged = oldFun->envChanged;
     // TODO: signatures need a rework
     fun->signature = oldFun->signature;
+    fun->origin(oldFun);
+    if (table->available(1))
+        fun->next(table->at(1));
 
     if (debug.intersects(PrintDebugPasses)) {
         std::cout << "\n*********** Finished compiling: " << std::setw(17)
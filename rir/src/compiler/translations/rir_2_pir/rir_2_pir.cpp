@@ -141,6 +141,7 @@ void Rir2Pir::translate(rir::Code* srcCode, Builder& insert,
                 if (compiler.debug.includes(DebugFlag::ShowWarnings))
                     std::cerr << "Cannot compile Function. Unsupported "
                                  "beginloop bc\n";
+                compiler.recordUnsupported(bc.bc);
                 fail();
                 return;
             default:
@@ -186,7 +187,8 @@ void Rir2Pir::translate(rir::Code* srcCode, Builder& insert,
                 state.setPC(trg);
                 state.setEntry(branch);
                 insert.bb = branch;
-                insert(new Deopt(insert.env, state.getPC(), state.stack));
+                insert(new Deopt(insert.env, srcCode, state.getPC(),
+                                 state.stack));
                 break;
             }
             default:
@@ -204,15 +206,26 @@ void Rir2Pir::translate(rir::Code* srcCode, Builder& insert,
             case Opcode::ret_:
                 break;
             case Opcode::return_:
-                if (compiler.debug.includes(DebugFlag::ShowWarnings))
-                    std::cerr
-                        << "Cannot compile Function. Unsupported return bc\n";
-                fail();
-                return;
+                // In the body of the function a non-local return is a normal
+                // return. From promises it would need to unwind the caller.
+                if (srcCode != srcFunction->body()) {
+                    if (compiler.debug.includes(DebugFlag::ShowWarnings))
+                        std::cerr << "Cannot compile Function. Unsupported "
+                                     "return bc\n";
+                    compiler.recordUnsupported(bc.bc);
+                    fail();
+                    return;
+                }
+                break;
             default:
                 assert(false);
             }
             results.push_back(ReturnSite(insert.bb, state.pop()));
+            // return_ leaves the function with the stack in any state
+            if (bc.bc == Opcode::return_) {
+                while (!state.empty())
+                    state.pop();
+            }
             assert(state.empty());
             if (worklist.empty()) {
                 state.clear();
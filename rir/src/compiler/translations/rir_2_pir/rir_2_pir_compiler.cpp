@@ -8,10 +8,13 @@
 #include "../../opt/cleanup.h"
 #include "../../opt/delay_env.h"
 #include "../../opt/delay_instr.h"
+#include "../../opt/elide_bounds_checks.h"
 #include "../../opt/elide_env.h"
 #include "../../opt/force_dominance.h"
 #include "../../opt/inline.h"
 #include "../../opt/scope_resolution.h"
+#include "../../opt/unbox_scalars.h"
+#include "../../util/pass_statistics.h"
 #include "ir/BC.h"
 
 #include <iomanip>
@@ -56,19 +59,31 @@ void Rir2PirCompiler::compileClosure(rir::Function* srcFunction,
                                      FormalArgs const& formals, Env* closureEnv,
                                      MaybeCls success, Maybe fail) {
 
-    // TODO: Support default arguments and dots
-    if (formals.hasDefaultArgs || formals.hasDots)
-        return fail();
-
     // TODO: we can only compile for a fixed closure env, if we have a guard if
     // someone where to change it! Most probably this would not trip any
     // problems as closure envs don't get changed often. But let's better be
     // safe than sorry.
     closureEnv = Env::notClosed();
 
+    // A recursive call cannot refer to the closure yet, its translation might
+    // still fail
+    if (compiling.count(srcFunction)) {
+        fail();
+        return;
+    }
+    compiling.insert(srcFunction);
+
     bool failed = false;
     module->createIfMissing(
         srcFunction, formals.names, closureEnv, [&](Closure* pirFunction) {
+            if (!compileDefaultArgs(srcFunction, formals, pirFunction)) {
+                if (debug.includes(DebugFlag::ShowWarnings))
+                    std::cout << " Failed to compile default args "
+                              << srcFunction << "\n";
+                failed = true;
+                return false;
+            }
+
             Builder builder(pirFunction, closureEnv);
             Rir2Pir rir2pir(*this, srcFunction);
             if (debug.intersects(PrintDebugPasses)) {
@@ -86,14 +101,28 @@ void Rir2PirCompiler::compileClosure(rir::Function* srcFunction,
                 }
             }
 
-            if (rir2pir.tryCompile(srcFunction->body(), builder)) {
+            bool compiled;
+            {
+                PassStatistics::Timer t(
+                    debug.includes(DebugFlag::PassStatistics), "rir2pir",
+                    pirFunction);
+                compiled = rir2pir.tryCompile(srcFunction->body(), builder);
+            }
+            if (compiled) {
                 if (debug.includes(DebugFlag::PrintEarlyPir)) {
                     std::cout << " ========= Compiled to PIR Version:";
                     builder.function->print(std::cout);
                 }
                 if (debug.intersects(PrintDebugPasses))
                     std::cout << " ========= Finished optimization passed\n";
-                if (!Verify::apply(pirFunction)) {
+                bool verified;
+                {
+                    PassStatistics::Timer t(
+                        debug.includes(DebugFlag::PassStatistics), "verify",
+                        pirFunction);
+                    verified = Verify::apply(pirFunction);
+                }
+                if (!verified) {
                     failed = true;
                     if (debug.includes(DebugFlag::ShowWarnings))
                         std::cout << " Failed verification after p2r compile "
@@ -108,6 +137,7 @@ void Rir2PirCompiler::compileClosure(rir::Function* srcFunction,
             failed = true;
             return false;
         });
+    compiling.erase(srcFunction);
 
     if (failed)
         fail();
@@ -115,6 +145,31 @@ void Rir2PirCompiler::compileClosure(rir::Function* srcFunction,
         success(module->get(srcFunction));
 }
 
+bool Rir2PirCompiler::compileDefaultArgs(rir::Function* srcFunction,
+                                         FormalArgs const& formals,
+                                         Closure* pirFunction) {
+    pirFunction->defaultArgs.resize(formals.names.size(), nullptr);
+    if (!formals.hasDefaultArgs)
+        return true;
+
+    // The compiled default args are stored in the order of the formals, see
+    // closureArgumentAdaptor
+    rir::Code* code = findDefaultArgument(srcFunction->first());
+    for (size_t i = 0; i < formals.names.size(); ++i) {
+        if (formals.defaultArgs[i] == R_MissingArg)
+            continue;
+        assert(code != srcFunction->codeEnd() &&
+               "No more compiled formals available.");
+        Promise* prom = pirFunction->createProm(code->src);
+        Builder promiseBuilder(pirFunction, prom);
+        if (!Rir2Pir(*this, srcFunction).tryCompile(code, promiseBuilder))
+            return false;
+        pirFunction->defaultArgs[i] = prom;
+        code = findDefaultArgument(code->next());
+    }
+    return true;
+}
+
 void Rir2PirCompiler::optimizeModule() {
     size_t passnr = 0;
     module->eachPirFunction([&](Module::VersionedClosure& v) {
@@ -130,13 +185,42 @@ void Rir2PirCompiler::optimizeModule() {
             auto f = v.current();
             if (debug.includes(DebugFlag::PreserveVersions))
                 v.saveVersion();
-            Inline::apply(f);
+            {
+                PassStatistics::Timer t(
+                    debug.includes(DebugFlag::PassStatistics), "inline", f);
+                Inline::apply(f);
+            }
             if (debug.includes(DebugFlag::PrintInlining)) {
                 printAfterPass("inline", "Inlining", f, passnr++);
             }
             applyOptimizations(f, "Optimizations After Inlining");
         });
     }
+
+    module->eachPirFunction([&](Module::VersionedClosure& v) {
+        auto f = v.current();
+        {
+            PassStatistics::Timer t(debug.includes(DebugFlag::PassStatistics),
+                                    "bounds checks", f);
+            ElideBoundsChecks::apply(f);
+            Cleanup().apply(f);
+        }
+        if (debug.includes(DebugFlag::PrintOptimizationPasses))
+            printAfterPass("bounds checks", "Bounds Checks", f, passnr++);
+#ifdef TYPED_STACK
+        // See UnboxScalars for why it needs the typed node stack
+        {
+            PassStatistics::Timer t(debug.includes(DebugFlag::PassStatistics),
+                                    "unbox", f);
+            UnboxScalars::apply(f);
+        }
+        if (debug.includes(DebugFlag::PrintOptimizationPasses))
+            printAfterPass("unbox", "Unboxing", f, passnr++);
+#endif
+#ifndef NDEBUG
+        assert(Verify::apply(f));
+#endif
+    });
 }
 
 void Rir2PirCompiler::printAfterPass(const std::string& pass,
@@ -150,15 +234,22 @@ void Rir2PirCompiler::printAfterPass(const std::string& pass,
 void Rir2PirCompiler::applyOptimizations(Closure* f,
                                          const std::string& category) {
     size_t passnr = 0;
+    bool statistics = debug.includes(DebugFlag::PassStatistics);
     for (auto& translation : this->translations) {
-        translation->apply(f);
+        {
+            PassStatistics::Timer t(statistics, translation->getName(), f);
+            translation->apply(f);
+        }
         if (debug.includes(DebugFlag::PrintOptimizationPasses))
             printAfterPass(translation->getName(), category, f, passnr++);
 #if 0
         assert(Verify::apply(f));
 #endif
     }
+#ifndef NDEBUG
+    PassStatistics::Timer t(statistics, "verify", f);
     assert(Verify::apply(f));
+#endif
 }
 
 } // namespace pir
@@ -3,6 +3,10 @@
 
 #include "../../../utils/FormalArgs.h"
 #include "../rir_compiler.h"
+#include "ir/BC_inc.h"
+
+#include <map>
+#include <set>
 
 namespace rir {
 namespace pir {
@@ -12,16 +16,30 @@ class Rir2PirCompiler : public RirCompiler {
     Rir2PirCompiler(Module* module, const DebugOptions& debug);
 
     void compileClosure(SEXP, MaybeCls success, Maybe fail) override;
+    Env* closureEnv(SEXP closure) { return module->getEnv(CLOENV(closure)); }
     void compileFunction(rir::Function*, FormalArgs const&, MaybeCls success,
                          Maybe fail);
     void optimizeModule();
     void printAfterPass(const std::string&, const std::string&, Closure*,
                         size_t);
 
+    // Counts for every opcode how often it caused a translation to fail. This
+    // is the data for the `pir.coverage` report.
+    typedef std::map<Opcode, size_t> UnsupportedOpcodes;
+    const UnsupportedOpcodes& unsupportedOpcodes() const {
+        return unsupported;
+    }
+    void recordUnsupported(Opcode bc) { unsupported[bc]++; }
+
   private:
     void compileClosure(rir::Function*, FormalArgs const&, Env* closureEnv,
                         MaybeCls success, Maybe fail);
+    bool compileDefaultArgs(rir::Function*, FormalArgs const&, Closure*);
     void applyOptimizations(Closure*, const std::string&);
+
+    UnsupportedOpcodes unsupported;
+    // Closures whose translation is in progress
+    std::set<rir::Function*> compiling;
 };
 } // namespace pir
 } // namespace rir
@@ -3,6 +3,8 @@
 #include "../../pir/pir_impl.h"
 #include "../../util/builder.h"
 #include "R/Funtab.h"
+#include "interpreter/builtins.h"
+#include "interpreter/interp_context.h"
 #include "ir/BC.h"
 #include "ir/Compiler.h"
 #include "rir_2_pir.h"
@@ -69,6 +71,59 @@ bool StackMachine::tryRunCurrentBC(const Rir2Pir& rir2pir, Builder& insert) {
         return tmp;
     };
 
+    // Translates the promise arguments of an implicit call to MkArg
+    auto compilePromiseArgs = [&](std::vector<Value*>& args) {
+        for (auto argi : bc.immediateCallArguments) {
+            if (argi == DOTS_ARG_IDX) {
+                args.push_back(insert(new LdDots(env)));
+                continue;
+            } else if (argi == MISSING_ARG_IDX) {
+                args.push_back(insert(new LdConst(R_MissingArg)));
+                continue;
+            }
+            rir::Code* promiseCode = srcFunction->codeAt(argi);
+            Promise* prom = insert.function->createProm(promiseCode->src);
+            {
+                Builder promiseBuilder(insert.function, prom);
+                if (!Rir2Pir(rir2pir).tryCompile(promiseCode, promiseBuilder))
+                    return false;
+            }
+            Value* val = Missing::instance();
+            if (Query::pure(prom)) {
+                rir2pir.translate(promiseCode, insert,
+                                  [&](Value* success) { val = success; });
+            }
+            args.push_back(insert(new MkArg(prom, val, env)));
+        }
+        return true;
+    };
+
+    // A callee inlined later can only deoptimize, if the caller has nothing
+    // else on its stack. The caller then continues after the call.
+    auto recordCaller = [&](Value* call) {
+        if (empty()) {
+            auto c = CallInstruction::CastCall(call);
+            c->callerCode = srcCode;
+            c->callerPc = pc + bc.size();
+        }
+    };
+    auto pushCall = [&](Value* call) {
+        recordCaller(call);
+        push(call);
+    };
+
+    static const PirType scalarInt =
+        PirType(RType::integer).scalar().noAttribs();
+    static const PirType scalarNum =
+        (PirType(RType::integer) | RType::real).scalar().noAttribs();
+
+    auto callArgumentNames = [&]() {
+        std::vector<SEXP> names;
+        for (auto n : bc.callArgumentNames)
+            names.push_back(rir::Pool::get(n));
+        return names;
+    };
+
     switch (bc.bc) {
 
     case Opcode::push_:
@@ -85,6 +140,34 @@ bool StackMachine::tryRunCurrentBC(const Rir2Pir& rir2pir, Builder& insert) {
         insert(new StVar(bc.immediateConst(), v, env));
         break;
 
+    case Opcode::ldlval_:
+        // ldlval_ expects the binding to be forced already, so the Force is
+        // a no-op here
+        v = insert(new LdVar(bc.immediateConst(), env));
+        push(insert(new Force(v, env)));
+        break;
+
+    case Opcode::ldddvar_:
+        push(insert(new LdDDVar(bc.immediateConst(), env)));
+        break;
+
+    case Opcode::missing_:
+        push(insert(new IsMissing(bc.immediateConst(), env)));
+        break;
+
+    case Opcode::asast_: {
+        // The ast is only known statically, if the promise was created here
+        auto mkarg = MkArg::Cast(top());
+        if (!mkarg || !mkarg->prom) {
+            rir2pir.compiler.recordUnsupported(bc.bc);
+            return false;
+        }
+        pop();
+        push(insert(new LdConst(
+            src_pool_at(globalContext(), mkarg->prom->srcPoolIdx))));
+        break;
+    }
+
     case Opcode::ldvar_super_:
         push(insert(new LdVarSuper(bc.immediateConst(), env)));
         break;
@@ -144,85 +227,39 @@ bool StackMachine::tryRunCurrentBC(const Rir2Pir& rir2pir, Builder& insert) {
         break;
 
     case Opcode::record_binop_: {
-        // TODO
+        // Promises with deopts cannot be inlined, which is worth more
+        if (srcCode != srcFunction->body())
+            break;
+        speculateType(1, bc.immediate.binopFeedback[0], insert);
+        speculateType(0, bc.immediate.binopFeedback[1], insert);
         break;
     }
 
     case Opcode::record_call_: {
         Value* target = top();
-        callFeedback[target] = bc.immediate.callFeedback;
+        callFeedback[target] = {bc.immediate.callFeedback, pc};
         break;
     }
 
     case Opcode::call_implicit_: {
         std::vector<Value*> args;
-        for (auto argi : bc.immediateCallArguments) {
-            if (argi == DOTS_ARG_IDX) {
-                return false;
-            } else if (argi == MISSING_ARG_IDX) {
-                return false;
-            }
-            rir::Code* promiseCode = srcFunction->codeAt(argi);
-            Promise* prom = insert.function->createProm(promiseCode->src);
-            {
-                Builder promiseBuilder(insert.function, prom);
-                if (!Rir2Pir(rir2pir).tryCompile(promiseCode, promiseBuilder))
-                    return false;
-            }
-            Value* val = Missing::instance();
-            if (Query::pure(prom)) {
-                rir2pir.translate(promiseCode, insert,
-                                  [&](Value* success) { val = success; });
-            }
-            args.push_back(insert(new MkArg(prom, val, env)));
-        }
+        if (!compilePromiseArgs(args))
+            return false;
 
         Value* callee = pop();
-        SEXP monomorphic = nullptr;
-        if (callFeedback.count(callee)) {
-            auto& feedback = callFeedback.at(callee);
-            if (feedback.numTargets == 1)
-                monomorphic = feedback.targets[0];
-        }
-        // TODO: currently speculative static calls break our tests, so we
-        // disable them here. But most probably we are just hiding some actual
-        // bugs with this, so we should REALLY REALLY enable it again!
-        monomorphic = nullptr;
-
         auto ast = bc.immediate.callFixedArgs.ast;
-        auto insertGenericCall = [&]() {
-            push(insert(new Call(insert.env, callee, args, ast)));
-        };
-        if (monomorphic && isValidClosureSEXP(monomorphic)) {
-            rir2pir.compiler.compileClosure(
-                monomorphic,
-                [&](Closure* f) {
-                    Value* expected = insert(new LdConst(monomorphic));
-                    Value* t = insert(new Identical(callee, expected));
-                    insert(new Branch(t));
-                    BB* curBB = insert.bb;
-
-                    BB* fallback = insert.createBB();
-                    insert.bb = fallback;
-                    curBB->next0 = fallback;
-                    Value* r1 = insert(new Call(insert.env, callee, args, ast));
-
-                    BB* asExpected = insert.createBB();
-                    insert.bb = asExpected;
-                    curBB->next1 = asExpected;
-                    Value* r2 = insert(
-                        new StaticCall(insert.env, f, args, monomorphic, ast));
-
-                    BB* cont = insert.createBB();
-                    fallback->next0 = cont;
-                    asExpected->next0 = cont;
-                    insert.bb = cont;
-                    push(insert(new Phi({r1, r2}, {fallback, asExpected})));
-                },
-                insertGenericCall);
-        } else {
-            insertGenericCall();
-        }
+        if (!speculateCall(rir2pir, callee, args, ast, insert))
+            pushCall(insert(new Call(insert.env, callee, args, ast)));
+        break;
+    }
+
+    case Opcode::named_call_implicit_: {
+        std::vector<Value*> args;
+        if (!compilePromiseArgs(args))
+            return false;
+        Value* callee = pop();
+        push(insert(new NamedCall(env, callee, args, callArgumentNames(),
+                                  bc.immediate.callFixedArgs.ast)));
         break;
     }
 
@@ -247,11 +284,23 @@ bool StackMachine::tryRunCurrentBC(const Rir2Pir& rir2pir, Builder& insert) {
             args[n - i - 1] = pop();
 
         auto target = pop();
-        push(insert(
+        pushCall(insert(
             new Call(env, target, args, bc.immediate.callFixedArgs.ast)));
         break;
     }
 
+    case Opcode::named_call_: {
+        unsigned n = bc.immediate.callFixedArgs.nargs;
+        std::vector<Value*> args(n);
+        for (size_t i = 0; i < n; ++i)
+            args[n - i - 1] = pop();
+
+        auto target = pop();
+        push(insert(new NamedCall(env, target, args, callArgumentNames(),
+                                  bc.immediate.callFixedArgs.ast)));
+        break;
+    }
+
     case Opcode::static_call_: {
         unsigned n = bc.immediate.staticCallFixedArgs.nargs;
         auto ast = bc.immediate.staticCallFixedArgs.ast;
@@ -264,8 +313,22 @@ bool StackMachine::tryRunCurrentBC(const Rir2Pir& rir2pir, Builder& insert) {
         if (TYPEOF(target) == BUILTINSXP) {
             // TODO: compile a list of safe builtins
             static int vector = findBuiltin("vector");
-
-            if (getBuiltinNr(target) == vector)
+            // abs only errors for non-numbers
+            static int abs = findBuiltin("abs");
+
+            // Without attributes the builtins with a safe native
+            // implementation cannot dispatch and do not need the env
+            bool plainArgs = true;
+            for (auto a : args)
+                if (!a->type.isA(PirType::val().noAttribs()))
+                    plainArgs = false;
+
+            bool numArg =
+                n == 1 && args[0]->type.isA(PirType::num().noAttribs());
+
+            if (getBuiltinNr(target) == vector ||
+                (getBuiltinNr(target) == abs && numArg) ||
+                (plainArgs && NativeBuiltins::safe(target)))
                 push(insert(new CallSafeBuiltin(target, args, ast)));
             else
                 push(insert(new CallBuiltin(env, target, args, ast)));
@@ -281,7 +344,10 @@ bool StackMachine::tryRunCurrentBC(const Rir2Pir& rir2pir, Builder& insert) {
             rir2pir.compiler.compileClosure(
                 target,
                 [&](Closure* f) {
-                    push(insert(new StaticCall(env, f, args, target, ast)));
+                    pushCall(insert(
+                        new StaticCall(env, f, args, target,
+                                       rir2pir.compiler.closureEnv(target),
+                                       ast)));
                 },
                 [&]() { failed = true; });
             if (failed)
@@ -302,6 +368,10 @@ bool StackMachine::tryRunCurrentBC(const Rir2Pir& rir2pir, Builder& insert) {
         push(insert(new ForSeqSize(top())));
         break;
 
+    case Opcode::for_kernel_:
+        push(insert(new ForKernel(bc.immediateConst(), top(), env)));
+        break;
+
     case Opcode::extract1_1_: {
         Value* idx = pop();
         Value* vec = pop();
@@ -312,7 +382,16 @@ bool StackMachine::tryRunCurrentBC(const Rir2Pir& rir2pir, Builder& insert) {
     case Opcode::extract2_1_: {
         Value* idx = pop();
         Value* vec = pop();
-        push(insert(new Extract2_1D(vec, idx, env, consumeSrcIdx())));
+        auto extract = insert(new Extract2_1D(vec, idx, env, consumeSrcIdx()));
+        // The fast path in the interpreter returns a scalar without
+        // attributes. The fallback (errors and NA indices) still needs the env.
+        if (idx->type.isA(scalarNum)) {
+            for (auto t : {RType::integer, RType::real}) {
+                if (vec->type.isA(PirType(t).noAttribs()))
+                    extract->type = PirType(t).scalar().noAttribs();
+            }
+        }
+        push(extract);
         break;
     }
 
@@ -368,22 +447,46 @@ bool StackMachine::tryRunCurrentBC(const Rir2Pir& rir2pir, Builder& insert) {
         break;                                                                 \
     }
 
-        BINOP(Lt, lt_);
-        BINOP(Gt, gt_);
-        BINOP(Gte, le_);
-        BINOP(Lte, ge_);
         BINOP(Mod, mod_);
         BINOP(Div, div_);
         BINOP(IDiv, idiv_);
-        BINOP(Add, add_);
-        BINOP(Mul, mul_);
         BINOP(Colon, colon_);
         BINOP(Pow, pow_);
-        BINOP(Sub, sub_);
-        BINOP(Eq, eq_);
-        BINOP(Neq, ne_);
 #undef BINOP
 
+    // On int and real scalars without attributes these never dispatch and
+    // always take the fast path in the interpreter, which does not use the env
+#define SCALAR_BINOP(Name, Op, Relop)                                          \
+    case Opcode::Op: {                                                         \
+        auto rhs = pop();                                                      \
+        auto lhs = pop();                                                      \
+        if (lhs->type.isA(scalarNum) && rhs->type.isA(scalarNum)) {            \
+            auto binop = insert(                                               \
+                new Name(lhs, rhs, Env::elided(), consumeSrcIdx()));           \
+            if (Relop)                                                         \
+                binop->type = PirType(RType::logical).scalar().noAttribs();    \
+            else if (lhs->type.isA(scalarInt) && rhs->type.isA(scalarInt))     \
+                binop->type = scalarInt;                                       \
+            else                                                               \
+                binop->type = PirType(RType::real).scalar().noAttribs();       \
+            push(binop);                                                       \
+        } else {                                                               \
+            push(insert(new Name(lhs, rhs, env, consumeSrcIdx())));            \
+        }                                                                      \
+        break;                                                                 \
+    }
+
+        SCALAR_BINOP(Lt, lt_, true);
+        SCALAR_BINOP(Gt, gt_, true);
+        SCALAR_BINOP(Gte, le_, true);
+        SCALAR_BINOP(Lte, ge_, true);
+        SCALAR_BINOP(Eq, eq_, true);
+        SCALAR_BINOP(Neq, ne_, true);
+        SCALAR_BINOP(Add, add_, false);
+        SCALAR_BINOP(Mul, mul_, false);
+        SCALAR_BINOP(Sub, sub_, false);
+#undef SCALAR_BINOP
+
     case Opcode::identical_: {
         auto rhs = pop();
         auto lhs = pop();
@@ -484,19 +587,34 @@ bool StackMachine::tryRunCurrentBC(const Rir2Pir& rir2pir, Builder& insert) {
     case Opcode::stloc_:
     case Opcode::movloc_:
     case Opcode::isobj_:
+    case Opcode::istype_:
+    case Opcode::unbox_:
+    case Opcode::box_:
+    case Opcode::extract2_1_unchecked_:
+    case Opcode::in_bounds_:
+    case Opcode::call_intrinsic_:
+    case Opcode::nadd_:
+    case Opcode::nsub_:
+    case Opcode::nmul_:
+    case Opcode::nlt_:
+    case Opcode::ngt_:
+    case Opcode::nle_:
+    case Opcode::nge_:
+    case Opcode::neq_:
+    case Opcode::nne_:
     case Opcode::check_missing_:
+    case Opcode::starg_:
+    case Opcode::deopt_:
         assert(false && "Recompiling PIR not supported for now.");
 
     // Unsupported opcodes:
-    case Opcode::named_call_:
-    case Opcode::named_call_implicit_:
-    case Opcode::ldlval_:
-    case Opcode::asast_:
-    case Opcode::missing_:
+    // guard_env_ would need a deoptimization target and loop contexts (only
+    // needed for non-local break and next) need support for non-local
+    // control flow in PIR.
     case Opcode::guard_env_:
     case Opcode::beginloop_:
     case Opcode::endcontext_:
-    case Opcode::ldddvar_:
+        rir2pir.compiler.recordUnsupported(bc.bc);
         return false;
     }
 
@@ -511,6 +629,120 @@ bool StackMachine::tryRunCurrentBC(const Rir2Pir& rir2pir, Builder& insert) {
     return true;
 }
 
+void StackMachine::speculateType(size_t i, const TypeFeedback& feedback,
+                                 Builder& insert) {
+    if (feedback.numTypes != 1)
+        return;
+    auto seen = feedback.seen[0];
+    if (seen.object || seen.attribs)
+        return;
+
+    PirType type;
+    switch (seen.sexptype) {
+    case INTSXP:
+        type = RType::integer;
+        break;
+    case REALSXP:
+        type = RType::real;
+        break;
+    default:
+        return;
+    }
+    if (seen.scalar)
+        type = type.scalar();
+    type = type.noAttribs();
+
+    Value* v = at(i);
+    if (v->type.isA(type) || !PirType::val().isSuper(v->type))
+        return;
+
+    insert(new Branch(insert(new IsType(seen, v))));
+    BB* guard = insert.bb;
+    BB* fail = insert.createBB();
+    BB* cont = insert.createBB();
+    guard->next0 = fail;
+    guard->next1 = cont;
+
+    // Continue in the baseline version before the record_binop_, such that
+    // the new type is recorded
+    insert.bb = fail;
+    insert(new Deopt(insert.env, srcCode, pc, stack));
+
+    insert.bb = cont;
+    set(i, insert(new CastType(v, v->type, type)));
+}
+
+bool StackMachine::speculateCall(const Rir2Pir& rir2pir, Value* callee,
+                                 const std::vector<Value*>& args, unsigned ast,
+                                 Builder& insert) {
+    // Promises with deopts cannot be inlined, which is worth more
+    if (srcCode != srcFunction->body() || !callFeedback.count(callee))
+        return false;
+    auto& recorded = callFeedback.at(callee);
+    auto& feedback = recorded.feedback;
+    // With MaxTargets targets the call site might have seen more of them
+    if (feedback.numTargets == 0 ||
+        feedback.numTargets == CallFeedback::MaxTargets)
+        return false;
+
+    std::vector<std::pair<SEXP, Closure*>> targets;
+    for (size_t i = 0; i < feedback.numTargets; ++i) {
+        SEXP target = feedback.targets[i];
+        if (!isValidClosureSEXP(target))
+            return false;
+        Closure* cls = nullptr;
+        rir2pir.compiler.compileClosure(target, [&](Closure* f) { cls = f; },
+                                        []() {});
+        if (!cls)
+            return false;
+        targets.push_back({target, cls});
+    }
+
+    // The stack at the record_call_
+    auto before = stack;
+    before.push_back(callee);
+
+    BB* cont = insert.createBB();
+    std::vector<std::pair<BB*, Value*>> results;
+    for (auto& t : targets) {
+        Value* expected = insert(new LdConst(t.first));
+        insert(new Branch(insert(new Identical(callee, expected))));
+        BB* guard = insert.bb;
+        BB* hit = insert.createBB();
+        BB* miss = insert.createBB();
+        guard->next0 = miss;
+        guard->next1 = hit;
+
+        insert.bb = hit;
+        auto call = insert(new StaticCall(insert.env, t.second, args, t.first,
+                                          rir2pir.compiler.closureEnv(t.first),
+                                          ast));
+        if (empty()) {
+            call->callerCode = srcCode;
+            call->callerPc = BC::next(pc);
+        }
+        results.push_back({hit, call});
+        hit->next0 = cont;
+        insert.bb = miss;
+    }
+
+    // None of the recorded targets, continue in the baseline version before
+    // the record_call_, such that the new target is recorded
+    insert(new Deopt(insert.env, srcCode, recorded.pc, before));
+
+    insert.bb = cont;
+    if (results.size() == 1) {
+        push(results.back().second);
+    } else {
+        Phi* phi = insert(new Phi());
+        for (auto r : results)
+            phi->addInput(r.first, r.second);
+        phi->updateType();
+        push(phi);
+    }
+    return true;
+}
+
 bool StackMachine::doMerge(Opcode* trg, Builder& builder, StackMachine* other) {
     if (other->entry == nullptr) {
         other->entry = builder.createBB();
@@ -48,13 +48,30 @@ class StackMachine {
     std::deque<Value*> stack;
 
   private:
-    std::unordered_map<Value*, CallFeedback> callFeedback;
+    // The call feedback of a callee and the pc of its record_call_
+    struct RecordedCall {
+        CallFeedback feedback;
+        Opcode* pc;
+    };
+    std::unordered_map<Value*, RecordedCall> callFeedback;
     rir::Function* srcFunction;
     rir::Code* srcCode;
     Opcode* pc;
     pir::BB* entry = nullptr;
     Value* at(size_t);
     void set(size_t n, Value* v);
+
+    // Guards that stack value i has the type in the feedback, if it is
+    // monomorphic. Deoptimizes otherwise.
+    void speculateType(size_t i, const TypeFeedback& feedback,
+                       Builder& insert);
+
+    // Calls the targets in the call feedback of `callee` statically, if there
+    // are few of them. Guards that the callee is one of them and deoptimizes
+    // otherwise.
+    bool speculateCall(const Rir2Pir& rir2pir, Value* callee,
+                       const std::vector<Value*>& args, unsigned ast,
+                       Builder& insert);
 };
 
 } // namespace pir
@@ -0,0 +1,68 @@
+#include "arena.h"
+
+#include <cassert>
+#include <cstdlib>
+
+namespace rir {
+namespace pir {
+
+namespace {
+// Every allocation is prefixed with its owning arena (or nullptr if it was
+// malloced), such that deallocate knows what to do. The header keeps the
+// payload aligned for any type.
+struct alignas(16) Header {
+    Arena* owner;
+};
+
+constexpr size_t alignUp(size_t size) {
+    return (size + alignof(Header) - 1) & ~(alignof(Header) - 1);
+}
+} // namespace
+
+Arena* Arena::current = nullptr;
+
+Arena::Arena() : outer(current) { current = this; }
+
+Arena::~Arena() {
+    assert(current == this && "Modules have to die in reverse order");
+    current = outer;
+    for (auto c : chunks)
+        free(c);
+}
+
+void* Arena::bump(size_t size) {
+    allocated_ += size;
+    if (size > ChunkSize / 4) {
+        // Big objects get their own chunk, to not waste the current one
+        char* big = static_cast<char*>(malloc(size));
+        chunks.push_back(big);
+        return big;
+    }
+    if (pos + size > end) {
+        pos = static_cast<char*>(malloc(ChunkSize));
+        end = pos + ChunkSize;
+        chunks.push_back(pos);
+    }
+    void* res = pos;
+    pos += size;
+    return res;
+}
+
+void* Arena::allocate(size_t size, Arena* arena) {
+    size_t total = sizeof(Header) + alignUp(size);
+    Header* h =
+        static_cast<Header*>(arena ? arena->bump(total) : malloc(total));
+    h->owner = arena;
+    return h + 1;
+}
+
+void Arena::deallocate(void* p) {
+    if (!p)
+        return;
+    Header* h = static_cast<Header*>(p) - 1;
+    if (!h->owner)
+        free(h);
+}
+
+} // namespace pir
+} // namespace rir
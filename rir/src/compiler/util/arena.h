@@ -0,0 +1,100 @@
+#ifndef COMPILER_ARENA_H
+#define COMPILER_ARENA_H
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+namespace rir {
+namespace pir {
+
+/*
+ * Bump pointer allocator for the PIR IR (instructions, BBs, promises,
+ * closures and their arg and instruction vectors).
+ *
+ * Every Module owns an arena. While a module is alive all PIR objects are
+ * allocated in its arena and freed in bulk when the module dies. `delete`
+ * still runs the destructor, but does not release any memory. Modules are
+ * strictly nested, therefore the live arenas form a stack and the innermost
+ * one receives all allocations. Objects created without a live Module fall
+ * back to malloc.
+ *
+ */
+class Arena {
+  public:
+    Arena();
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    void operator=(const Arena&) = delete;
+
+    // Allocates in the innermost live arena, or with malloc if there is none
+    static void* allocate(size_t size) { return allocate(size, current); }
+    // Allocates in `arena`, or with malloc if it is nullptr
+    static void* allocate(size_t size, Arena* arena);
+    static void deallocate(void* p);
+
+    static Arena* active() { return current; }
+
+    size_t allocated() const { return allocated_; }
+
+  private:
+    static constexpr size_t ChunkSize = 64 * 1024;
+
+    void* bump(size_t size);
+
+    std::vector<char*> chunks;
+    char* pos = nullptr;
+    char* end = nullptr;
+    size_t allocated_ = 0;
+
+    Arena* outer;
+    static Arena* current;
+};
+
+// Allocator to put std containers of PIR objects into an arena. The arena is
+// fixed when the container is created: a container created without a live
+// Module keeps using malloc, even if it grows while a Module is alive, such
+// that its storage does not die with that Module.
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_swap;
+
+    Arena* arena;
+
+    ArenaAllocator() : arena(Arena::active()) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    // A copy belongs to the object being created, not to the original
+    ArenaAllocator select_on_container_copy_construction() const {
+        return ArenaAllocator();
+    }
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(Arena::allocate(n * sizeof(T), arena));
+    }
+    void deallocate(T* p, size_t) { Arena::deallocate(p); }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena == b.arena;
+}
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) {
+    return a.arena != b.arena;
+}
+
+// Adds arena allocation to a class (and all its subclasses)
+#define PIR_ARENA_ALLOCATED                                                    \
+    static void* operator new(size_t size) {                                   \
+        return ::rir::pir::Arena::allocate(size);                              \
+    }                                                                          \
+    static void operator delete(void* p) { ::rir::pir::Arena::deallocate(p); }
+
+} // namespace pir
+} // namespace rir
+
+#endif
@@ -13,6 +13,32 @@ Builder::Builder(Closure* fun, Value* closureEnv)
     for (long i = fun->argNames.size() - 1; i >= 0; --i)
         args[i] = this->operator()(new LdArg(i));
     env = this->operator()(new MkEnv(closureEnv, fun->argNames, args.data()));
+
+    // Missing arguments get their default argument promise bound, the same
+    // way closureArgumentAdaptor does it in the interpreter
+    for (size_t i = 0; i < fun->defaultArgs.size(); ++i) {
+        Promise* def = fun->defaultArgs[i];
+        if (!def)
+            continue;
+        Value* missing = this->operator()(new LdConst(R_MissingArg));
+        this->operator()(new Branch(
+            this->operator()(new Identical(args[i], missing))));
+
+        BB* supplied = createBB();
+        BB* useDefault = createBB();
+        BB* cont = createBB();
+        bb->next0 = supplied;
+        bb->next1 = useDefault;
+        supplied->next0 = cont;
+
+        bb = useDefault;
+        Value* prom =
+            this->operator()(new MkArg(def, Missing::instance(), env));
+        auto st = new StVar(fun->argNames[i], prom, env);
+        st->isStArg = true;
+        this->operator()(st);
+        next(cont);
+    }
 }
 Builder::Builder(Closure* fun, Promise* prom)
     : function(fun), code(prom), env(nullptr), bb(prom->entry) {
@@ -0,0 +1,96 @@
+#include "pass_statistics.h"
+#include "../pir/pir_impl.h"
+#include "R/Printing.h"
+#include "interpreter/runtime.h"
+#include "runtime/Function.h"
+#include "visitor.h"
+
+#include <iomanip>
+#include <map>
+
+namespace rir {
+namespace pir {
+
+std::vector<PassStatistics::Entry> PassStatistics::log;
+
+static std::string name(Closure* closure) {
+    if (!closure->rirFunction)
+        return "?";
+    SEXP body = closure->rirFunction->body()->src;
+    return dumpSexp(src_pool_at(globalContext(), body), 18);
+}
+
+PassStatistics::Timer::Timer(bool enabled, const std::string& pass,
+                             Closure* closure, Code* code)
+    : enabled(enabled), closure(closure), code(code) {
+    if (!enabled)
+        return;
+    entry.pass = pass;
+    entry.closure = name(closure);
+    measure(entry.instrsBefore, entry.bbsBefore);
+    start = std::chrono::steady_clock::now();
+}
+
+void PassStatistics::Timer::stop() {
+    if (!enabled)
+        return;
+    enabled = false;
+    auto end = std::chrono::steady_clock::now();
+    entry.ms = std::chrono::duration<double, std::milli>(end - start).count();
+    measure(entry.instrsAfter, entry.bbsAfter);
+    log.push_back(entry);
+}
+
+void PassStatistics::Timer::measure(size_t& instrs, size_t& bbs) {
+    instrs = bbs = 0;
+    auto count = [&](Code* c) {
+        Visitor::run(c->entry, [&](BB* bb) {
+            bbs++;
+            instrs += bb->size();
+        });
+    };
+    if (code) {
+        count(code);
+    } else {
+        count(closure);
+        closure->eachPromise(count);
+    }
+}
+
+void PassStatistics::print(std::ostream& out, size_t first) {
+    struct Summary {
+        size_t runs = 0;
+        double ms = 0;
+        long instrs = 0;
+    };
+    std::map<std::string, Summary> summary;
+
+    out << "============== Pass statistics ======================\n";
+    out << std::left << std::setw(24) << "pass" << std::setw(20) << "closure"
+        << std::right << std::setw(10) << "ms" << std::setw(14)
+        << "instrs" << std::setw(10) << "bbs"
+        << "\n";
+    for (size_t i = first; i < log.size(); ++i) {
+        auto& e = log[i];
+        out << std::left << std::setw(24) << e.pass << std::setw(20)
+            << e.closure << std::right << std::setw(10) << std::fixed
+            << std::setprecision(3) << e.ms << std::setw(7) << e.instrsBefore
+            << std::setw(7) << e.instrsAfter << std::setw(5) << e.bbsBefore
+            << std::setw(5) << e.bbsAfter << "\n";
+        auto& s = summary[e.pass];
+        s.runs++;
+        s.ms += e.ms;
+        s.instrs += (long)e.instrsAfter - (long)e.instrsBefore;
+    }
+    out << "-------------- Summary ------------------------------\n";
+    for (auto& s : summary) {
+        out << std::left << std::setw(24) << s.first << std::right
+            << std::setw(6) << s.second.runs << " runs" << std::setw(12)
+            << std::fixed << std::setprecision(3) << s.second.ms << " ms"
+            << std::setw(8) << s.second.instrs << " instrs\n";
+    }
+    out << "=====================================================\n";
+}
+
+} // namespace pir
+} // namespace rir
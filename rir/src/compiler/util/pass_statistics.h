@@ -0,0 +1,68 @@
+#ifndef COMPILER_PASS_STATISTICS_H
+#define COMPILER_PASS_STATISTICS_H
+
+#include "../pir/pir.h"
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace rir {
+namespace pir {
+
+/*
+ * Process wide log of the compile time and the IR size of every PIR pass (and
+ * of the rir2pir and pir2rir stages) run on a closure. Only collected with
+ * DebugFlag::PassStatistics, see pir.passStatistics in R.
+ */
+class PassStatistics {
+  public:
+    struct Entry {
+        std::string pass;
+        // The source of the closure, PIR closures do not outlive the
+        // compilation
+        std::string closure;
+        double ms;
+        size_t instrsBefore;
+        size_t instrsAfter;
+        size_t bbsBefore;
+        size_t bbsAfter;
+    };
+
+    static const std::vector<Entry>& entries() { return log; }
+    static void clear() { log.clear(); }
+
+    // Prints the entries from `first` on and a per pass summary
+    static void print(std::ostream& out, size_t first = 0);
+
+    /*
+     * Measures a pass for its lifetime. The closure (including its promises)
+     * is measured before and after, or only `code` if given. stop() ends the
+     * measurement early.
+     */
+    class Timer {
+      public:
+        Timer(bool enabled, const std::string& pass, Closure* closure,
+              Code* code = nullptr);
+        ~Timer() { stop(); }
+        void stop();
+
+      private:
+        bool enabled;
+        Entry entry;
+        Closure* closure;
+        Code* code;
+        std::chrono::steady_clock::time_point start;
+
+        void measure(size_t& instrs, size_t& bbs);
+    };
+
+  private:
+    static std::vector<Entry> log;
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
@@ -0,0 +1,349 @@
+#include "builtins.h"
+#include "R/Funtab.h"
+
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace rir {
+
+// No attributes, thus no dispatch and nothing to copy to the result
+static bool isPlain(SEXP x) { return ATTRIB(x) == R_NilValue; }
+
+static bool isNum(SEXP x) {
+    return TYPEOF(x) == LGLSXP || TYPEOF(x) == INTSXP || TYPEOF(x) == REALSXP;
+}
+
+static SEXP length(const SEXP* args, size_t nargs) {
+    if (nargs != 1 || OBJECT(args[0]))
+        return nullptr;
+    SEXP x = args[0];
+    switch (TYPEOF(x)) {
+    case NILSXP:
+    case LGLSXP:
+    case INTSXP:
+    case REALSXP:
+    case CPLXSXP:
+    case STRSXP:
+    case VECSXP:
+    case EXPRSXP:
+    case RAWSXP: {
+        R_xlen_t len = XLENGTH(x);
+        if (len > INT_MAX)
+            return Rf_ScalarReal(len);
+        return Rf_ScalarInteger(len);
+    }
+    default:
+        return nullptr;
+    }
+}
+
+static SEXP isNa(const SEXP* args, size_t nargs) {
+    if (nargs != 1 || !isPlain(args[0]))
+        return nullptr;
+    SEXP x = args[0];
+    R_xlen_t n = XLENGTH(x);
+    SEXP res;
+    switch (TYPEOF(x)) {
+    case LGLSXP:
+    case INTSXP:
+        res = Rf_allocVector(LGLSXP, n);
+        for (R_xlen_t i = 0; i < n; ++i)
+            LOGICAL(res)[i] = INTEGER(x)[i] == NA_INTEGER;
+        return res;
+    case REALSXP:
+        res = Rf_allocVector(LGLSXP, n);
+        for (R_xlen_t i = 0; i < n; ++i)
+            LOGICAL(res)[i] = ISNAN(REAL(x)[i]);
+        return res;
+    case STRSXP:
+        res = Rf_allocVector(LGLSXP, n);
+        for (R_xlen_t i = 0; i < n; ++i)
+            LOGICAL(res)[i] = STRING_ELT(x, i) == NA_STRING;
+        return res;
+    default:
+        return nullptr;
+    }
+}
+
+// The elements of a number vector as doubles
+static double realAt(SEXP x, R_xlen_t i) {
+    if (TYPEOF(x) == REALSXP)
+        return REAL(x)[i];
+    int v = INTEGER(x)[i];
+    return v == NA_INTEGER ? NA_REAL : v;
+}
+
+static SEXP sqrt(const SEXP* args, size_t nargs) {
+    if (nargs != 1 || !isPlain(args[0]) || !isNum(args[0]))
+        return nullptr;
+    SEXP x = args[0];
+    R_xlen_t n = XLENGTH(x);
+    // Negative numbers give NaN with a warning
+    for (R_xlen_t i = 0; i < n; ++i)
+        if (realAt(x, i) < 0)
+            return nullptr;
+    SEXP res = Rf_allocVector(REALSXP, n);
+    for (R_xlen_t i = 0; i < n; ++i)
+        REAL(res)[i] = std::sqrt(realAt(x, i));
+    return res;
+}
+
+static SEXP abs(const SEXP* args, size_t nargs) {
+    if (nargs != 1 || !isPlain(args[0]) || !isNum(args[0]))
+        return nullptr;
+    SEXP x = args[0];
+    R_xlen_t n = XLENGTH(x);
+    SEXP res;
+    if (TYPEOF(x) == REALSXP) {
+        res = Rf_allocVector(REALSXP, n);
+        for (R_xlen_t i = 0; i < n; ++i)
+            REAL(res)[i] = std::fabs(REAL(x)[i]);
+    } else {
+        // Logicals become integers, NA_INTEGER is INT_MIN and stays NA
+        res = Rf_allocVector(INTSXP, n);
+        for (R_xlen_t i = 0; i < n; ++i) {
+            int v = INTEGER(x)[i];
+            INTEGER(res)[i] = v == NA_INTEGER ? NA_INTEGER : std::abs(v);
+        }
+    }
+    return res;
+}
+
+static SEXP c(const SEXP* args, size_t nargs) {
+    // The result has the largest type of the arguments. Coercing numbers to
+    // strings is left to R.
+    SEXPTYPE type = NILSXP;
+    R_xlen_t n = 0;
+    bool numbers = false;
+    for (size_t i = 0; i < nargs; ++i) {
+        SEXP x = args[i];
+        if (TYPEOF(x) == NILSXP)
+            continue;
+        if (!isPlain(x) || (!isNum(x) && TYPEOF(x) != STRSXP))
+            return nullptr;
+        numbers = numbers || TYPEOF(x) != STRSXP;
+        if (TYPEOF(x) > type)
+            type = TYPEOF(x);
+        n += XLENGTH(x);
+    }
+    if (type == NILSXP)
+        return R_NilValue;
+    if (type == STRSXP && numbers)
+        return nullptr;
+
+    SEXP res = Rf_allocVector(type, n);
+    R_xlen_t pos = 0;
+    for (size_t i = 0; i < nargs; ++i) {
+        SEXP x = args[i];
+        if (TYPEOF(x) == NILSXP)
+            continue;
+        R_xlen_t len = XLENGTH(x);
+        if (type == STRSXP) {
+            for (R_xlen_t j = 0; j < len; ++j)
+                SET_STRING_ELT(res, pos + j, STRING_ELT(x, j));
+        } else if (type == REALSXP) {
+            for (R_xlen_t j = 0; j < len; ++j)
+                REAL(res)[pos + j] = realAt(x, j);
+        } else {
+            // integers and logicals share their representation
+            memcpy(INTEGER(res) + pos, INTEGER(x), len * sizeof(int));
+        }
+        pos += len;
+    }
+    return res;
+}
+
+// .Internal(vector(mode, length))
+static SEXP vector(const SEXP* args, size_t nargs) {
+    if (nargs != 2)
+        return nullptr;
+    SEXP mode = args[0];
+    SEXP len = args[1];
+    if (TYPEOF(mode) != STRSXP || XLENGTH(mode) != 1 ||
+        STRING_ELT(mode, 0) == NA_STRING || !isNum(len) ||
+        TYPEOF(len) == LGLSXP || XLENGTH(len) != 1)
+        return nullptr;
+    double d = realAt(len, 0);
+    if (ISNAN(d) || d < 0 || d > INT_MAX)
+        return nullptr;
+
+    const char* m = CHAR(STRING_ELT(mode, 0));
+    SEXPTYPE type;
+    if (!strcmp(m, "logical"))
+        type = LGLSXP;
+    else if (!strcmp(m, "integer"))
+        type = INTSXP;
+    else if (!strcmp(m, "numeric") || !strcmp(m, "double"))
+        type = REALSXP;
+    else if (!strcmp(m, "character"))
+        type = STRSXP;
+    else if (!strcmp(m, "list"))
+        type = VECSXP;
+    else
+        return nullptr;
+
+    R_xlen_t n = static_cast<R_xlen_t>(d);
+    SEXP res = Rf_allocVector(type, n);
+    // Strings and lists are initialized by allocVector
+    if (type == LGLSXP || type == INTSXP)
+        memset(INTEGER(res), 0, n * sizeof(int));
+    else if (type == REALSXP)
+        memset(REAL(res), 0, n * sizeof(double));
+    return res;
+}
+
+// Checks the arguments of the Summary group builtins. The result is a real
+// if any argument is, otherwise an integer.
+static bool summaryArgs(const SEXP* args, size_t nargs, bool& real,
+                        R_xlen_t& n) {
+    real = false;
+    n = 0;
+    for (size_t i = 0; i < nargs; ++i) {
+        SEXP x = args[i];
+        if (TYPEOF(x) == NILSXP)
+            continue;
+        if (OBJECT(x) || !isNum(x))
+            return false;
+        real = real || TYPEOF(x) == REALSXP;
+        n += XLENGTH(x);
+    }
+    return true;
+}
+
+static SEXP sum(const SEXP* args, size_t nargs) {
+    bool real;
+    R_xlen_t n;
+    if (!summaryArgs(args, nargs, real, n))
+        return nullptr;
+
+    double rsum = 0;
+    long long isum = 0;
+    for (size_t i = 0; i < nargs; ++i) {
+        SEXP x = args[i];
+        if (TYPEOF(x) == NILSXP)
+            continue;
+        R_xlen_t len = XLENGTH(x);
+        if (TYPEOF(x) == REALSXP) {
+            long double s = 0;
+            for (R_xlen_t j = 0; j < len; ++j)
+                s += REAL(x)[j];
+            rsum += static_cast<double>(s);
+            continue;
+        }
+        long long s = 0;
+        for (R_xlen_t j = 0; j < len; ++j) {
+            int v = INTEGER(x)[j];
+            if (v == NA_INTEGER)
+                return real ? Rf_ScalarReal(NA_REAL)
+                            : Rf_ScalarInteger(NA_INTEGER);
+            s += v;
+        }
+        // Integer overflow gives NA with a warning
+        if (s > INT_MAX || s < -INT_MAX)
+            return nullptr;
+        if (real)
+            rsum += s;
+        else
+            isum += s;
+    }
+    if (real)
+        return Rf_ScalarReal(rsum);
+    if (isum > INT_MAX || isum < -INT_MAX)
+        return nullptr;
+    return Rf_ScalarInteger(isum);
+}
+
+template <bool Min>
+static SEXP minmax(const SEXP* args, size_t nargs) {
+    bool real;
+    R_xlen_t n;
+    // min and max of nothing warn
+    if (!summaryArgs(args, nargs, real, n) || n == 0)
+        return nullptr;
+
+    if (!real) {
+        int res = Min ? INT_MAX : -INT_MAX;
+        for (size_t i = 0; i < nargs; ++i) {
+            SEXP x = args[i];
+            if (TYPEOF(x) == NILSXP)
+                continue;
+            for (R_xlen_t j = 0; j < XLENGTH(x); ++j) {
+                int v = INTEGER(x)[j];
+                if (v == NA_INTEGER)
+                    return Rf_ScalarInteger(NA_INTEGER);
+                if (Min ? v < res : v > res)
+                    res = v;
+            }
+        }
+        return Rf_ScalarInteger(res);
+    }
+
+    // NA trumps NaN
+    double res = Min ? R_PosInf : R_NegInf;
+    bool nan = false;
+    for (size_t i = 0; i < nargs; ++i) {
+        SEXP x = args[i];
+        if (TYPEOF(x) == NILSXP)
+            continue;
+        for (R_xlen_t j = 0; j < XLENGTH(x); ++j) {
+            double v = realAt(x, j);
+            if (ISNA(v))
+                return Rf_ScalarReal(NA_REAL);
+            if (ISNAN(v))
+                nan = true;
+            else if (Min ? v < res : v > res)
+                res = v;
+        }
+    }
+    return Rf_ScalarReal(nan ? R_NaN : res);
+}
+
+struct NativeBuiltinEntry {
+    const char* name;
+    NativeBuiltin fun;
+    bool safe;
+};
+
+static const NativeBuiltinEntry entries[] = {
+    {"length", length, true},  {"is.na", isNa, false},
+    {"sqrt", sqrt, false},     {"abs", abs, false},
+    {"c", c, true},            {"vector", vector, true},
+    {"sum", sum, false},       {"min", minmax<true>, false},
+    {"max", minmax<false>, false},
+};
+
+// Indexed by the builtin number
+static const std::vector<const NativeBuiltinEntry*>& table() {
+    static std::vector<const NativeBuiltinEntry*> table;
+    if (table.empty()) {
+        for (auto& e : entries) {
+            size_t nr = findBuiltin(e.name);
+            if (table.size() <= nr)
+                table.resize(nr + 1, nullptr);
+            table[nr] = &e;
+        }
+    }
+    return table;
+}
+
+static const NativeBuiltinEntry* entry(SEXP builtin) {
+    assert(TYPEOF(builtin) == BUILTINSXP);
+    auto& t = table();
+    size_t nr = getBuiltinNr(builtin);
+    return nr < t.size() ? t[nr] : nullptr;
+}
+
+NativeBuiltin NativeBuiltins::get(SEXP builtin) {
+    auto e = entry(builtin);
+    return e ? e->fun : nullptr;
+}
+
+bool NativeBuiltins::safe(SEXP builtin) {
+    auto e = entry(builtin);
+    return e && e->safe;
+}
+
+} // namespace rir
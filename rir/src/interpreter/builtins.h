@@ -0,0 +1,38 @@
+#ifndef RIR_BUILTINS_H
+#define RIR_BUILTINS_H
+
+#include "R/r.h"
+
+#include <cstddef>
+
+namespace rir {
+
+// Takes the evaluated arguments and returns the result, or nullptr if the R
+// builtin has to be called instead
+typedef SEXP (*NativeBuiltin)(const SEXP* args, size_t nargs);
+
+/*
+ * RIR-native implementations of frequently called builtins (length, is.na,
+ * sqrt, abs, c, vector, sum, min and max). They are called with the
+ * arguments on the stack, without the argslist and the CCODE entry point of
+ * R/Funtab.h. This covers the static_call_s of the interpreter, the native
+ * code and PIR (CallBuiltin and CallSafeBuiltin).
+ *
+ * Only the common cases are implemented: named arguments, objects (which
+ * dispatch), attributes and anything that would warn go to the R builtin.
+ */
+class NativeBuiltins {
+  public:
+    static const size_t MaxArgs = 8;
+
+    // The native implementation of builtin, nullptr if there is none
+    static NativeBuiltin get(SEXP builtin);
+
+    // Calls to the builtin have no effects, not even errors, if none of the
+    // arguments has attributes, i.e. it can be a CallSafeBuiltin in PIR
+    static bool safe(SEXP builtin);
+};
+
+} // namespace rir
+
+#endif
@@ -1,74 +1,167 @@
 #include "deoptimizer.h"
+#include "R/Printing.h"
+#include "R/Protect.h"
+#include "runtime.h"
 
-static DeoptInfo* deoptTable;
-static uint32_t* deoptTableOffset;
-static size_t deoptTableSize = 0;
-static size_t deoptTableEntries = 0;
-static size_t deoptTableSizeUsed = 0;
-static size_t deoptTableEntriesUsed = 0;
-static size_t deoptTableGrow = 10;
-
-using namespace rir;
-
-static DeoptInfo* DeoptInfo_alloc() {
-    size_t needed = sizeof(DeoptInfo);
-    if (deoptTableSizeUsed + needed >= deoptTableSize) {
-        size_t newDeoptTableSize = deoptTableSize + deoptTableGrow * needed;
-        DeoptInfo* newDeoptTable = (DeoptInfo*)malloc(newDeoptTableSize);
-        assert(newDeoptTable);
-        if (deoptTableSize)
-            memcpy(newDeoptTable, deoptTable, deoptTableSize);
-        memset((char*)newDeoptTable + deoptTableSize, 0,
-               newDeoptTableSize - deoptTableSize);
-        if (deoptTableSize > 0)
-            free(deoptTable);
-        deoptTable = newDeoptTable;
-        deoptTableSize = newDeoptTableSize;
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+namespace rir {
+
+// The table is a VECSXP with one INTSXP per deoptimization point, followed by
+// a list of the referenced Functions and an INTSXP with the number of times
+// every deoptimization point was taken. Every frame is encoded as the
+// index of its Function, the offset of the Code in that Function, the offset
+// of the pc in that Code and the size of the stack.
+static const int FrameFields = 4;
+
+SEXP DeoptTable::create(const std::vector<std::vector<DeoptFrame>>& deopts) {
+    Protect p;
+    std::vector<Function*> functions;
+    SEXP table = p(Rf_allocVector(VECSXP, deopts.size() + 2));
+
+    for (size_t i = 0; i < deopts.size(); ++i) {
+        auto& frames = deopts[i];
+        assert(!frames.empty());
+        SEXP entry = Rf_allocVector(INTSXP, frames.size() * FrameFields);
+        SET_VECTOR_ELT(table, i, entry);
+        int* fields = INTEGER(entry);
+        for (auto& f : frames) {
+            assert(f.code->localsCount == 0 &&
+                   "Cannot deoptimize to code with locals");
+            assert(f.pc >= f.code->code() && f.pc < f.code->endCode());
+            Function* fun = f.code->function();
+            auto known = std::find(functions.begin(), functions.end(), fun);
+            if (known == functions.end())
+                known = functions.insert(functions.end(), fun);
+            *fields++ = known - functions.begin();
+            *fields++ = f.code->header;
+            *fields++ = f.pc - f.code->code();
+            *fields++ = f.stackSize;
+        }
     }
-    DeoptInfo* i = (DeoptInfo*)((char*)deoptTable + deoptTableSizeUsed);
-    i->size = 0;
-    deoptTableSizeUsed += needed;
-    return i;
+
+    SEXP funs = Rf_allocVector(VECSXP, functions.size());
+    SET_VECTOR_ELT(table, deopts.size(), funs);
+    for (size_t i = 0; i < functions.size(); ++i)
+        SET_VECTOR_ELT(funs, i, functions[i]->container());
+
+    SEXP counts = Rf_allocVector(INTSXP, deopts.size());
+    SET_VECTOR_ELT(table, deopts.size() + 1, counts);
+    std::fill_n(INTEGER(counts), deopts.size(), 0);
+    return table;
 }
 
-uint32_t Deoptimizer_register(Opcode* oldPc) {
-    DeoptInfo* i = DeoptInfo_alloc();
-    i->oldPc = oldPc;
-
-    if (deoptTableEntriesUsed == deoptTableEntries) {
-        size_t newDeoptTableEntries = deoptTableEntries + deoptTableGrow;
-        uint32_t* newDeoptTableOffset =
-            (uint32_t*)malloc(sizeof(uint32_t) * newDeoptTableEntries);
-        assert(newDeoptTableOffset);
-        if (deoptTableEntries > 0)
-            memcpy(newDeoptTableOffset, deoptTableOffset,
-                   sizeof(uint32_t) * deoptTableEntries);
-        memset(newDeoptTableOffset + deoptTableEntries, 0,
-               sizeof(uint32_t) * (newDeoptTableEntries - deoptTableEntries));
-        if (deoptTableEntries > 0)
-            free(deoptTableOffset);
-        deoptTableOffset = newDeoptTableOffset;
-        deoptTableEntries = newDeoptTableEntries;
+size_t DeoptTable::size(SEXP table) {
+    if (table == nullptr)
+        return 0;
+    return XLENGTH(table) - 2;
+}
+
+std::vector<DeoptFrame> DeoptTable::frames(SEXP table, uint32_t id) {
+    assert(id != NO_DEOPT_INFO && id < size(table));
+    SEXP funs = VECTOR_ELT(table, size(table));
+    SEXP entry = VECTOR_ELT(table, id);
+    int* fields = INTEGER(entry);
+
+    std::vector<DeoptFrame> res(XLENGTH(entry) / FrameFields);
+    for (auto& f : res) {
+        Function* fun = Function::unpack(VECTOR_ELT(funs, fields[0]));
+        f.code = fun->codeAt(fields[1]);
+        f.pc = f.code->code() + fields[2];
+        f.stackSize = fields[3];
+        fields += FrameFields;
     }
-    uint32_t off = (char*)i - (char*)deoptTable;
-    uint32_t idx = deoptTableEntriesUsed++;
-    deoptTableOffset[idx] = off;
-    return idx;
+    return res;
+}
+
+unsigned DeoptTable::hit(SEXP table, uint32_t id) {
+    assert(id < size(table));
+    int& count = INTEGER(VECTOR_ELT(table, size(table) + 1))[id];
+    if (count < INT_MAX)
+        count++;
+    return count;
 }
 
-static DeoptInfo* DeoptInfo_get(uint32_t idx) {
-    uint32_t off = deoptTableOffset[idx];
-    return (DeoptInfo*)((char*)deoptTable + off);
+unsigned DeoptTable::count(SEXP table, uint32_t id) {
+    assert(id < size(table));
+    return INTEGER(VECTOR_ELT(table, size(table) + 1))[id];
 }
 
-void Deoptimizer_print(uint32_t idx) {
-    assert(idx != NO_DEOPT_INFO);
-    DeoptInfo* i = DeoptInfo_get(idx);
-    Rprintf("[d#%d: %p]", idx, i->oldPc);
+void DeoptTable::print(SEXP table, std::ostream& out) {
+    for (uint32_t id = 0; id < size(table); ++id) {
+        out << "d#" << id << ":";
+        for (auto& f : frames(table, id))
+            out << " [" << f.code << " +" << f.pc - f.code->code() << ", "
+                << f.stackSize << " on stack]";
+        out << " taken " << count(table, id) << "x\n";
+    }
 }
 
-Opcode* Deoptimizer_pc(uint32_t idx) {
-    assert(idx != NO_DEOPT_INFO);
-    DeoptInfo* i = DeoptInfo_get(idx);
-    return i->oldPc;
+std::vector<Reoptimizer::Entry> Reoptimizer::log;
+static bool printLog = getenv("RIR_DEOPT_LOG");
+bool Reoptimizer::logEnabled = printLog;
+
+bool Reoptimizer::enableLog(bool enable) {
+    bool was = logEnabled;
+    logEnabled = enable || printLog;
+    return was;
 }
+
+void Reoptimizer::record(const char* event, Function* baseline, uint32_t id,
+                         unsigned count) {
+    if (!logEnabled)
+        return;
+    std::string function = dumpSexp(
+        src_pool_at(globalContext(), baseline->body()->src), 40);
+    if (log.size() < MaxLogEntries)
+        log.push_back(
+            {event, function, id, count, baseline->invocationCount});
+
+    if (!printLog)
+        return;
+    std::cerr << "[deopt log] " << event << " " << function;
+    if (id != NO_DEOPT_INFO)
+        std::cerr << " d#" << id;
+    std::cerr << " count " << count << " invoked " << baseline->invocationCount
+              << "\n";
+}
+
+bool Reoptimizer::shouldOptimize(Function* baseline) {
+    if (baseline->reoptimizations == 0) {
+        if (baseline->invocationCount != FirstOptimization)
+            return false;
+        record("optimize", baseline, NO_DEOPT_INFO, 0);
+        return true;
+    }
+    if (baseline->reoptimizations > MaxReoptimizations ||
+        baseline->invocationCount != baseline->reoptimizeAt)
+        return false;
+    record("reoptimize", baseline, NO_DEOPT_INFO, baseline->reoptimizations);
+    return true;
+}
+
+void Reoptimizer::deoptimized(Function* fun, uint32_t id) {
+    assert(fun->origin() && "optimized version without baseline");
+    Function* baseline = Function::unpack(fun->origin());
+    record("deopt", baseline, id, DeoptTable::hit(fun->deoptTable(), id));
+
+    // Other activations of the same version can deoptimize later on
+    if (fun->deopt)
+        return;
+    fun->deopt = true;
+
+    if (baseline->reoptimizations == MaxReoptimizations) {
+        // Disables shouldOptimize for good
+        baseline->reoptimizations = MaxReoptimizations + 1;
+        record("give up", baseline, NO_DEOPT_INFO, MaxReoptimizations);
+        return;
+    }
+    unsigned delay = BackoffDelay << baseline->reoptimizations;
+    baseline->reoptimizations++;
+    baseline->reoptimizeAt = baseline->invocationCount + delay;
+    record("invalidate", baseline, NO_DEOPT_INFO, baseline->reoptimizations);
+}
+
+} // namespace rir
@@ -3,26 +3,107 @@
 
 #include "interp_data.h"
 
-#ifdef __cplusplus
-extern "C" {
-#else
-#define bool int
-#define true 1
-#define false 0
-#endif
+#include <iostream>
+#include <string>
+#include <vector>
 
-typedef struct {
-    rir::Opcode* oldPc;
-    size_t size;
-    uint8_t payload[];
-} DeoptInfo;
+namespace rir {
 
-extern uint32_t Deoptimizer_register(rir::Opcode* oldPc);
-extern void Deoptimizer_print(uint32_t);
-extern rir::Opcode* Deoptimizer_pc(uint32_t);
+/*
+ * One frame of a deoptimization point: the interpreter continues at `pc` in
+ * the baseline `code`, with `stackSize` values on the stack. The code can be
+ * the body or a promise of any rir Function, e.g. of a callee which was
+ * inlined into the optimized code. Baseline code does not use locals, all
+ * variables of a frame live in its environment.
+ */
+struct DeoptFrame {
+    Code* code;
+    Opcode* pc;
+    unsigned stackSize;
+};
 
-#ifdef __cplusplus
-}
-#endif
+/*
+ * The deoptimization metadata of an optimized Function. A deoptimization
+ * point (the immediate of guard_env_ and deopt_) indexes the table and
+ * describes its frames, innermost first. The table is referenced from the
+ * Function and keeps the Functions of all frames alive, therefore it is freed
+ * together with the Function.
+ *
+ * When deopt_ executes, the stack holds the state of all frames, starting with
+ * the outermost: the stack of every frame followed by its environment. The
+ * innermost frames are run to completion and their result is pushed to the
+ * stack of their caller, the outermost frame then continues in the current
+ * interpreter loop.
+ *
+ * The table also counts how often every deoptimization point was taken.
+ */
+class DeoptTable {
+  public:
+    // deopts[i] are the frames of deoptimization point i
+    static SEXP create(const std::vector<std::vector<DeoptFrame>>& deopts);
+
+    static size_t size(SEXP table);
+    static std::vector<DeoptFrame> frames(SEXP table, uint32_t id);
+
+    // Counts one more deoptimization at `id`, returns the new count
+    static unsigned hit(SEXP table, uint32_t id);
+    static unsigned count(SEXP table, uint32_t id);
+
+    static void print(SEXP table, std::ostream& out);
+};
+
+/*
+ * Decides when the optimized version in slot 1 of a dispatch table is
+ * compiled. The first version is compiled on the second invocation of the
+ * baseline version. Once a version deoptimizes it is invalid: the dispatcher
+ * skips it and the next version is compiled after a delay, which doubles with
+ * every deoptimized version (the baseline version meanwhile collects the
+ * envLeaked and envChanged flags for the recompilation). At most
+ * MaxReoptimizations versions are recompiled, once the last of them
+ * deoptimizes the closure stays in the baseline.
+ *
+ * The transitions are recorded in a process wide log of at most MaxLogEntries
+ * entries, see rir.deoptLog in R. Recording is off by default, it is switched
+ * on by rir.enableDeoptLog or the environment variable RIR_DEOPT_LOG, which
+ * also prints them to stderr.
+ */
+class Reoptimizer {
+  public:
+    static const unsigned FirstOptimization = 2;
+    static const unsigned BackoffDelay = 16;
+    static const unsigned MaxReoptimizations = 4;
+    static const size_t MaxLogEntries = 1 << 16;
+
+    struct Entry {
+        std::string event;
+        // The source of the closure
+        std::string function;
+        // deoptimization point, NO_DEOPT_INFO for the other events
+        uint32_t id;
+        // times `id` was taken, or number of deoptimized versions
+        unsigned count;
+        unsigned invocations;
+    };
+
+    static const std::vector<Entry>& entries() { return log; }
+    static void clear() { log.clear(); }
+    // Returns whether it was enabled before
+    static bool enableLog(bool enable);
+
+    // Called on every invocation of the baseline version, true if the
+    // optimizer should run now
+    static bool shouldOptimize(Function* baseline);
+
+    // The optimized version `fun` left its code at deoptimization point `id`
+    static void deoptimized(Function* fun, uint32_t id);
+
+  private:
+    static std::vector<Entry> log;
+    static bool logEnabled;
+    static void record(const char* event, Function* baseline, uint32_t id,
+                       unsigned count);
+};
+
+} // namespace rir
 
 #endif
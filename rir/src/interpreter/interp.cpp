@@ -4,9 +4,16 @@
 #include "R/Funtab.h"
 #include "interp.h"
 #include "interp_context.h"
+#include "interpreter/builtins.h"
 #include "interpreter/deoptimizer.h"
+#include "interpreter/intrinsics.h"
+#include "interpreter/template_jit.h"
+#include "interpreter/vector_kernel.h"
 #include "runtime.h"
 
+#include <algorithm>
+#include <string>
+
 #define NOT_IMPLEMENTED assert(false)
 
 #undef eval
@@ -14,6 +21,11 @@
 extern "C" {
 extern SEXP Rf_NewEnvironment(SEXP, SEXP, SEXP);
 extern Rboolean R_Visible;
+extern SEXP R_LookupMethod(SEXP, SEXP, SEXP, SEXP);
+extern SEXP R_dot_Class;
+extern SEXP R_dot_Group;
+extern SEXP R_dot_GenericCallEnv;
+extern SEXP R_dot_GenericDefEnv;
 }
 
 // #define UNSOUND_OPTS
@@ -56,6 +68,13 @@ struct CallContext {
         : CallContext(c, callee, nargs, ast, stackArgs, nullptr, nullptr,
                       callerEnv, ctx) {}
 
+    // The same call, but with the arguments already matched to the formals of
+    // the callee and passed on the stack
+    CallContext(const CallContext& call, size_t nargs, R_bcstack_t* stackArgs)
+        : nargs(nargs), stackArgs(stackArgs), implicitArgs(nullptr),
+          names(nullptr), caller(call.caller), callerEnv(call.callerEnv),
+          ast(call.ast), callee(call.callee) {}
+
     const size_t nargs;
     const R_bcstack_t* stackArgs;
     const Immediate* implicitArgs;
@@ -109,8 +128,20 @@ RIR_INLINE SEXP getSrcForCall(Code* c, Opcode* pc, Context* ctx) {
 #define BEGIN_MACHINE NEXT();
 #define INSTRUCTION(name)                                                      \
     op_##name: /* debug(c, pc, #name, ostack_length(ctx) - bp, ctx); */
+#ifdef DIRECT_THREADED_CODE
+#define NEXT()                                                                 \
+    (__extension__({                                                           \
+        pc++;                                                                  \
+        goto** hp++;                                                           \
+    }))
+// Moves hp along with a pc that did not just advance to the next instruction
+#define SYNC_HANDLERS() hp = threaded->at(c->function(), pc)
+#define BRANCH_HANDLERS() hp = threaded->branchTarget(hp)
+#define SKIP_HANDLERS() hp++
+#else
 #define NEXT()                                                                 \
     (__extension__({ goto* opAddr[static_cast<uint8_t>(advanceOpcode())]; }))
+#endif
 #define LASTOP                                                                 \
     {}
 #else
@@ -126,6 +157,15 @@ RIR_INLINE SEXP getSrcForCall(Code* c, Opcode* pc, Context* ctx) {
         assert(false && "wrong or unimplemented opcode")
 #endif
 
+#ifndef DIRECT_THREADED_CODE
+#define SYNC_HANDLERS()                                                        \
+    {}
+#define BRANCH_HANDLERS()                                                      \
+    {}
+#define SKIP_HANDLERS()                                                        \
+    {}
+#endif
+
 // bytecode accesses
 
 #define advanceOpcode() (*pc++)
@@ -161,6 +201,24 @@ RIR_INLINE SEXP createPromise(Code* code, SEXP env) {
     return p;
 }
 
+// Arguments which are self-evaluating constants are passed as values, like
+// GNU R's bytecode does (PUSHCONSTARG). Their Code only pushes the ast, which
+// the compiler already marked as shared.
+RIR_INLINE SEXP createArgPromise(Code* code, SEXP env, Context* ctx) {
+    SEXP ast = src_pool_at(ctx, code->src);
+    switch (TYPEOF(ast)) {
+    case SYMSXP:
+    case LANGSXP:
+    case PROMSXP:
+    case DOTSXP:
+    case BCODESXP:
+    case EXTERNALSXP:
+        return createPromise(code, env);
+    default:
+        return ast;
+    }
+}
+
 RIR_INLINE SEXP promiseValue(SEXP promise, Context* ctx) {
     // if already evaluated, return the value
     if (PRVALUE(promise) && PRVALUE(promise) != R_UnboundValue) {
@@ -212,6 +270,28 @@ RIR_INLINE void __listAppend(SEXP* front, SEXP* last, SEXP value, SEXP name) {
     *last = app;
 }
 
+// Flattens the ellipsis of the caller into the argslist
+RIR_INLINE void __listAppendDots(SEXP* front, SEXP* last, SEXP callerEnv,
+                                 bool eagerCallee) {
+    SEXP ellipsis = Rf_findVar(R_DotsSymbol, callerEnv);
+    if (TYPEOF(ellipsis) == DOTSXP) {
+        while (ellipsis != R_NilValue) {
+            SEXP name = TAG(ellipsis);
+            if (eagerCallee) {
+                SEXP arg = CAR(ellipsis);
+                if (arg != R_MissingArg)
+                    arg = Rf_eval(CAR(ellipsis), callerEnv);
+                assert(TYPEOF(arg) != PROMSXP);
+                __listAppend(front, last, arg, name);
+            } else {
+                SEXP promise = Rf_mkPROMISE(CAR(ellipsis), callerEnv);
+                __listAppend(front, last, promise, name);
+            }
+            ellipsis = CDR(ellipsis);
+        }
+    }
+}
+
 SEXP createLegacyArgsListFromStackValues(const CallContext& call,
                                          bool eagerCallee, Context* ctx) {
     SEXP result = R_NilValue;
@@ -223,10 +303,14 @@ SEXP createLegacyArgsListFromStackValues(const CallContext& call,
 
         SEXP arg = call.stackArg(i);
 
-        if (!eagerCallee && (arg == R_MissingArg || arg == R_DotsSymbol)) {
-            // We have to wrap them in a promise, otherwise they are treated
-            // as expressions to be evaluated, when in fact they are meant to be
-            // asts as values
+        // R_DotsSymbol on the stack stands for the caller's ellipsis (see
+        // LdDots in PIR)
+        if (arg == R_DotsSymbol) {
+            __listAppendDots(&result, &pos, call.callerEnv, eagerCallee);
+        } else if (!eagerCallee && arg == R_MissingArg) {
+            // We have to wrap it in a promise, otherwise it is treated as an
+            // expression to be evaluated, when in fact it is meant to be an
+            // ast as value
             SEXP promise = Rf_mkPROMISE(arg, call.callerEnv);
             SET_PRVALUE(promise, arg);
             __listAppend(&result, &pos, promise, R_NilValue);
@@ -259,24 +343,7 @@ SEXP createLegacyArgsList(const CallContext& call, bool eagerCallee,
         // and
         // flatten the ellipsis
         if (argi == DOTS_ARG_IDX) {
-            SEXP ellipsis = Rf_findVar(R_DotsSymbol, call.callerEnv);
-            if (TYPEOF(ellipsis) == DOTSXP) {
-                while (ellipsis != R_NilValue) {
-                    name = TAG(ellipsis);
-                    if (eagerCallee) {
-                        SEXP arg = CAR(ellipsis);
-                        if (arg != R_MissingArg)
-                            arg = Rf_eval(CAR(ellipsis), call.callerEnv);
-                        assert(TYPEOF(arg) != PROMSXP);
-                        __listAppend(&result, &pos, arg, name);
-                    } else {
-                        SEXP promise =
-                            Rf_mkPROMISE(CAR(ellipsis), call.callerEnv);
-                        __listAppend(&result, &pos, promise, name);
-                    }
-                    ellipsis = CDR(ellipsis);
-                }
-            }
+            __listAppendDots(&result, &pos, call.callerEnv, eagerCallee);
         } else if (argi == MISSING_ARG_IDX) {
             if (eagerCallee)
                 Rf_errorcall(call.ast, "argument %d is empty", i + 1);
@@ -290,7 +357,7 @@ SEXP createLegacyArgsList(const CallContext& call, bool eagerCallee,
                 __listAppend(&result, &pos, arg, name);
             } else {
                 Code* arg = call.implicitArg(i);
-                SEXP promise = createPromise(arg, call.callerEnv);
+                SEXP promise = createArgPromise(arg, call.callerEnv, ctx);
                 __listAppend(&result, &pos, promise, name);
             }
         }
@@ -438,6 +505,14 @@ SEXP legacyCall(const CallContext& call, Context* ctx) {
     return res;
 }
 
+// TODO: lazy frames. Baseline frames always get a heap environment, even if
+// fun->envLeaked says it never leaked. Keeping the bindings in Locals instead
+// and materializing the ENVSXP on the first leak needs
+//  - the interpreter to access bindings of such frames through Locals,
+//  - envLeaked and envChanged to decide which frames start out lazy,
+//  - hooks in custom-r, where sys.frame, parent.frame, environment() and the
+//    contexts hand out the frame, to materialize it there.
+// Only optimized code keeps bindings in locals so far, see DelayEnv.
 SEXP closureArgumentAdaptor(const CallContext& call, SEXP arglist,
                             SEXP suppliedvars) {
     SEXP op = call.callee;
@@ -519,23 +594,90 @@ unsigned dispatch(const CallContext& call, DispatchTable* vt) {
     if (vt->capacity() == 1 || !vt->available(1))
         return 0;
 
-    // Try to dispatch to slot 1
-    if (call.hasNames() ||
-        /* TODO: length is waay slow. Will be fixed by signatures */
-        call.nargs != (size_t)Rf_length(FORMALS(call.callee))) {
+    // Once deoptimized, the baseline version is used until the Reoptimizer
+    // replaces it
+    if (vt->at(1)->deopt)
         return 0;
+
+    // Slot 1 can take any call, see rirCallOptimized
+    return 1;
+};
+
+// The optimized version loads its arguments positionally with ldarg_. This only
+// works if the call supplies exactly one unnamed argument per formal and the
+// callee does not take `...`.
+static bool needsArgMatching(const CallContext& call) {
+    if (call.hasNames())
+        return true;
+
+    /* TODO: walking the formals is waay slow. Will be fixed by signatures */
+    size_t nformals = 0;
+    for (SEXP f = FORMALS(call.callee); f != R_NilValue; f = CDR(f)) {
+        if (TAG(f) == R_DotsSymbol)
+            return true;
+        nformals++;
     }
+    if (call.nargs != nformals)
+        return true;
 
-    // TODO: add support to `...` passing, ie. we pass our ellipsis arg
-    // to the callee
-    if (!call.hasStackArgs()) {
-        for (size_t i = 0; i < call.nargs; ++i)
-            if (call.implicitArgOffset(i) == DOTS_ARG_IDX)
-                return 0;
+    for (size_t i = 0; i < call.nargs; ++i) {
+        if (call.hasStackArgs()) {
+            if (call.stackArg(i) == R_DotsSymbol)
+                return true;
+        } else {
+            auto argi = call.implicitArgOffset(i);
+            if (argi == DOTS_ARG_IDX || argi == MISSING_ARG_IDX)
+                return true;
+        }
     }
+    return false;
+}
 
-    return 1;
-};
+// Call the optimized version of a function. If the arguments do not line up
+// with the formals, we match them like closureArgumentAdaptor does and pass
+// the result on the stack. Missing args are passed as R_MissingArg and
+// bound to their default argument by the callee.
+SEXP rirCallOptimized(const CallContext& call, Function* fun, SEXP arglist,
+                      Context* ctx) {
+    if (!needsArgMatching(call)) {
+        if (call.hasStackArgs() || (size_t)Rf_length(arglist) != call.nargs)
+            return rirCallTrampoline(call, fun, arglist, ctx);
+
+        // The promises of the arglist are passed on the stack, such that
+        // ldarg_ does not create a second promise for the same argument
+        ostack_ensureSize(ctx, call.nargs);
+        R_bcstack_t* promises = R_BCNodeStackTop;
+        for (SEXP a = arglist; a != R_NilValue; a = CDR(a))
+            ostack_push(ctx, CAR(a));
+
+        CallContext promisesCall(call, call.nargs, promises);
+        SEXP result = rirCallTrampoline(promisesCall, fun, arglist, ctx);
+        ostack_popn(ctx, call.nargs);
+        return result;
+    }
+
+    SEXP actuals = Rf_matchArgs(FORMALS(call.callee), arglist, call.ast);
+    PROTECT(actuals);
+
+    size_t nformals = Rf_length(actuals);
+    ostack_ensureSize(ctx, nformals);
+    R_bcstack_t* matched = R_BCNodeStackTop;
+    for (SEXP a = actuals; a != R_NilValue; a = CDR(a)) {
+        SEXP arg = CAR(a);
+        // Missing stack args come wrapped, see
+        // createLegacyArgsListFromStackValues
+        if (TYPEOF(arg) == PROMSXP && PRVALUE(arg) == R_MissingArg)
+            arg = R_MissingArg;
+        ostack_push(ctx, arg);
+    }
+
+    CallContext matchedCall(call, nformals, matched);
+    SEXP result = rirCallTrampoline(matchedCall, fun, arglist, ctx);
+    ostack_popn(ctx, nformals);
+
+    UNPROTECT(1);
+    return result;
+}
 
 // Call a RIR function, when we already have created the list of actuals (this
 // is for example the case, if we tried to dispatch).
@@ -561,7 +703,7 @@ SEXP rirCall(const CallContext& call, SEXP actuals, Context* ctx) {
         result = rirCallTrampoline(call, fun, env, actuals, ctx);
         UNPROTECT(1);
     } else {
-        result = rirCallTrampoline(call, fun, actuals, ctx);
+        result = rirCallOptimized(call, fun, actuals, ctx);
     }
 
     assert(result);
@@ -573,7 +715,6 @@ SEXP rirCall(const CallContext& call, SEXP actuals, Context* ctx) {
             fun->envChanged = true;
     }
 
-    assert(!fun->deopt);
     return result;
 }
 
@@ -589,7 +730,7 @@ SEXP rirCall(const CallContext& call, Context* ctx) {
     Function* fun = table->at(slot);
 
     fun->registerInvocation();
-    if (slot == 0 && fun->invocationCount == 2) {
+    if (slot == 0 && Reoptimizer::shouldOptimize(fun)) {
         ctx->optimizer(call.callee);
         slot = dispatch(call, table);
         needsEnv = slot == 0;
@@ -613,7 +754,7 @@ SEXP rirCall(const CallContext& call, Context* ctx) {
         // only when needed. Afaik, the argslist is only accessed ever in
         // do_usemethod, therefore it should be possible to have our own
         // do_usemethod, that lazily creates the argslist when needed.
-        result = rirCallTrampoline(call, fun, arglist, ctx);
+        result = rirCallOptimized(call, fun, arglist, ctx);
         UNPROTECT(1);
     }
 
@@ -626,10 +767,34 @@ SEXP rirCall(const CallContext& call, Context* ctx) {
             fun->envChanged = true;
     }
 
-    assert(!fun->deopt);
     return result;
 }
 
+// Builtins with a native implementation are called directly with the values
+// on the stack, without creating an argslist (see builtins.h)
+SEXP builtinCall(const CallContext& call, Context* ctx) {
+    NativeBuiltin native = NativeBuiltins::get(call.callee);
+    if (native && call.hasStackArgs() && !call.hasNames() &&
+        call.nargs <= NativeBuiltins::MaxArgs) {
+        SEXP args[NativeBuiltins::MaxArgs];
+        bool values = true;
+        for (size_t i = 0; i < call.nargs; ++i) {
+            args[i] = call.stackArg(i);
+            if (TYPEOF(args[i]) == PROMSXP || args[i] == R_DotsSymbol ||
+                args[i] == R_MissingArg)
+                values = false;
+        }
+        if (values) {
+            SEXP res = native(args, call.nargs);
+            if (res) {
+                R_Visible = TRUE;
+                return res;
+            }
+        }
+    }
+    return legacyCall(call, ctx);
+}
+
 SEXP doCall(const CallContext& call, Context* ctx) {
     assert(call.callee);
 
@@ -638,7 +803,7 @@ SEXP doCall(const CallContext& call, Context* ctx) {
         case SPECIALSXP:
             return legacySpecialCall(call, ctx);
         case BUILTINSXP:
-            return legacyCall(call, ctx);
+            return builtinCall(call, ctx);
         case CLOSXP: {
             if (TYPEOF(BODY(call.callee)) != EXTERNALSXP)
                 return legacyCall(call, ctx);
@@ -653,6 +818,11 @@ SEXP doCall(const CallContext& call, Context* ctx) {
     return apply(call);
 }
 
+enum class S3Dispatch { Unknown, NoMethod, Dispatched };
+static S3Dispatch cachedUsemethod(SEXP ast, SEXP obj, SEXP actuals,
+                                  SEXP selector, SEXP callerEnv, SEXP rho,
+                                  SEXP* result);
+
 SEXP dispatchApply(SEXP ast, SEXP obj, SEXP actuals, SEXP selector,
                    SEXP callerEnv, Context* ctx) {
     SEXP op = SYMVALUE(selector);
@@ -673,8 +843,19 @@ SEXP dispatchApply(SEXP ast, SEXP obj, SEXP actuals, SEXP selector,
     RCNTXT cntxt;
     initClosureContext(ast, &cntxt, rho1, callerEnv, actuals, op);
     SEXP result;
-    bool success = Rf_usemethod(generic, obj, ast, actuals, rho1, callerEnv,
-                                R_BaseEnv, &result);
+    bool success;
+    switch (cachedUsemethod(ast, obj, actuals, selector, callerEnv, rho1,
+                            &result)) {
+    case S3Dispatch::Dispatched:
+        success = true;
+        break;
+    case S3Dispatch::NoMethod:
+        success = false;
+        break;
+    default:
+        success = Rf_usemethod(generic, obj, ast, actuals, rho1, callerEnv,
+                               R_BaseEnv, &result);
+    }
     UNPROTECT(1);
     endClosureContext(&cntxt, success ? result : R_NilValue);
     if (success)
@@ -974,6 +1155,62 @@ static R_INLINE int R_integer_uminus(int x, Rboolean* pnaflag) {
         BINOP_FALLBACK(#op);                                                   \
     } while (false)
 
+// The operands are unboxed scalars of the same type, see unbox_
+#define DO_UNBOXED_BINOP(op, op2)                                              \
+    do {                                                                       \
+        R_bcstack_t* lhs = ostack_cell_at(ctx, 1);                             \
+        R_bcstack_t* rhs = ostack_cell_at(ctx, 0);                             \
+        if (ostack_cell_type(lhs) == INTSXP) {                                 \
+            int l = ostack_cell_int(lhs);                                      \
+            int r = ostack_cell_int(rhs);                                      \
+            Rboolean naflag = FALSE;                                           \
+            int int_res = 0;                                                   \
+            switch (op2) {                                                     \
+            case PLUSOP:                                                       \
+                int_res = R_integer_plus(l, r, &naflag);                       \
+                break;                                                         \
+            case MINUSOP:                                                      \
+                int_res = R_integer_minus(l, r, &naflag);                      \
+                break;                                                         \
+            case TIMESOP:                                                      \
+                int_res = R_integer_times(l, r, &naflag);                      \
+                break;                                                         \
+            }                                                                  \
+            ostack_popn(ctx, 2);                                               \
+            ostack_push_int(ctx, int_res);                                     \
+            CHECK_INTEGER_OVERFLOW(R_NilValue, naflag);                        \
+        } else {                                                               \
+            SLOWASSERT(ostack_cell_type(lhs) == REALSXP);                      \
+            double real_res = ostack_cell_real(lhs) op ostack_cell_real(rhs);  \
+            ostack_popn(ctx, 2);                                               \
+            ostack_push_real(ctx, real_res);                                   \
+        }                                                                      \
+    } while (false)
+
+#define DO_UNBOXED_RELOP(op)                                                   \
+    do {                                                                       \
+        R_bcstack_t* lhs = ostack_cell_at(ctx, 1);                             \
+        R_bcstack_t* rhs = ostack_cell_at(ctx, 0);                             \
+        if (ostack_cell_type(lhs) == INTSXP) {                                 \
+            int l = ostack_cell_int(lhs);                                      \
+            int r = ostack_cell_int(rhs);                                      \
+            if (l == NA_INTEGER || r == NA_INTEGER)                            \
+                res = R_LogicalNAValue;                                        \
+            else                                                               \
+                res = l op r ? R_TrueValue : R_FalseValue;                     \
+        } else {                                                               \
+            SLOWASSERT(ostack_cell_type(lhs) == REALSXP);                      \
+            double l = ostack_cell_real(lhs);                                  \
+            double r = ostack_cell_real(rhs);                                  \
+            if (ISNAN(l) || ISNAN(r))                                          \
+                res = R_LogicalNAValue;                                        \
+            else                                                               \
+                res = l op r ? R_TrueValue : R_FalseValue;                     \
+        }                                                                      \
+        ostack_popn(ctx, 2);                                                   \
+        ostack_push(ctx, res);                                                 \
+    } while (false)
+
 static SEXP seq_int(int n1, int n2) {
     int n = n1 <= n2 ? n2 - n1 + 1 : n1 - n2 + 1;
     SEXP ans = Rf_allocVector(INTSXP, n);
@@ -988,6 +1225,52 @@ static SEXP seq_int(int n1, int n2) {
     return ans;
 }
 
+// True if every element of idx is a non-NA index in 1..length, truncating
+// reals like extract2_1_ does
+static bool indicesInBounds(SEXP idx, R_xlen_t length) {
+    if (ATTRIB(idx) != R_NilValue)
+        return false;
+    R_xlen_t n = XLENGTH(idx);
+    switch (TYPEOF(idx)) {
+    case INTSXP: {
+        int* data = INTEGER(idx);
+        for (R_xlen_t i = 0; i < n; ++i)
+            if (data[i] == NA_INTEGER || data[i] < 1 || data[i] > length)
+                return false;
+        return true;
+    }
+    case REALSXP: {
+        double* data = REAL(idx);
+        // NaN fails both comparisons
+        for (R_xlen_t i = 0; i < n; ++i)
+            if (!(data[i] >= 1 && data[i] < length + 1))
+                return false;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+static bool inBounds(SEXP vec, SEXP from, SEXP to) {
+    if (TYPEOF(vec) == PROMSXP)
+        vec = PRVALUE(vec);
+    switch (TYPEOF(vec)) {
+    case INTSXP:
+    case REALSXP:
+    case LGLSXP:
+    case VECSXP:
+        break;
+    default:
+        return false;
+    }
+    if (ATTRIB(vec) != R_NilValue)
+        return false;
+    R_xlen_t length = XLENGTH(vec);
+    return indicesInBounds(from, length) &&
+           (to == from || indicesInBounds(to, length));
+}
+
 RIR_INLINE SEXP findRootPromise(SEXP p) {
     if (TYPEOF(p) == PROMSXP) {
         while (TYPEOF(PREXPR(p)) == PROMSXP) {
@@ -1026,6 +1309,11 @@ void debug(Code* c, Opcode* pc, const char* name, unsigned depth,
     }
 }
 
+#define ACTIVE_BINDING_MASK (1 << 15)
+#define BINDING_LOCK_MASK (1 << 14)
+#define IS_ACTIVE_BINDING(b) ((b)->sxpinfo.gp & ACTIVE_BINDING_MASK)
+#define BINDING_IS_LOCKED(b) ((b)->sxpinfo.gp & BINDING_LOCK_MASK)
+
 #define BINDING_CACHE_SIZE 5
 typedef struct {
     SEXP loc;
@@ -1053,6 +1341,392 @@ RIR_INLINE SEXP cachedGetBindingCell(SEXP env, Immediate idx, Context* ctx,
     return NULL;
 }
 
+/*
+ * Cache for variables looked up from the global env or a namespace, i.e. a
+ * chain of frames like namespace, imports, base namespace, global env, search
+ * path, base env. Entries are shared by all ldvar_ sites and map the start of
+ * the lookup and the symbol to the frame and the binding cell where it was
+ * found.
+ *
+ * An entry stays valid as long as no frame from the start to the frame of the
+ * binding gains or loses a binding. Our R marks such frames as changed. We
+ * consume these marks: frames on a cached chain get their mark cleared and,
+ * since other entries might depend on them too, globalCacheVersion is bumped,
+ * which invalidates all entries.
+ *
+ * Bindings in the base env (and base namespace) are stored in the symbol,
+ * therefore for those the symbol is cached instead of the binding cell.
+ */
+#define GLOBAL_CACHE_SIZE 1024
+typedef struct {
+    SEXP start;
+    SEXP sym;
+    SEXP frame;
+    SEXP cell;
+    unsigned version;
+} GlobalCacheEntry;
+
+static GlobalCacheEntry globalCache[GLOBAL_CACHE_SIZE];
+static unsigned globalCacheVersion = 1;
+// Keeps the cached envs alive, such that their address cannot be reused
+static SEXP globalCacheRoots = nullptr;
+
+RIR_INLINE bool isBaseFrame(SEXP frame) {
+    return frame == R_BaseEnv || frame == R_BaseNamespace;
+}
+
+RIR_INLINE SEXP globalBindingValue(SEXP frame, SEXP cell) {
+    return isBaseFrame(frame) ? SYMVALUE(cell) : CAR(cell);
+}
+
+static void invalidateGlobalCache() { globalCacheVersion++; }
+
+static bool clearFramesChanged(SEXP start, SEXP end) {
+    bool changed = false;
+    for (SEXP f = start;; f = ENCLOS(f)) {
+        if (FRAME_CHANGED(f)) {
+            CLEAR_FRAME_CHANGED(f);
+            changed = true;
+        }
+        if (f == end)
+            break;
+    }
+    return changed;
+}
+
+static SEXP globalGetVar(SEXP sym, SEXP start) {
+    uintptr_t h = ((uintptr_t)start >> 4) ^ ((uintptr_t)sym >> 4);
+    GlobalCacheEntry& e = globalCache[h % GLOBAL_CACHE_SIZE];
+
+    if (e.start == start && e.sym == sym &&
+        e.version == globalCacheVersion) {
+        bool valid = true;
+        for (SEXP f = start;; f = ENCLOS(f)) {
+            // The frame is not on the chain anymore (parent.env<-)
+            if (f == R_EmptyEnv || FRAME_CHANGED(f)) {
+                valid = false;
+                break;
+            }
+            if (f == e.frame)
+                break;
+        }
+        if (valid) {
+            SEXP res = globalBindingValue(e.frame, e.cell);
+            if (res != R_UnboundValue)
+                return res;
+        }
+    }
+
+    bool topLevel =
+        start == R_GlobalEnv ||
+        (HASHTAB(start) != R_NilValue && R_IsNamespaceEnv(start));
+    if (!topLevel)
+        return Rf_findVar(sym, start);
+
+    for (SEXP f = start; f != R_EmptyEnv; f = ENCLOS(f)) {
+        SEXP cell;
+        if (isBaseFrame(f)) {
+            if (SYMVALUE(sym) == R_UnboundValue)
+                continue;
+            cell = sym;
+        } else {
+            R_varloc_t loc = R_findVarLocInFrame(f, sym);
+            if (R_VARLOC_IS_NULL(loc))
+                continue;
+            cell = loc.cell;
+        }
+        if (IS_ACTIVE_BINDING(cell))
+            return Rf_findVar(sym, start);
+
+        if (clearFramesChanged(start, f))
+            invalidateGlobalCache();
+
+        if (!globalCacheRoots) {
+            globalCacheRoots = Rf_allocVector(VECSXP, 2 * GLOBAL_CACHE_SIZE);
+            R_PreserveObject(globalCacheRoots);
+        }
+        SET_VECTOR_ELT(globalCacheRoots, 2 * (h % GLOBAL_CACHE_SIZE), start);
+        SET_VECTOR_ELT(globalCacheRoots, 2 * (h % GLOBAL_CACHE_SIZE) + 1,
+                       f);
+        e.start = start;
+        e.sym = sym;
+        e.frame = f;
+        e.cell = cell;
+        e.version = globalCacheVersion;
+
+        SEXP res = globalBindingValue(f, cell);
+        if (res == R_UnboundValue)
+            return Rf_findVar(sym, start);
+        return res;
+    }
+    return R_UnboundValue;
+}
+
+/*
+ * Cache for the S3 dispatch in dispatchApply. Entries are keyed by the call
+ * (i.e. the call site) and the generic. They remember, for the class vector
+ * of the last object, the method symbols tried and the binding cell the
+ * method was found in (or that there is none). A hit neither builds the
+ * method names nor looks them up.
+ *
+ * An entry is valid under the conditions of the global cache above: no frame
+ * from the topenv of the caller to the base env, nor the S3 methods table,
+ * gained or lost a binding. Additionally the frames between the caller and
+ * its topenv must not bind any of the tried symbols. The method is read from
+ * its cell, thus redefining it does not invalidate the entry.
+ */
+#define S3_CACHE_SIZE 256
+#define S3_CACHE_CLASSES 8
+
+typedef struct {
+    SEXP ast;
+    SEXP selector;
+    SEXP klass;
+    SEXP top;
+    // The method was found under the last symbol, unless frame is null
+    SEXP syms[S3_CACHE_CLASSES + 1];
+    unsigned nsyms;
+    SEXP frame;
+    SEXP cell;
+    unsigned version;
+} S3CacheEntry;
+
+static S3CacheEntry s3Cache[S3_CACHE_SIZE];
+// Keeps the class vectors and envs of the entries alive
+static SEXP s3CacheRoots = nullptr;
+
+// The binding cell of sym in frame f (the symbol itself for base frames),
+// nullptr if there is none
+static SEXP frameBinding(SEXP f, SEXP sym) {
+    if (isBaseFrame(f))
+        return SYMVALUE(sym) == R_UnboundValue ? nullptr : sym;
+    R_varloc_t loc = R_findVarLocInFrame(f, sym);
+    return R_VARLOC_IS_NULL(loc) ? nullptr : loc.cell;
+}
+
+// The function bound in cell, nullptr if it is none or not forced yet
+static SEXP bindingFun(SEXP frame, SEXP cell) {
+    if (!isBaseFrame(frame) && IS_ACTIVE_BINDING(cell))
+        return nullptr;
+    SEXP v = globalBindingValue(frame, cell);
+    if (TYPEOF(v) == PROMSXP)
+        v = PRVALUE(v);
+    return Rf_isFunction(v) ? v : nullptr;
+}
+
+static SEXP s3MethodsTable() {
+    static SEXP sym = Rf_install(".__S3MethodsTable__.");
+    SEXP table = SYMVALUE(sym);
+    if (TYPEOF(table) == PROMSXP)
+        table = PRVALUE(table);
+    return TYPEOF(table) == ENVSXP ? table : nullptr;
+}
+
+static bool sameClass(SEXP a, SEXP b) {
+    if (a == b)
+        return true;
+    if (XLENGTH(a) != XLENGTH(b))
+        return false;
+    // CHARSXPs are cached
+    for (R_xlen_t i = 0; i < XLENGTH(a); ++i)
+        if (STRING_ELT(a, i) != STRING_ELT(b, i))
+            return false;
+    return true;
+}
+
+static bool s3CacheValid(S3CacheEntry& e, SEXP callerEnv, SEXP top) {
+    if (e.version != globalCacheVersion || e.top != top)
+        return false;
+    for (SEXP f = callerEnv; f != top && f != R_EmptyEnv; f = ENCLOS(f))
+        for (unsigned i = 0; i < e.nsyms; ++i)
+            if (frameBinding(f, e.syms[i]))
+                return false;
+    for (SEXP f = top; f != R_EmptyEnv; f = ENCLOS(f))
+        if (FRAME_CHANGED(f))
+            return false;
+    SEXP table = s3MethodsTable();
+    return !table || !FRAME_CHANGED(table);
+}
+
+// Finds the cell of the method R_LookupMethod found, in the same order: the
+// frames up to the topenv, the S3 methods table and the rest of the frames
+static bool locateMethod(SEXP sym, SEXP method, SEXP callerEnv, SEXP top,
+                         SEXP* frame, SEXP* cell) {
+    auto in = [&](SEXP f) {
+        SEXP c = frameBinding(f, sym);
+        if (c && bindingFun(f, c) == method) {
+            *frame = f;
+            *cell = c;
+            return true;
+        }
+        return false;
+    };
+    for (SEXP f = callerEnv; f != ENCLOS(top) && f != R_EmptyEnv;
+         f = ENCLOS(f))
+        if (in(f))
+            // Local frames are not cached
+            return f == top;
+    SEXP table = s3MethodsTable();
+    if (table && in(table))
+        return true;
+    for (SEXP f = ENCLOS(top); f != R_EmptyEnv; f = ENCLOS(f))
+        if (in(f))
+            return true;
+    return false;
+}
+
+// Whether sym is bound ahead of cell (nullptr if it was not found) from the
+// topenv on, in the order of locateMethod. Such a binding is no function, and
+// rebinding it to one does not mark its frame changed.
+static bool boundAhead(SEXP sym, SEXP top, SEXP cell) {
+    SEXP c = frameBinding(top, sym);
+    if (c)
+        return c != cell;
+    SEXP table = s3MethodsTable();
+    if (table && (c = frameBinding(table, sym)))
+        return c != cell;
+    for (SEXP f = ENCLOS(top); f != R_EmptyEnv; f = ENCLOS(f))
+        if ((c = frameBinding(f, sym)))
+            return c != cell;
+    return false;
+}
+
+// Like dispatchMethod in R's objects.c, for a primitive generic. The method
+// was found for the i-th class, or is the default method if i is the number
+// of classes.
+static SEXP dispatchS3Method(SEXP ast, SEXP selector, SEXP method, SEXP sym,
+                             SEXP klass, unsigned i, SEXP actuals, SEXP rho,
+                             SEXP callerEnv) {
+    SEXP dotClass = R_NilValue;
+    if (i == 0) {
+        dotClass = klass;
+    } else if ((R_xlen_t)i < XLENGTH(klass)) {
+        dotClass = Rf_allocVector(STRSXP, XLENGTH(klass) - i);
+        PROTECT(dotClass);
+        for (R_xlen_t j = 0; j < XLENGTH(dotClass); ++j)
+            SET_STRING_ELT(dotClass, j, STRING_ELT(klass, i + j));
+        Rf_setAttrib(dotClass, R_PreviousSymbol, klass);
+        UNPROTECT(1);
+    }
+    PROTECT(dotClass);
+
+    PROTECT_INDEX idx;
+    SEXP newvars = R_NilValue;
+    PROTECT_WITH_INDEX(newvars, &idx);
+    auto define = [&](SEXP tag, SEXP val) {
+        PROTECT(val);
+        newvars = Rf_cons(val, newvars);
+        UNPROTECT(1);
+        REPROTECT(newvars, idx);
+        SET_TAG(newvars, tag);
+    };
+    define(R_dot_GenericDefEnv, R_BaseEnv);
+    define(R_dot_GenericCallEnv, callerEnv);
+    define(R_dot_Group, R_BlankScalarString);
+    define(R_dot_Method, Rf_mkString(CHAR(PRINTNAME(sym))));
+    define(R_dot_Class, dotClass);
+    define(R_dot_Generic, Rf_mkString(CHAR(PRINTNAME(selector))));
+
+    SEXP newcall = PROTECT(Rf_shallow_duplicate(ast));
+    SETCAR(newcall, sym);
+    R_GlobalContext->callflag = CTXT_GENERIC;
+    SEXP result = Rf_applyClosure(newcall, method, actuals, rho, newvars);
+    R_GlobalContext->callflag = CTXT_RETURN;
+    UNPROTECT(3);
+    return result;
+}
+
+// The S3 dispatch of dispatchApply through the cache. Objects with implicit
+// classes, too many classes or methods which are not closures are left to
+// usemethod.
+static S3Dispatch cachedUsemethod(SEXP ast, SEXP obj, SEXP actuals,
+                                  SEXP selector, SEXP callerEnv, SEXP rho,
+                                  SEXP* result) {
+    SEXP klass = Rf_getAttrib(obj, R_ClassSymbol);
+    if (IS_S4_OBJECT(obj) || TYPEOF(klass) != STRSXP ||
+        XLENGTH(klass) > S3_CACHE_CLASSES)
+        return S3Dispatch::Unknown;
+    unsigned nclass = XLENGTH(klass);
+    SEXP top = Rf_topenv(R_NilValue, callerEnv);
+
+    uintptr_t h = ((uintptr_t)ast >> 4) ^ ((uintptr_t)selector >> 4);
+    S3CacheEntry& e = s3Cache[h % S3_CACHE_SIZE];
+    if (e.ast == ast && e.selector == selector && sameClass(e.klass, klass) &&
+        s3CacheValid(e, callerEnv, top)) {
+        if (!e.frame)
+            return S3Dispatch::NoMethod;
+        SEXP method = bindingFun(e.frame, e.cell);
+        if (method && TYPEOF(method) == CLOSXP) {
+            *result = dispatchS3Method(ast, selector, method,
+                                       e.syms[e.nsyms - 1], klass,
+                                       e.nsyms - 1, actuals, rho, callerEnv);
+            return S3Dispatch::Dispatched;
+        }
+    }
+
+    // Look up the methods like usemethod, then fill the entry
+    const char* generic = CHAR(PRINTNAME(selector));
+    SEXP syms[S3_CACHE_CLASSES + 1];
+    SEXP method = nullptr;
+    unsigned i = 0;
+    for (; i <= nclass; ++i) {
+        std::string name = generic;
+        name += ".";
+        name += i < nclass ? Rf_translateChar(STRING_ELT(klass, i))
+                           : "default";
+        syms[i] = Rf_install(name.c_str());
+        SEXP m = R_LookupMethod(syms[i], rho, callerEnv, R_BaseEnv);
+        if (Rf_isFunction(m)) {
+            method = m;
+            break;
+        }
+    }
+    if (method && TYPEOF(method) != CLOSXP)
+        return S3Dispatch::Unknown;
+
+    SEXP frame = nullptr, cell = nullptr;
+    if (method && !locateMethod(syms[i], method, callerEnv, top, &frame, &cell))
+        return S3Dispatch::Unknown;
+    unsigned nsyms = method ? i + 1 : nclass + 1;
+    for (unsigned j = 0; j < nsyms; ++j)
+        if (boundAhead(syms[j], top, j == i ? cell : nullptr))
+            return S3Dispatch::Unknown;
+
+    bool changed = clearFramesChanged(top, R_BaseEnv);
+    SEXP table = s3MethodsTable();
+    if (table && FRAME_CHANGED(table)) {
+        CLEAR_FRAME_CHANGED(table);
+        changed = true;
+    }
+    if (changed)
+        invalidateGlobalCache();
+
+    if (!s3CacheRoots) {
+        s3CacheRoots = Rf_allocVector(VECSXP, 3 * S3_CACHE_SIZE);
+        R_PreserveObject(s3CacheRoots);
+    }
+    size_t slot = 3 * (h % S3_CACHE_SIZE);
+    SET_VECTOR_ELT(s3CacheRoots, slot, klass);
+    SET_VECTOR_ELT(s3CacheRoots, slot + 1, top);
+    SET_VECTOR_ELT(s3CacheRoots, slot + 2, frame ? frame : R_NilValue);
+    e.ast = ast;
+    e.selector = selector;
+    e.klass = klass;
+    e.top = top;
+    e.nsyms = nsyms;
+    for (unsigned j = 0; j < e.nsyms; ++j)
+        e.syms[j] = syms[j];
+    e.frame = frame;
+    e.cell = cell;
+    e.version = globalCacheVersion;
+
+    if (!method)
+        return S3Dispatch::NoMethod;
+    *result = dispatchS3Method(ast, selector, method, syms[i], klass, i,
+                               actuals, rho, callerEnv);
+    return S3Dispatch::Dispatched;
+}
+
 static SEXP cachedGetVar(SEXP env, Immediate idx, Context* ctx,
                          BindingCache* bindingCache) {
     SEXP loc = cachedGetBindingCell(env, idx, ctx, bindingCache);
@@ -1063,13 +1737,12 @@ static SEXP cachedGetVar(SEXP env, Immediate idx, Context* ctx,
     }
     SEXP sym = cp_pool_at(ctx, idx);
     SLOWASSERT(TYPEOF(sym) == SYMSXP);
+    // Not in the local frame, continue in the global or namespace env
+    if (!loc && !isBaseFrame(env))
+        return globalGetVar(sym, env == R_GlobalEnv ? env : ENCLOS(env));
     return Rf_findVar(sym, env);
 }
 
-#define ACTIVE_BINDING_MASK (1 << 15)
-#define BINDING_LOCK_MASK (1 << 14)
-#define IS_ACTIVE_BINDING(b) ((b)->sxpinfo.gp & ACTIVE_BINDING_MASK)
-#define BINDING_IS_LOCKED(b) ((b)->sxpinfo.gp & BINDING_LOCK_MASK)
 static void cachedSetVar(SEXP val, SEXP env, Immediate idx, Context* ctx,
                          BindingCache* bindingCache) {
     SEXP loc = cachedGetBindingCell(env, idx, ctx, bindingCache);
@@ -1084,12 +1757,1060 @@ static void cachedSetVar(SEXP val, SEXP env, Immediate idx, Context* ctx,
         return;
     }
 
-    SEXP sym = cp_pool_at(ctx, idx);
-    SLOWASSERT(TYPEOF(sym) == SYMSXP);
-    INCREMENT_NAMED(val);
-    PROTECT(val);
-    Rf_defineVar(sym, val, env);
-    UNPROTECT(1);
+    SEXP sym = cp_pool_at(ctx, idx);
+    SLOWASSERT(TYPEOF(sym) == SYMSXP);
+    INCREMENT_NAMED(val);
+    PROTECT(val);
+    Rf_defineVar(sym, val, env);
+    UNPROTECT(1);
+}
+
+#ifdef DIRECT_THREADED_CODE
+// The handler address of every instruction of a Function, in the order of the
+// instructions. The interpreter keeps a cursor into the handlers (hp) in sync
+// with pc: straight-line code advances both, taken branches follow the
+// precomputed index of their target and every other jump of pc looks up the
+// instruction by its offset. The table is built the first time the function
+// runs. The bytecode itself is not touched, therefore pcs (e.g. for sources or
+// deoptimization) stay valid.
+struct ThreadedCode {
+    size_t length;
+    // followed by void* handlers[length], uint32_t offsets[length] (from the
+    // start of the Function, ascending) and uint32_t targets[length] (index
+    // of the target of a branch, unused for other instructions)
+
+    void** handlers() { return (void**)(this + 1); }
+    uint32_t* offsets() { return (uint32_t*)(handlers() + length); }
+    uint32_t* targets() { return offsets() + length; }
+
+    uint32_t indexOf(Function* fun, Opcode* pc) {
+        uint32_t offset = (uintptr_t)pc - (uintptr_t)fun;
+        uint32_t* pos = std::lower_bound(offsets(), offsets() + length, offset);
+        SLOWASSERT(pos != offsets() + length && *pos == offset);
+        return pos - offsets();
+    }
+
+    // Returns the entry of the instruction at pc
+    void** at(Function* fun, Opcode* pc) {
+        return handlers() + indexOf(fun, pc);
+    }
+
+    // Returns the entry of the target of the branch, which hp points past
+    void** branchTarget(void** hp) {
+        return handlers() + targets()[hp - 1 - handlers()];
+    }
+
+    static size_t size(size_t length) {
+        return sizeof(ThreadedCode) +
+               length * (sizeof(void*) + 2 * sizeof(uint32_t));
+    }
+};
+
+static ThreadedCode* threadedCode(Function* fun, void** opAddr) {
+    SEXP table = fun->threaded();
+    if (!table) {
+        size_t length = 0;
+        for (Code* c : *fun) {
+            for (Opcode* pc = c->code(); pc < c->endCode(); pc += BC::size(pc))
+                length++;
+        }
+
+        PROTECT(table = Rf_allocVector(RAWSXP, ThreadedCode::size(length)));
+        ThreadedCode* t = (ThreadedCode*)RAW(table);
+        t->length = length;
+        size_t i = 0;
+        for (Code* c : *fun) {
+            for (Opcode* pc = c->code(); pc < c->endCode();
+                 pc += BC::size(pc)) {
+                t->handlers()[i] = opAddr[static_cast<uint8_t>(*pc)];
+                t->offsets()[i] = (uintptr_t)pc - (uintptr_t)fun;
+                i++;
+            }
+        }
+        i = 0;
+        for (Code* c : *fun) {
+            for (Opcode* pc = c->code(); pc < c->endCode();
+                 pc += BC::size(pc)) {
+                t->targets()[i++] = BC::decode(pc).isJmp()
+                                        ? t->indexOf(fun, BC::jmpTarget(pc))
+                                        : 0;
+            }
+        }
+        fun->threaded(table);
+        UNPROTECT(1);
+    }
+    return (ThreadedCode*)RAW(table);
+}
+#endif
+
+// Instruction bodies shared by the interpreter and the helpers of the native
+// code (see TemplateJit). Where the pc is passed, it points after the opcode.
+
+RIR_INLINE SEXP ldfun(SEXP sym, SEXP env, Context* ctx) {
+    SEXP res = Rf_findFun(sym, env);
+
+    // TODO something should happen here
+    if (res == R_UnboundValue)
+        assert(false && "Unbound var");
+    if (res == R_MissingArg)
+        assert(false && "Missing argument");
+
+    switch (TYPEOF(res)) {
+    case CLOSXP:
+        jit(res, ctx);
+        break;
+    case SPECIALSXP:
+    case BUILTINSXP:
+        // special and builtin functions are ok
+        break;
+    default:
+        error("attempt to apply non-function");
+    }
+    return res;
+}
+
+RIR_INLINE SEXP ldvar(SEXP env, Immediate id, Context* ctx,
+                      BindingCache* bindingCache) {
+    SEXP res = cachedGetVar(env, id, ctx, bindingCache);
+    R_Visible = TRUE;
+
+    if (res == R_UnboundValue) {
+        Rf_error("object not found");
+    } else if (res == R_MissingArg) {
+        SEXP sym = cp_pool_at(ctx, id);
+        Rf_error("argument \"%s\" is missing, with no default",
+                 CHAR(PRINTNAME(sym)));
+    }
+
+    // if promise, evaluate & return
+    if (TYPEOF(res) == PROMSXP)
+        res = promiseValue(res, ctx);
+
+    if (NAMED(res) == 0 && res != R_NilValue)
+        SET_NAMED(res, 1);
+    return res;
+}
+
+RIR_INLINE void stvar(SEXP val, SEXP env, Immediate id, Context* ctx,
+                      BindingCache* bindingCache) {
+    int wasChanged = FRAME_CHANGED(env);
+
+    cachedSetVar(val, env, id, ctx, bindingCache);
+
+    if (!wasChanged && FRAME_CHANGED(env)) {
+        // A new binding in a global or namespace env might shadow a cached
+        // one
+        if (HASHTAB(env) != R_NilValue)
+            invalidateGlobalCache();
+        CLEAR_FRAME_CHANGED(env);
+    }
+}
+
+// Binds the default argument of a missing formal like closureArgumentAdaptor,
+// such that missing() is still true for it
+RIR_INLINE void starg(SEXP val, SEXP env, Immediate id, Context* ctx,
+                      BindingCache* bindingCache) {
+    stvar(val, env, id, ctx, bindingCache);
+    SEXP loc = cachedGetBindingCell(env, id, ctx, bindingCache);
+    assert(loc && "formals are bound in the local frame");
+    SET_MISSING(loc, 2);
+}
+
+// Increments the int on top of the stack
+RIR_INLINE void inc(Context* ctx) {
+    SEXP val = ostack_top(ctx);
+    assert(TYPEOF(val) == INTSXP);
+    int i = INTEGER(val)[0];
+    if (MAYBE_SHARED(val)) {
+        ostack_pop(ctx);
+        SEXP n = Rf_allocVector(INTSXP, 1);
+        INTEGER(n)[0] = i + 1;
+        ostack_push(ctx, n);
+    } else {
+        INTEGER(val)[0]++;
+    }
+}
+
+RIR_INLINE SEXP asbool(SEXP val, Code* c, Opcode* pc, Context* ctx) {
+    int cond = NA_LOGICAL;
+    if (XLENGTH(val) > 1)
+        warningcall(getSrcAt(c, pc - 1, ctx),
+                    ("the condition has length > 1 and only the first "
+                     "element will be used"));
+
+    if (XLENGTH(val) > 0) {
+        switch (TYPEOF(val)) {
+        case LGLSXP:
+            cond = LOGICAL(val)[0];
+            break;
+        case INTSXP:
+            cond = INTEGER(val)[0]; // relies on NA_INTEGER == NA_LOGICAL
+            break;
+        default:
+            cond = Rf_asLogical(val);
+        }
+    }
+
+    if (cond == NA_LOGICAL) {
+        const char* msg =
+            XLENGTH(val)
+                ? (isLogical(val) ? ("missing value where TRUE/FALSE needed")
+                                  : ("argument is not interpretable as logical"))
+                : ("argument is of length zero");
+        errorcall(getSrcAt(c, pc - 1, ctx), msg);
+    }
+    return cond ? R_TrueValue : R_FalseValue;
+}
+
+RIR_INLINE bool isType(SEXP val, Immediate type) {
+    switch (type) {
+    case NILSXP:
+    case LGLSXP:
+    case REALSXP:
+        return TYPEOF(val) == type;
+
+    case VECSXP:
+        return TYPEOF(val) == VECSXP || TYPEOF(val) == LISTSXP;
+
+    case LISTSXP:
+        return TYPEOF(val) == LISTSXP || TYPEOF(val) == NILSXP;
+
+    default:
+        assert(false);
+        return false;
+    }
+}
+
+// v[i] of the two values on top of the stack, which are left on the stack
+RIR_INLINE SEXP extract11(Code* c, Opcode* pc, Context* ctx, SEXP env) {
+    SEXP val = ostack_at(ctx, 1);
+    SEXP idx = ostack_at(ctx, 0);
+    SEXP res;
+
+    SEXP args = CONS_NR(idx, R_NilValue);
+    args = CONS_NR(val, args);
+    ostack_push(ctx, args);
+
+    if (isObject(val)) {
+        SEXP call = getSrcAt(c, pc - 1, ctx);
+        res = dispatchApply(call, val, args, R_SubsetSym, env, ctx);
+        if (!res)
+            res = do_subset_dflt(R_NilValue, R_SubsetSym, args, env);
+    } else {
+        res = do_subset_dflt(R_NilValue, R_SubsetSym, args, env);
+    }
+
+    ostack_pop(ctx);
+    R_Visible = TRUE;
+    return res;
+}
+
+// v[[i]] of the two values on top of the stack, which are left on the stack
+RIR_INLINE SEXP extract21(Code* c, Opcode* pc, Context* ctx, SEXP env) {
+    SEXP val = ostack_at(ctx, 1);
+    SEXP idx = ostack_at(ctx, 0);
+    int i = -1;
+    SEXP res;
+
+    if (getAttrib(val, R_NamesSymbol) != R_NilValue || ATTRIB(val) ||
+        ATTRIB(idx) != R_NilValue)
+        goto fallback;
+
+    switch (TYPEOF(idx)) {
+    case REALSXP:
+        if (SHORT_VEC_LENGTH(idx) != 1 || *REAL(idx) == NA_REAL)
+            goto fallback;
+        i = (int)*REAL(idx) - 1;
+        break;
+    case INTSXP:
+        if (SHORT_VEC_LENGTH(idx) != 1 || *INTEGER(idx) == NA_INTEGER)
+            goto fallback;
+        i = *INTEGER(idx) - 1;
+        break;
+    case LGLSXP:
+        if (SHORT_VEC_LENGTH(idx) != 1 || *LOGICAL(idx) == NA_LOGICAL)
+            goto fallback;
+        i = (int)*LOGICAL(idx) - 1;
+        break;
+    default:
+        goto fallback;
+    }
+
+    if (i >= XLENGTH(val) || i < 0)
+        goto fallback;
+
+    switch (TYPEOF(val)) {
+
+#define SIMPLECASE(vectype, vecaccess)                                         \
+    case vectype: {                                                            \
+        if (XLENGTH(val) == 1 && NO_REFERENCES(val)) {                         \
+            res = val;                                                         \
+        } else {                                                               \
+            res = allocVector(vectype, 1);                                     \
+            vecaccess(res)[0] = vecaccess(val)[i];                             \
+        }                                                                      \
+        break;                                                                 \
+    }
+
+        SIMPLECASE(REALSXP, REAL);
+        SIMPLECASE(INTSXP, INTEGER);
+        SIMPLECASE(LGLSXP, LOGICAL);
+#undef SIMPLECASE
+
+    case VECSXP: {
+        res = VECTOR_ELT(val, i);
+        break;
+    }
+
+    default:
+        goto fallback;
+    }
+
+    R_Visible = TRUE;
+    return res;
+
+// ---------
+fallback : {
+    SEXP args = CONS_NR(idx, R_NilValue);
+    args = CONS_NR(val, args);
+    ostack_push(ctx, args);
+    if (isObject(val)) {
+        SEXP call = getSrcAt(c, pc - 1, ctx);
+        res = dispatchApply(call, val, args, R_Subset2Sym, env, ctx);
+        if (!res)
+            res = do_subset2_dflt(call, R_Subset2Sym, args, env);
+    } else {
+        res = do_subset2_dflt(R_NilValue, R_Subset2Sym, args, env);
+    }
+    ostack_pop(ctx);
+
+    R_Visible = TRUE;
+    return res;
+}
+}
+
+// v[[i]] of the two values on top of the stack, which are left on the stack.
+// i is a valid index (see ElideBoundsChecks).
+RIR_INLINE SEXP extract21Unchecked(Context* ctx, SEXP env) {
+    SEXP val = ostack_at(ctx, 1);
+    SEXP idx = ostack_at(ctx, 0);
+    SEXP res;
+    int i = TYPEOF(idx) == REALSXP ? (int)*REAL(idx) : *INTEGER(idx);
+    i--;
+
+    switch (TYPEOF(val)) {
+#define SIMPLECASE(vectype, vecaccess)                                         \
+    case vectype: {                                                            \
+        if (XLENGTH(val) == 1 && NO_REFERENCES(val)) {                         \
+            res = val;                                                         \
+        } else {                                                               \
+            res = allocVector(vectype, 1);                                     \
+            vecaccess(res)[0] = vecaccess(val)[i];                             \
+        }                                                                      \
+        break;                                                                 \
+    }
+
+        SIMPLECASE(REALSXP, REAL);
+        SIMPLECASE(INTSXP, INTEGER);
+        SIMPLECASE(LGLSXP, LOGICAL);
+#undef SIMPLECASE
+
+    case VECSXP:
+        res = VECTOR_ELT(val, i);
+        break;
+
+    default: {
+        // Other loop sequences, they are no objects (see for_seq_size_)
+        SEXP args = CONS_NR(idx, R_NilValue);
+        args = CONS_NR(val, args);
+        ostack_push(ctx, args);
+        res = do_subset2_dflt(R_NilValue, R_Subset2Sym, args, env);
+        ostack_pop(ctx);
+    }
+    }
+
+    R_Visible = TRUE;
+    return res;
+}
+
+// lhs / rhs of the two values on top of the stack, which are left on the stack
+RIR_INLINE SEXP divide(Code* c, Opcode* pc, Context* ctx, SEXP env) {
+    SEXP lhs = ostack_at(ctx, 1);
+    SEXP rhs = ostack_at(ctx, 0);
+    SEXP res;
+    auto getenv = [env]() { return env; };
+
+    if (IS_SIMPLE_SCALAR(lhs, REALSXP) && IS_SIMPLE_SCALAR(rhs, REALSXP)) {
+        double real_res = (*REAL(lhs) == NA_REAL || *REAL(rhs) == NA_REAL)
+                              ? NA_REAL
+                              : *REAL(lhs) / *REAL(rhs);
+        STORE_BINOP(REALSXP, 0, real_res);
+    } else if (IS_SIMPLE_SCALAR(lhs, INTSXP) &&
+               IS_SIMPLE_SCALAR(rhs, INTSXP)) {
+        double real_res;
+        int l = *INTEGER(lhs);
+        int r = *INTEGER(rhs);
+        if (l == NA_INTEGER || r == NA_INTEGER)
+            real_res = NA_REAL;
+        else
+            real_res = (double)l / (double)r;
+        STORE_BINOP(REALSXP, 0, real_res);
+    } else {
+        BINOP_FALLBACK("/");
+    }
+    return res;
+}
+
+// lhs:rhs of the two values on top of the stack, which are left on the stack
+RIR_INLINE SEXP colon(Code* c, Opcode* pc, Context* ctx, SEXP env) {
+    SEXP lhs = ostack_at(ctx, 1);
+    SEXP rhs = ostack_at(ctx, 0);
+    SEXP res = NULL;
+    auto getenv = [env]() { return env; };
+
+    if (IS_SIMPLE_SCALAR(lhs, INTSXP)) {
+        int from = *INTEGER(lhs);
+        if (IS_SIMPLE_SCALAR(rhs, INTSXP)) {
+            int to = *INTEGER(rhs);
+            if (from != NA_INTEGER && to != NA_INTEGER) {
+                res = seq_int(from, to);
+            }
+        } else if (IS_SIMPLE_SCALAR(rhs, REALSXP)) {
+            double to = *REAL(rhs);
+            if (from != NA_INTEGER && to != NA_REAL && R_FINITE(to) &&
+                INT_MIN <= to && INT_MAX >= to && to == (int)to) {
+                res = seq_int(from, (int)to);
+            }
+        }
+    } else if (IS_SIMPLE_SCALAR(lhs, REALSXP)) {
+        double from = *REAL(lhs);
+        if (IS_SIMPLE_SCALAR(rhs, INTSXP)) {
+            int to = *INTEGER(rhs);
+            if (from != NA_REAL && to != NA_INTEGER && R_FINITE(from) &&
+                INT_MIN <= from && INT_MAX >= from && from == (int)from) {
+                res = seq_int((int)from, to);
+            }
+        } else if (IS_SIMPLE_SCALAR(rhs, REALSXP)) {
+            double to = *REAL(rhs);
+            if (from != NA_REAL && to != NA_REAL && R_FINITE(from) &&
+                R_FINITE(to) && INT_MIN <= from && INT_MAX >= from &&
+                INT_MIN <= to && INT_MAX >= to && from == (int)from &&
+                to == (int)to) {
+                res = seq_int((int)from, (int)to);
+            }
+        }
+    }
+
+    if (res == NULL) {
+        BINOP_FALLBACK(":");
+    }
+    return res;
+}
+
+RIR_INLINE SEXP forSeqSize(SEXP seq) {
+    // TODO: we should extract the length just once at the begining of
+    // the loop and generally have somthing more clever here...
+    SEXP value = allocVector(INTSXP, 1);
+    if (isVector(seq)) {
+        INTEGER(value)[0] = LENGTH(seq);
+    } else if (isList(seq) || isNull(seq)) {
+        INTEGER(value)[0] = Rf_length(seq);
+    } else {
+        errorcall(R_NilValue, "invalid for() loop sequence");
+    }
+    // TODO: Even when the for loop sequence is an object, R won't
+    // dispatch on it. Since in RIR we use the normals extract2_1
+    // BC on it, we would. To prevent this we strip the object
+    // flag here. What we should do instead, is use a non-dispatching
+    // extract BC.
+    SET_OBJECT(seq, 0);
+    return value;
+}
+
+// Calls the intrinsic with its arguments on top of the stack. The arguments
+// are left on the stack.
+RIR_INLINE SEXP callIntrinsic(Intrinsic i, Context* ctx, SEXP env) {
+    auto& info = Intrinsics::info(i);
+    SEXP args[Intrinsics::MaxArgs];
+    for (unsigned a = 0; a < info.nargs; ++a)
+        args[a] = ostack_at(ctx, info.nargs - 1 - a);
+    return info.invoke(args, env);
+}
+
+static SEXP evalRirCodeAt(Code* c, Context* ctx, SEXP* env,
+                          const CallContext* callCtxt, Opcode* initialPc);
+
+// Leaves the optimized code at deoptimization point `id` of fun. The frame
+// states are taken from the stack (see DeoptTable), all inlined frames are run
+// to completion in the baseline code. Returns the outermost frame, which the
+// caller continues executing in env, with its stack on top of the ostack.
+static DeoptFrame deoptimize(Function* fun, uint32_t id, Context* ctx,
+                             SEXP* env) {
+    Reoptimizer::deoptimized(fun, id);
+    auto frames = DeoptTable::frames(fun->deoptTable(), id);
+
+    // The frame states are on the stack already, reserve the room for the
+    // baseline frames growing them before any is resumed
+    unsigned stackLength = 5;
+    for (auto& frame : frames)
+        stackLength += frame.code->stackLength;
+    ostack_ensureSize(ctx, stackLength);
+
+    SEXP frameEnv = ostack_pop(ctx);
+    for (size_t i = 0; i < frames.size() - 1; ++i) {
+        PROTECT(frameEnv);
+        auto& frame = frames[i];
+        SEXP res = evalRirCodeAt(frame.code, ctx, &frameEnv, nullptr, frame.pc);
+        UNPROTECT(1);
+        // The result of the callee goes on top of the caller's stack
+        frameEnv = ostack_pop(ctx);
+        ostack_push(ctx, res);
+    }
+    assert(TYPEOF(frameEnv) == ENVSXP);
+    *env = frameEnv;
+    return frames.back();
+}
+
+// Intrinsics, see intrinsics.h
+
+SEXP intrinsic::subset1Plain(SEXP vec, SEXP idx) {
+    assert(ATTRIB(vec) == R_NilValue);
+    SEXP args = PROTECT(CONS_NR(vec, CONS_NR(idx, R_NilValue)));
+    SEXP res = do_subset_dflt(R_NilValue, R_SubsetSym, args, R_BaseEnv);
+    UNPROTECT(1);
+    R_Visible = TRUE;
+    return res;
+}
+
+// Helpers of the native code, see TemplateJit. They run one instruction on the
+// state of the native frame, pc points after the opcode.
+#define JIT_HELPER(name)                                                       \
+    static void jit_##name(JitFrame* frame, Opcode* pc) {                      \
+        Code* c __attribute__((unused)) = frame->code;                         \
+        Context* ctx __attribute__((unused)) = frame->ctx;                     \
+        BindingCache* bindingCache __attribute__((unused)) =                   \
+            (BindingCache*)frame->bindingCache;                                \
+        auto getenv __attribute__((unused)) = [frame]() -> SEXP {              \
+            assert(*frame->env);                                               \
+            return *frame->env;                                                \
+        };                                                                     \
+        SEXP res __attribute__((unused));
+#define JIT_HELPER_END }
+
+JIT_HELPER(ldfun_)
+    SEXP sym = readConst(ctx, readImmediate());
+    res = ldfun(sym, getenv(), ctx);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(ldvar_)
+    res = ldvar(getenv(), readImmediate(), ctx, bindingCache);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(stvar_)
+    stvar(ostack_pop(ctx), getenv(), readImmediate(), ctx, bindingCache);
+JIT_HELPER_END
+
+JIT_HELPER(starg_)
+    starg(ostack_pop(ctx), getenv(), readImmediate(), ctx, bindingCache);
+JIT_HELPER_END
+
+JIT_HELPER(record_call_)
+    ((CallFeedback*)pc)->record(ostack_top(ctx));
+JIT_HELPER_END
+
+JIT_HELPER(record_binop_)
+    TypeFeedback* feedback = (TypeFeedback*)pc;
+    feedback[0].record(ostack_at(ctx, 1));
+    feedback[1].record(ostack_top(ctx));
+JIT_HELPER_END
+
+JIT_HELPER(call_implicit_)
+    size_t n = readImmediate();
+    advanceImmediate();
+    size_t ast = readImmediate();
+    advanceImmediate();
+    CallContext call(c, ostack_top(ctx), n, ast, (Immediate*)pc, getenv(),
+                     ctx);
+    res = doCall(call, ctx);
+    ostack_pop(ctx); // callee
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(call_)
+    Immediate n = readImmediate();
+    advanceImmediate();
+    size_t ast = readImmediate();
+    CallContext call(c, ostack_at(ctx, n), n, ast, ostack_cell_at(ctx, n - 1),
+                     getenv(), ctx);
+    res = doCall(call, ctx);
+    ostack_popn(ctx, n + 1);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(guard_fun_)
+#ifndef UNSOUND_OPTS
+    SEXP sym = readConst(ctx, readImmediate());
+    advanceImmediate();
+    res = readConst(ctx, readImmediate());
+    assert(res == Rf_findFun(sym, getenv()) && "guard_fun_ fail");
+#endif
+JIT_HELPER_END
+
+JIT_HELPER(dup2_)
+    ostack_push_cell(ctx, *ostack_cell_at(ctx, 1));
+    ostack_push_cell(ctx, *ostack_cell_at(ctx, 1));
+JIT_HELPER_END
+
+JIT_HELPER(put_)
+    Immediate i = readImmediate();
+    R_bcstack_t* pos = ostack_cell_at(ctx, 0);
+    R_bcstack_t val = *pos;
+    while (i--) {
+        *pos = *(pos - 1);
+        pos--;
+    }
+    *pos = val;
+JIT_HELPER_END
+
+JIT_HELPER(pick_)
+    Immediate i = readImmediate();
+    R_bcstack_t* pos = ostack_cell_at(ctx, i);
+    R_bcstack_t val = *pos;
+    while (i--) {
+        *pos = *(pos + 1);
+        pos++;
+    }
+    *pos = val;
+JIT_HELPER_END
+
+#define JIT_BINOP_HELPER(name, op, op2)                                        \
+    JIT_HELPER(name)                                                           \
+    SEXP lhs = ostack_at(ctx, 1);                                              \
+    SEXP rhs = ostack_at(ctx, 0);                                              \
+    DO_BINOP(op, op2);                                                         \
+    JIT_HELPER_END
+JIT_BINOP_HELPER(add_, +, PLUSOP)
+JIT_BINOP_HELPER(sub_, -, MINUSOP)
+JIT_BINOP_HELPER(mul_, *, TIMESOP)
+#undef JIT_BINOP_HELPER
+
+JIT_HELPER(div_)
+    res = divide(c, pc, ctx, getenv());
+    ostack_popn(ctx, 2);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(colon_)
+    res = colon(c, pc, ctx, getenv());
+    ostack_popn(ctx, 2);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+#define JIT_UNOP_HELPER(name, op, op2)                                         \
+    JIT_HELPER(name)                                                           \
+    SEXP val = ostack_at(ctx, 0);                                              \
+    DO_UNOP(op, op2);                                                          \
+    JIT_HELPER_END
+JIT_UNOP_HELPER(uplus_, +, PLUSOP)
+JIT_UNOP_HELPER(uminus_, -, MINUSOP)
+#undef JIT_UNOP_HELPER
+
+#define JIT_RELOP_HELPER(name, op)                                             \
+    JIT_HELPER(name)                                                           \
+    SEXP lhs = ostack_at(ctx, 1);                                              \
+    SEXP rhs = ostack_at(ctx, 0);                                              \
+    DO_RELOP(op);                                                              \
+    ostack_popn(ctx, 2);                                                       \
+    ostack_push(ctx, res);                                                     \
+    JIT_HELPER_END
+JIT_RELOP_HELPER(lt_, <)
+JIT_RELOP_HELPER(gt_, >)
+JIT_RELOP_HELPER(le_, <=)
+JIT_RELOP_HELPER(ge_, >=)
+JIT_RELOP_HELPER(eq_, ==)
+JIT_RELOP_HELPER(ne_, !=)
+#undef JIT_RELOP_HELPER
+
+JIT_HELPER(inc_)
+    inc(ctx);
+JIT_HELPER_END
+
+JIT_HELPER(asbool_)
+    res = asbool(ostack_top(ctx), c, pc, ctx);
+    ostack_pop(ctx);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(is_)
+    SEXP val = ostack_pop(ctx);
+    ostack_push(ctx, isType(val, readImmediate()) ? R_TrueValue : R_FalseValue);
+JIT_HELPER_END
+
+JIT_HELPER(extract1_1_)
+    res = extract11(c, pc, ctx, getenv());
+    ostack_popn(ctx, 2);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(extract2_1_)
+    res = extract21(c, pc, ctx, getenv());
+    ostack_popn(ctx, 2);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(length_)
+    SEXP val = ostack_pop(ctx);
+    R_xlen_t len = XLENGTH(val);
+    ostack_push(ctx, Rf_allocVector(INTSXP, 1));
+    INTEGER(ostack_top(ctx))[0] = len;
+JIT_HELPER_END
+
+JIT_HELPER(for_seq_size_)
+    res = forSeqSize(ostack_at(ctx, 0));
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(for_kernel_)
+    SEXP kernel = readConst(ctx, readImmediate());
+    res = VectorKernel::run(kernel, ostack_top(ctx), getenv());
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(call_intrinsic_)
+    Intrinsic i = (Intrinsic)readImmediate();
+    auto& info = Intrinsics::info(i);
+    res = callIntrinsic(i, ctx, info.hasEnv ? getenv() : nullptr);
+    ostack_popn(ctx, info.nargs);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(set_shared_)
+    SEXP val = ostack_top(ctx);
+    if (NAMED(val) < 2)
+        SET_NAMED(val, 2);
+JIT_HELPER_END
+
+JIT_HELPER(make_unique_)
+    SEXP val = ostack_top(ctx);
+    if (NAMED(val) == 2) {
+        val = shallow_duplicate(val);
+        ostack_set(ctx, 0, val);
+        SET_NAMED(val, 1);
+    }
+JIT_HELPER_END
+
+JIT_HELPER(extract2_1_unchecked_)
+    res = extract21Unchecked(ctx, getenv());
+    ostack_popn(ctx, 2);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(in_bounds_)
+    bool ok = inBounds(ostack_at(ctx, 2), ostack_at(ctx, 1), ostack_at(ctx, 0));
+    ostack_popn(ctx, 3);
+    ostack_push(ctx, ok ? R_TrueValue : R_FalseValue);
+JIT_HELPER_END
+
+// Optimized code
+
+JIT_HELPER(ldarg_)
+    const CallContext* callCtxt = frame->callCtxt;
+    Immediate idx = readImmediate();
+    assert(callCtxt);
+    if (callCtxt->hasStackArgs()) {
+        ostack_push(ctx, callCtxt->stackArg(idx));
+    } else {
+        res = createArgPromise(callCtxt->implicitArg(idx),
+                               callCtxt->callerEnv, ctx);
+        ostack_push(ctx, res);
+    }
+JIT_HELPER_END
+
+JIT_HELPER(ldvar_noforce_)
+    res = cachedGetVar(getenv(), readImmediate(), ctx, bindingCache);
+    R_Visible = TRUE;
+    if (res == R_UnboundValue)
+        Rf_error("object not found");
+    if (NAMED(res) == 0 && res != R_NilValue)
+        SET_NAMED(res, 1);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(make_env_)
+    SEXP parent = ostack_pop(ctx);
+    assert(TYPEOF(parent) == ENVSXP &&
+           "Non-environment used as environment parent.");
+    res = Rf_NewEnvironment(R_NilValue, R_NilValue, parent);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(parent_env_)
+    ostack_push(ctx, CLOENV(frame->callCtxt->callee));
+JIT_HELPER_END
+
+JIT_HELPER(get_env_)
+    ostack_push(ctx, getenv());
+JIT_HELPER_END
+
+JIT_HELPER(set_env_)
+    // The bindings cache belongs to the old environment
+    memset(bindingCache, 0, sizeof(BindingCache) * BINDING_CACHE_SIZE);
+    SEXP e = ostack_pop(ctx);
+    assert(TYPEOF(e) == ENVSXP && "Expected an environment on TOS.");
+    *frame->env = e;
+JIT_HELPER_END
+
+JIT_HELPER(named_call_)
+    Immediate n = readImmediate();
+    advanceImmediate();
+    size_t ast = readImmediate();
+    advanceImmediate();
+    CallContext call(c, ostack_at(ctx, n), n, ast, ostack_cell_at(ctx, n - 1),
+                     (Immediate*)pc, getenv(), ctx);
+    res = doCall(call, ctx);
+    ostack_popn(ctx, n + 1);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(static_call_)
+    Immediate n = readImmediate();
+    advanceImmediate();
+    Immediate ast = readImmediate();
+    advanceImmediate();
+    SEXP callee = cp_pool_at(ctx, readImmediate());
+    // As in the interpreter, safe builtins are called without an env
+    CallContext call(c, callee, n, ast, ostack_cell_at(ctx, n - 1),
+                     *frame->env, ctx);
+    res = doCall(call, ctx);
+    ostack_popn(ctx, n);
+    ostack_push(ctx, res);
+JIT_HELPER_END
+
+JIT_HELPER(promise_)
+    Code* promiseCode = c->function()->codeAt(readImmediate());
+    SEXP prom = createPromise(promiseCode, getenv());
+    SET_PRVALUE(prom, ostack_pop(ctx));
+    ostack_push(ctx, prom);
+JIT_HELPER_END
+
+JIT_HELPER(force_)
+    if (TYPEOF(ostack_top(ctx)) == PROMSXP) {
+        SEXP val = ostack_pop(ctx);
+        ostack_push(ctx, promiseValue(val, ctx));
+    }
+JIT_HELPER_END
+
+JIT_HELPER(isfun_)
+    SEXP val = ostack_top(ctx);
+    switch (TYPEOF(val)) {
+    case CLOSXP:
+        jit(val, ctx);
+        break;
+    case SPECIALSXP:
+    case BUILTINSXP:
+        break;
+    default:
+        error("attempt to apply non-function");
+    }
+JIT_HELPER_END
+
+JIT_HELPER(check_missing_)
+    if (ostack_top(ctx) == R_MissingArg)
+        Rf_error("argument is missing, with no default");
+JIT_HELPER_END
+
+JIT_HELPER(identical_)
+    SEXP rhs = ostack_pop(ctx);
+    SEXP lhs = ostack_pop(ctx);
+    ostack_push(ctx, rhs == lhs ? R_TrueValue : R_FalseValue);
+JIT_HELPER_END
+
+JIT_HELPER(isobj_)
+    SEXP val = ostack_pop(ctx);
+    ostack_push(ctx, isObject(val) ? R_TrueValue : R_FalseValue);
+JIT_HELPER_END
+
+JIT_HELPER(istype_)
+    SEXP val = ostack_pop(ctx);
+    auto expected = RecordedType::unpack(readImmediate());
+    ostack_push(ctx, RecordedType(val) == expected ? R_TrueValue
+                                                   : R_FalseValue);
+JIT_HELPER_END
+
+JIT_HELPER(unbox_)
+    auto type = readImmediate();
+    SEXP val = ostack_pop(ctx);
+    SLOWASSERT(XLENGTH(val) == 1 && ATTRIB(val) == R_NilValue);
+    if (TYPEOF(val) == INTSXP) {
+        int i = INTEGER(val)[0];
+        if (type == INTSXP)
+            ostack_push_int(ctx, i);
+        else
+            ostack_push_real(ctx, i == NA_INTEGER ? NA_REAL : i);
+    } else {
+        SLOWASSERT(TYPEOF(val) == REALSXP && type == REALSXP);
+        ostack_push_real(ctx, REAL(val)[0]);
+    }
+JIT_HELPER_END
+
+JIT_HELPER(box_)
+#ifdef TYPED_STACK
+    R_bcstack_t* cell = ostack_cell_at(ctx, 0);
+    if (ostack_cell_type(cell) == INTSXP)
+        res = Rf_ScalarInteger(ostack_cell_int(cell));
+    else
+        res = Rf_ScalarReal(ostack_cell_real(cell));
+    ostack_pop(ctx);
+    ostack_push(ctx, res);
+#endif
+JIT_HELPER_END
+
+#define JIT_UNBOXED_BINOP_HELPER(name, op, op2)                                \
+    JIT_HELPER(name)                                                           \
+    DO_UNBOXED_BINOP(op, op2);                                                 \
+    JIT_HELPER_END
+JIT_UNBOXED_BINOP_HELPER(nadd_, +, PLUSOP)
+JIT_UNBOXED_BINOP_HELPER(nsub_, -, MINUSOP)
+JIT_UNBOXED_BINOP_HELPER(nmul_, *, TIMESOP)
+#undef JIT_UNBOXED_BINOP_HELPER
+
+#define JIT_UNBOXED_RELOP_HELPER(name, op)                                     \
+    JIT_HELPER(name)                                                           \
+    DO_UNBOXED_RELOP(op);                                                      \
+    JIT_HELPER_END
+JIT_UNBOXED_RELOP_HELPER(nlt_, <)
+JIT_UNBOXED_RELOP_HELPER(ngt_, >)
+JIT_UNBOXED_RELOP_HELPER(nle_, <=)
+JIT_UNBOXED_RELOP_HELPER(nge_, >=)
+JIT_UNBOXED_RELOP_HELPER(neq_, ==)
+JIT_UNBOXED_RELOP_HELPER(nne_, !=)
+#undef JIT_UNBOXED_RELOP_HELPER
+
+#undef JIT_HELPER
+#undef JIT_HELPER_END
+
+// Exits of the native code to the baseline code. The rest of the frame runs
+// in the interpreter and its result is left on the stack.
+static bool jit_exit(JitFrame* frame, uint32_t deoptId) {
+    DeoptFrame f =
+        deoptimize(frame->code->function(), deoptId, frame->ctx, frame->env);
+    SEXP res = evalRirCodeAt(f.code, frame->ctx, frame->env, frame->callCtxt,
+                             f.pc);
+    ostack_push(frame->ctx, res);
+    return true;
+}
+
+static bool jit_deopt_(JitFrame* frame, Opcode* pc) {
+    return jit_exit(frame, readImmediate());
+}
+
+static bool jit_guard_env_(JitFrame* frame, Opcode* pc) {
+    SEXP env = *frame->env;
+    if (!FRAME_CHANGED(env) && !FRAME_LEAKED(env))
+        return false;
+    ostack_push(frame->ctx, env);
+    return jit_exit(frame, readImmediate());
+}
+
+JitExit TemplateJit::exit(Opcode op) {
+    switch (op) {
+    case Opcode::deopt_:
+        return jit_deopt_;
+    case Opcode::guard_env_:
+        return jit_guard_env_;
+    default:
+        return nullptr;
+    }
+}
+
+JitHelper TemplateJit::helper(Opcode op) {
+    switch (op) {
+#define V(name)                                                                \
+    case Opcode::name:                                                         \
+        return jit_##name;
+        V(ldfun_)
+        V(ldvar_)
+        V(stvar_)
+        V(starg_)
+        V(record_call_)
+        V(record_binop_)
+        V(call_implicit_)
+        V(call_)
+        V(guard_fun_)
+        V(dup2_)
+        V(put_)
+        V(pick_)
+        V(add_)
+        V(sub_)
+        V(mul_)
+        V(div_)
+        V(colon_)
+        V(uplus_)
+        V(uminus_)
+        V(lt_)
+        V(gt_)
+        V(le_)
+        V(ge_)
+        V(eq_)
+        V(ne_)
+        V(inc_)
+        V(asbool_)
+        V(is_)
+        V(extract1_1_)
+        V(extract2_1_)
+        V(length_)
+        V(for_seq_size_)
+        V(for_kernel_)
+        V(call_intrinsic_)
+        V(set_shared_)
+        V(make_unique_)
+        V(extract2_1_unchecked_)
+        V(in_bounds_)
+        V(ldarg_)
+        V(ldvar_noforce_)
+        V(make_env_)
+        V(parent_env_)
+        V(get_env_)
+        V(set_env_)
+        V(named_call_)
+        V(static_call_)
+        V(promise_)
+        V(force_)
+        V(isfun_)
+        V(check_missing_)
+        V(identical_)
+        V(isobj_)
+        V(istype_)
+        V(unbox_)
+        V(box_)
+        V(nadd_)
+        V(nsub_)
+        V(nmul_)
+        V(nlt_)
+        V(ngt_)
+        V(nle_)
+        V(nge_)
+        V(neq_)
+        V(nne_)
+#undef V
+    default:
+        return nullptr;
+    }
+}
+
+// Sets up the same frame state as evalRirCodeAt for the native code
+static SEXP evalNative(NativeCode native, Code* c, Context* ctx, SEXP* env,
+                       const CallContext* callCtxt) {
+    ostack_ensureSize(ctx, c->localsCount + c->stackLength + 5);
+    Locals locals(c->localsCount);
+    BindingCache bindingCache[BINDING_CACHE_SIZE];
+    memset(&bindingCache, 0, sizeof(bindingCache));
+    R_Visible = TRUE;
+    JitFrame frame = {c, ctx, env, callCtxt, bindingCache,
+                      c->localsCount ? &locals.cell(0) : nullptr};
+    return native(&frame);
 }
 
 SEXP evalRirCodeExtCaller(Code* c, Context* ctx, SEXP* env) {
@@ -1098,6 +2819,16 @@ SEXP evalRirCodeExtCaller(Code* c, Context* ctx, SEXP* env) {
 
 SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
                  const CallContext* callCtxt) {
+    Function* fun = c->function();
+    if (c == fun->body()) {
+        if (NativeCode native = TemplateJit::native(fun))
+            return evalNative(native, c, ctx, env, callCtxt);
+    }
+    return evalRirCodeAt(c, ctx, env, callCtxt, c->code());
+}
+
+static SEXP evalRirCodeAt(Code* c, Context* ctx, SEXP* env,
+                          const CallContext* callCtxt, Opcode* initialPc) {
     assert(*env || (callCtxt != nullptr));
 
     extern int R_PPStackTop;
@@ -1112,19 +2843,25 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
 
     assert(c->magic == CODE_MAGIC);
 
+    // make sure there is enough room on the stack for the locals and the
+    // operands. there is some slack of 5 to make sure the call instruction can
+    // store some intermediate values on the stack
+    ostack_ensureSize(ctx, c->localsCount + c->stackLength + 5);
+
     Locals locals(c->localsCount);
 
     BindingCache bindingCache[BINDING_CACHE_SIZE];
     memset(&bindingCache, 0, sizeof(bindingCache));
 
-    // make sure there is enough room on the stack
-    // there is some slack of 5 to make sure the call instruction can store
-    // some intermediate values on the stack
-    ostack_ensureSize(ctx, c->stackLength + 5);
-
-    Opcode* pc = c->code();
+    Opcode* pc = initialPc;
     SEXP res;
 
+#ifdef DIRECT_THREADED_CODE
+    ThreadedCode* threaded = threadedCode(c->function(), opAddr);
+    void** hp;
+    SYNC_HANDLERS();
+#endif
+
     R_Visible = TRUE;
 
     auto getenv = [&env]() -> SEXP {
@@ -1132,6 +2869,19 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         return *env;
     };
 
+    // Continues in the baseline code of deoptimization point `id`
+    auto deopt = [&](uint32_t id) {
+        DeoptFrame frame = deoptimize(c->function(), id, ctx, env);
+        memset(&bindingCache, 0, sizeof(bindingCache));
+        c = frame.code;
+        pc = frame.pc;
+        PC_BOUNDSCHECK(pc, c);
+#ifdef DIRECT_THREADED_CODE
+        threaded = threadedCode(c->function(), opAddr);
+        SYNC_HANDLERS();
+#endif
+    };
+
     // main loop
     BEGIN_MACHINE {
 
@@ -1174,25 +2924,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         INSTRUCTION(ldfun_) {
             SEXP sym = readConst(ctx, readImmediate());
             advanceImmediate();
-            res = Rf_findFun(sym, getenv());
-
-            // TODO something should happen here
-            if (res == R_UnboundValue)
-                assert(false && "Unbound var");
-            if (res == R_MissingArg)
-                assert(false && "Missing argument");
-
-            switch (TYPEOF(res)) {
-            case CLOSXP:
-                jit(res, ctx);
-                break;
-            case SPECIALSXP:
-            case BUILTINSXP:
-                // special and builtin functions are ok
-                break;
-            default:
-                error("attempt to apply non-function");
-            }
+            res = ldfun(sym, getenv(), ctx);
             ostack_push(ctx, res);
             NEXT();
         }
@@ -1200,24 +2932,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         INSTRUCTION(ldvar_) {
             Immediate id = readImmediate();
             advanceImmediate();
-            res = cachedGetVar(getenv(), id, ctx, bindingCache);
-            R_Visible = TRUE;
-
-            if (res == R_UnboundValue) {
-                Rf_error("object not found");
-            } else if (res == R_MissingArg) {
-                SEXP sym = cp_pool_at(ctx, id);
-                Rf_error("argument \"%s\" is missing, with no default",
-                         CHAR(PRINTNAME(sym)));
-            }
-
-            // if promise, evaluate & return
-            if (TYPEOF(res) == PROMSXP)
-                res = promiseValue(res, ctx);
-
-            if (NAMED(res) == 0 && res != R_NilValue)
-                SET_NAMED(res, 1);
-
+            res = ldvar(getenv(), id, ctx, bindingCache);
             ostack_push(ctx, res);
             NEXT();
         }
@@ -1336,7 +3051,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
                 ostack_push(ctx, callCtxt->stackArg(idx));
             } else {
                 Code* arg = callCtxt->implicitArg(idx);
-                res = createPromise(arg, callCtxt->callerEnv);
+                res = createArgPromise(arg, callCtxt->callerEnv, ctx);
                 ostack_push(ctx, res);
             }
             NEXT();
@@ -1345,21 +3060,21 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         INSTRUCTION(ldloc_) {
             Immediate offset = readImmediate();
             advanceImmediate();
-            res = locals.load(offset);
-            ostack_push(ctx, res);
+            ostack_push_cell(ctx, locals.cell(offset));
             NEXT();
         }
 
         INSTRUCTION(stvar_) {
             Immediate id = readImmediate();
             advanceImmediate();
-            int wasChanged = FRAME_CHANGED(getenv());
-            SEXP val = ostack_pop(ctx);
-
-            cachedSetVar(val, getenv(), id, ctx, bindingCache);
+            stvar(ostack_pop(ctx), getenv(), id, ctx, bindingCache);
+            NEXT();
+        }
 
-            if (!wasChanged)
-                CLEAR_FRAME_CHANGED(getenv());
+        INSTRUCTION(starg_) {
+            Immediate id = readImmediate();
+            advanceImmediate();
+            starg(ostack_pop(ctx), getenv(), id, ctx, bindingCache);
             NEXT();
         }
 
@@ -1376,7 +3091,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         INSTRUCTION(stloc_) {
             Immediate offset = readImmediate();
             advanceImmediate();
-            locals.store(offset, ostack_top(ctx));
+            locals.cell(offset) = *ostack_cell_at(ctx, 0);
             ostack_pop(ctx);
             NEXT();
         }
@@ -1386,7 +3101,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
             advanceImmediate();
             Immediate source = readImmediate();
             advanceImmediate();
-            locals.store(target, locals.load(source));
+            locals.cell(target) = locals.cell(source);
             NEXT();
         }
 
@@ -1601,13 +3316,13 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         }
 
         INSTRUCTION(dup_) {
-            ostack_push(ctx, ostack_top(ctx));
+            ostack_push_cell(ctx, *ostack_cell_at(ctx, 0));
             NEXT();
         }
 
         INSTRUCTION(dup2_) {
-            ostack_push(ctx, ostack_at(ctx, 1));
-            ostack_push(ctx, ostack_at(ctx, 1));
+            ostack_push_cell(ctx, *ostack_cell_at(ctx, 1));
+            ostack_push_cell(ctx, *ostack_cell_at(ctx, 1));
             NEXT();
         }
 
@@ -1617,10 +3332,9 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         }
 
         INSTRUCTION(swap_) {
-            SEXP lhs = ostack_pop(ctx);
-            SEXP rhs = ostack_pop(ctx);
-            ostack_push(ctx, lhs);
-            ostack_push(ctx, rhs);
+            R_bcstack_t lhs = *ostack_cell_at(ctx, 0);
+            *ostack_cell_at(ctx, 0) = *ostack_cell_at(ctx, 1);
+            *ostack_cell_at(ctx, 1) = lhs;
             NEXT();
         }
 
@@ -1628,21 +3342,12 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
             Immediate i = readImmediate();
             advanceImmediate();
             R_bcstack_t* pos = ostack_cell_at(ctx, 0);
-#ifdef TYPED_STACK
-            SEXP val = pos->u.sxpval;
-            while (i--) {
-                pos->u.sxpval = (pos - 1)->u.sxpval;
-                pos--;
-            }
-            pos->u.sxpval = val;
-#else
-            SEXP val = *pos;
+            R_bcstack_t val = *pos;
             while (i--) {
                 *pos = *(pos - 1);
                 pos--;
             }
             *pos = val;
-#endif
             NEXT();
         }
 
@@ -1650,29 +3355,19 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
             Immediate i = readImmediate();
             advanceImmediate();
             R_bcstack_t* pos = ostack_cell_at(ctx, i);
-#ifdef TYPED_STACK
-            SEXP val = pos->u.sxpval;
-            while (i--) {
-                pos->u.sxpval = (pos + 1)->u.sxpval;
-                pos++;
-            }
-            pos->u.sxpval = val;
-#else
-            SEXP val = *pos;
+            R_bcstack_t val = *pos;
             while (i--) {
                 *pos = *(pos + 1);
                 pos++;
             }
             *pos = val;
-#endif
             NEXT();
         }
 
         INSTRUCTION(pull_) {
             Immediate i = readImmediate();
             advanceImmediate();
-            SEXP val = ostack_at(ctx, i);
-            ostack_push(ctx, val);
+            ostack_push_cell(ctx, *ostack_cell_at(ctx, i));
             NEXT();
         }
 
@@ -1690,17 +3385,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         }
 
         INSTRUCTION(inc_) {
-            SEXP val = ostack_top(ctx);
-            assert(TYPEOF(val) == INTSXP);
-            int i = INTEGER(val)[0];
-            if (MAYBE_SHARED(val)) {
-                ostack_pop(ctx);
-                SEXP n = Rf_allocVector(INTSXP, 1);
-                INTEGER(n)[0] = i + 1;
-                ostack_push(ctx, n);
-            } else {
-                INTEGER(val)[0]++;
-            }
+            inc(ctx);
             NEXT();
         }
 
@@ -1725,30 +3410,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         }
 
         INSTRUCTION(div_) {
-            SEXP lhs = ostack_at(ctx, 1);
-            SEXP rhs = ostack_at(ctx, 0);
-
-            if (IS_SIMPLE_SCALAR(lhs, REALSXP) &&
-                IS_SIMPLE_SCALAR(rhs, REALSXP)) {
-                double real_res =
-                    (*REAL(lhs) == NA_REAL || *REAL(rhs) == NA_REAL)
-                        ? NA_REAL
-                        : *REAL(lhs) / *REAL(rhs);
-                STORE_BINOP(REALSXP, 0, real_res);
-            } else if (IS_SIMPLE_SCALAR(lhs, INTSXP) &&
-                       IS_SIMPLE_SCALAR(rhs, INTSXP)) {
-                double real_res;
-                int l = *INTEGER(lhs);
-                int r = *INTEGER(rhs);
-                if (l == NA_INTEGER || r == NA_INTEGER)
-                    real_res = NA_REAL;
-                else
-                    real_res = (double)l / (double)r;
-                STORE_BINOP(REALSXP, 0, real_res);
-            } else {
-                BINOP_FALLBACK("/");
-            }
-
+            res = divide(c, pc, ctx, getenv());
             ostack_popn(ctx, 2);
             ostack_push(ctx, res);
             NEXT();
@@ -1884,6 +3546,82 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
             NEXT();
         }
 
+        INSTRUCTION(unbox_) {
+            auto type = readImmediate();
+            advanceImmediate();
+            SEXP val = ostack_pop(ctx);
+            SLOWASSERT(XLENGTH(val) == 1 && ATTRIB(val) == R_NilValue);
+            if (TYPEOF(val) == INTSXP) {
+                int i = INTEGER(val)[0];
+                if (type == INTSXP)
+                    ostack_push_int(ctx, i);
+                else
+                    ostack_push_real(ctx, i == NA_INTEGER ? NA_REAL : i);
+            } else {
+                SLOWASSERT(TYPEOF(val) == REALSXP && type == REALSXP);
+                ostack_push_real(ctx, REAL(val)[0]);
+            }
+            NEXT();
+        }
+
+        INSTRUCTION(box_) {
+#ifdef TYPED_STACK
+            R_bcstack_t* cell = ostack_cell_at(ctx, 0);
+            if (ostack_cell_type(cell) == INTSXP)
+                res = Rf_ScalarInteger(ostack_cell_int(cell));
+            else
+                res = Rf_ScalarReal(ostack_cell_real(cell));
+            ostack_pop(ctx);
+            ostack_push(ctx, res);
+#endif
+            NEXT();
+        }
+
+        INSTRUCTION(nadd_) {
+            DO_UNBOXED_BINOP(+, PLUSOP);
+            NEXT();
+        }
+
+        INSTRUCTION(nsub_) {
+            DO_UNBOXED_BINOP(-, MINUSOP);
+            NEXT();
+        }
+
+        INSTRUCTION(nmul_) {
+            DO_UNBOXED_BINOP(*, TIMESOP);
+            NEXT();
+        }
+
+        INSTRUCTION(nlt_) {
+            DO_UNBOXED_RELOP(<);
+            NEXT();
+        }
+
+        INSTRUCTION(ngt_) {
+            DO_UNBOXED_RELOP(>);
+            NEXT();
+        }
+
+        INSTRUCTION(nle_) {
+            DO_UNBOXED_RELOP(<=);
+            NEXT();
+        }
+
+        INSTRUCTION(nge_) {
+            DO_UNBOXED_RELOP(>=);
+            NEXT();
+        }
+
+        INSTRUCTION(neq_) {
+            DO_UNBOXED_RELOP(==);
+            NEXT();
+        }
+
+        INSTRUCTION(nne_) {
+            DO_UNBOXED_RELOP(!=);
+            NEXT();
+        }
+
         INSTRUCTION(not_) {
             SEXP val = ostack_at(ctx, 0);
 
@@ -1952,39 +3690,9 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         }
 
         INSTRUCTION(asbool_) {
-            SEXP val = ostack_top(ctx);
-            int cond = NA_LOGICAL;
-            if (XLENGTH(val) > 1)
-                warningcall(getSrcAt(c, pc - 1, ctx),
-                            ("the condition has length > 1 and only the first "
-                             "element will be used"));
-
-            if (XLENGTH(val) > 0) {
-                switch (TYPEOF(val)) {
-                case LGLSXP:
-                    cond = LOGICAL(val)[0];
-                    break;
-                case INTSXP:
-                    cond =
-                        INTEGER(val)[0]; // relies on NA_INTEGER == NA_LOGICAL
-                    break;
-                default:
-                    cond = Rf_asLogical(val);
-                }
-            }
-
-            if (cond == NA_LOGICAL) {
-                const char* msg =
-                    XLENGTH(val)
-                        ? (isLogical(val)
-                               ? ("missing value where TRUE/FALSE needed")
-                               : ("argument is not interpretable as logical"))
-                        : ("argument is of length zero");
-                errorcall(getSrcAt(c, pc - 1, ctx), msg);
-            }
-
+            res = asbool(ostack_top(ctx), c, pc, ctx);
             ostack_pop(ctx);
-            ostack_push(ctx, cond ? R_TrueValue : R_FalseValue);
+            ostack_push(ctx, res);
             NEXT();
         }
 
@@ -2006,27 +3714,16 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
             SEXP val = ostack_pop(ctx);
             Immediate i = readImmediate();
             advanceImmediate();
-            bool res;
-            switch (i) {
-            case NILSXP:
-            case LGLSXP:
-            case REALSXP:
-                res = TYPEOF(val) == i;
-                break;
-
-            case VECSXP:
-                res = TYPEOF(val) == VECSXP || TYPEOF(val) == LISTSXP;
-                break;
-
-            case LISTSXP:
-                res = TYPEOF(val) == LISTSXP || TYPEOF(val) == NILSXP;
-                break;
+            ostack_push(ctx, isType(val, i) ? R_TrueValue : R_FalseValue);
+            NEXT();
+        }
 
-            default:
-                assert(false);
-                break;
-            }
-            ostack_push(ctx, res ? R_TrueValue : R_FalseValue);
+        INSTRUCTION(istype_) {
+            SEXP val = ostack_pop(ctx);
+            auto expected = RecordedType::unpack(readImmediate());
+            advanceImmediate();
+            ostack_push(ctx, RecordedType(val) == expected ? R_TrueValue
+                                                           : R_FalseValue);
             NEXT();
         }
 
@@ -2080,8 +3777,10 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         INSTRUCTION(brobj_) {
             JumpOffset offset = readJumpOffset();
             advanceJump();
-            if (OBJECT(ostack_top(ctx)))
+            if (OBJECT(ostack_top(ctx))) {
                 pc = pc + offset;
+                BRANCH_HANDLERS();
+            }
             PC_BOUNDSCHECK(pc, c);
             NEXT();
         }
@@ -2091,6 +3790,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
             advanceJump();
             if (ostack_pop(ctx) == R_TrueValue) {
                 pc = pc + offset;
+                BRANCH_HANDLERS();
                 if (offset < 0)
                     incPerfCount(c);
             }
@@ -2103,6 +3803,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
             advanceJump();
             if (ostack_pop(ctx) == R_FalseValue) {
                 pc = pc + offset;
+                BRANCH_HANDLERS();
                 if (offset < 0)
                     incPerfCount(c);
             }
@@ -2116,32 +3817,14 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
             if (offset < 0)
                 incPerfCount(c);
             pc = pc + offset;
+            BRANCH_HANDLERS();
             PC_BOUNDSCHECK(pc, c);
             NEXT();
         }
 
         INSTRUCTION(extract1_1_) {
-            SEXP val = ostack_at(ctx, 1);
-            SEXP idx = ostack_at(ctx, 0);
-
-            SEXP args = CONS_NR(idx, R_NilValue);
-            args = CONS_NR(val, args);
-            ostack_push(ctx, args);
-
-            if (isObject(val)) {
-                SEXP call = getSrcAt(c, pc - 1, ctx);
-                res =
-                    dispatchApply(call, val, args, R_SubsetSym, getenv(), ctx);
-                if (!res)
-                    res =
-                        do_subset_dflt(R_NilValue, R_SubsetSym, args, getenv());
-            } else {
-                res = do_subset_dflt(R_NilValue, R_SubsetSym, args, getenv());
-            }
-
-            ostack_popn(ctx, 3);
-
-            R_Visible = TRUE;
+            res = extract11(c, pc, ctx, getenv());
+            ostack_popn(ctx, 2);
             ostack_push(ctx, res);
             NEXT();
         }
@@ -2193,89 +3876,27 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         }
 
         INSTRUCTION(extract2_1_) {
-            SEXP val = ostack_at(ctx, 1);
-            SEXP idx = ostack_at(ctx, 0);
-            int i = -1;
-
-            if (getAttrib(val, R_NamesSymbol) != R_NilValue || ATTRIB(val) ||
-                ATTRIB(idx) != R_NilValue)
-                goto fallback;
-
-            switch (TYPEOF(idx)) {
-            case REALSXP:
-                if (SHORT_VEC_LENGTH(idx) != 1 || *REAL(idx) == NA_REAL)
-                    goto fallback;
-                i = (int)*REAL(idx) - 1;
-                break;
-            case INTSXP:
-                if (SHORT_VEC_LENGTH(idx) != 1 || *INTEGER(idx) == NA_INTEGER)
-                    goto fallback;
-                i = *INTEGER(idx) - 1;
-                break;
-            case LGLSXP:
-                if (SHORT_VEC_LENGTH(idx) != 1 || *LOGICAL(idx) == NA_LOGICAL)
-                    goto fallback;
-                i = (int)*LOGICAL(idx) - 1;
-                break;
-            default:
-                goto fallback;
-            }
-
-            if (i >= XLENGTH(val) || i < 0)
-                goto fallback;
-
-            switch (TYPEOF(val)) {
-
-#define SIMPLECASE(vectype, vecaccess)                                         \
-    case vectype: {                                                            \
-        if (XLENGTH(val) == 1 && NO_REFERENCES(val)) {                         \
-            res = val;                                                         \
-        } else {                                                               \
-            res = allocVector(vectype, 1);                                     \
-            vecaccess(res)[0] = vecaccess(val)[i];                             \
-        }                                                                      \
-        break;                                                                 \
-    }
-
-                SIMPLECASE(REALSXP, REAL);
-                SIMPLECASE(INTSXP, INTEGER);
-                SIMPLECASE(LGLSXP, LOGICAL);
-#undef SIMPLECASE
-
-            case VECSXP: {
-                res = VECTOR_ELT(val, i);
-                break;
-            }
-
-            default:
-                goto fallback;
-            }
-
-            R_Visible = TRUE;
+            res = extract21(c, pc, ctx, getenv());
             ostack_popn(ctx, 2);
             ostack_push(ctx, res);
             NEXT();
+        }
 
-        // ---------
-        fallback : {
-            SEXP args = CONS_NR(idx, R_NilValue);
-            args = CONS_NR(val, args);
-            ostack_push(ctx, args);
-            if (isObject(val)) {
-                SEXP call = getSrcAt(c, pc - 1, ctx);
-                res =
-                    dispatchApply(call, val, args, R_Subset2Sym, getenv(), ctx);
-                if (!res)
-                    res = do_subset2_dflt(call, R_Subset2Sym, args, getenv());
-            } else {
-                res = do_subset2_dflt(R_NilValue, R_Subset2Sym, args, getenv());
-            }
-            ostack_popn(ctx, 3);
-
-            R_Visible = TRUE;
+        INSTRUCTION(extract2_1_unchecked_) {
+            res = extract21Unchecked(ctx, getenv());
+            ostack_popn(ctx, 2);
             ostack_push(ctx, res);
             NEXT();
         }
+
+        INSTRUCTION(in_bounds_) {
+            SEXP vec = ostack_at(ctx, 2);
+            SEXP from = ostack_at(ctx, 1);
+            SEXP to = ostack_at(ctx, 0);
+            bool ok = inBounds(vec, from, to);
+            ostack_popn(ctx, 3);
+            ostack_push(ctx, ok ? R_TrueValue : R_FalseValue);
+            NEXT();
         }
 
         INSTRUCTION(extract2_2_) {
@@ -2374,6 +3995,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
                             if (target != R_NilValue && *pc == Opcode::stvar_ &&
                                 *(int*)(pc - sizeof(int)) == *(int*)(pc + 1)) {
                                 pc = pc + sizeof(int) + 1;
+                                SKIP_HANDLERS();
                                 if (NAMED(vec) == 0)
                                     SET_NAMED(vec, 1);
                             } else {
@@ -2415,19 +4037,19 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
             uint32_t deoptId = readImmediate();
             advanceImmediate();
             if (FRAME_CHANGED(getenv()) || FRAME_LEAKED(getenv())) {
-                Function* fun = c->function();
-                assert(fun->body() == c && "Cannot deopt from promise");
-                fun->deopt = true;
-                SEXP val = fun->origin();
-                Function* deoptFun = Function::unpack(val);
-                Code* deoptCode = deoptFun->body();
-                c = deoptCode;
-                pc = Deoptimizer_pc(deoptId);
-                PC_BOUNDSCHECK(pc, c);
+                ostack_push(ctx, getenv());
+                deopt(deoptId);
             }
             NEXT();
         }
 
+        INSTRUCTION(deopt_) {
+            uint32_t deoptId = readImmediate();
+            advanceImmediate();
+            deopt(deoptId);
+            NEXT();
+        }
+
         INSTRUCTION(seq_) {
             static SEXP prim = NULL;
             if (!prim) {
@@ -2482,49 +4104,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         }
 
         INSTRUCTION(colon_) {
-
-            SEXP lhs = ostack_at(ctx, 1);
-            SEXP rhs = ostack_at(ctx, 0);
-            res = NULL;
-
-            if (IS_SIMPLE_SCALAR(lhs, INTSXP)) {
-                int from = *INTEGER(lhs);
-                if (IS_SIMPLE_SCALAR(rhs, INTSXP)) {
-                    int to = *INTEGER(rhs);
-                    if (from != NA_INTEGER && to != NA_INTEGER) {
-                        res = seq_int(from, to);
-                    }
-                } else if (IS_SIMPLE_SCALAR(rhs, REALSXP)) {
-                    double to = *REAL(rhs);
-                    if (from != NA_INTEGER && to != NA_REAL && R_FINITE(to) &&
-                        INT_MIN <= to && INT_MAX >= to && to == (int)to) {
-                        res = seq_int(from, (int)to);
-                    }
-                }
-            } else if (IS_SIMPLE_SCALAR(lhs, REALSXP)) {
-                double from = *REAL(lhs);
-                if (IS_SIMPLE_SCALAR(rhs, INTSXP)) {
-                    int to = *INTEGER(rhs);
-                    if (from != NA_REAL && to != NA_INTEGER && R_FINITE(from) &&
-                        INT_MIN <= from && INT_MAX >= from &&
-                        from == (int)from) {
-                        res = seq_int((int)from, to);
-                    }
-                } else if (IS_SIMPLE_SCALAR(rhs, REALSXP)) {
-                    double to = *REAL(rhs);
-                    if (from != NA_REAL && to != NA_REAL && R_FINITE(from) &&
-                        R_FINITE(to) && INT_MIN <= from && INT_MAX >= from &&
-                        INT_MIN <= to && INT_MAX >= to && from == (int)from &&
-                        to == (int)to) {
-                        res = seq_int((int)from, (int)to);
-                    }
-                }
-            }
-
-            if (res == NULL) {
-                BINOP_FALLBACK(":");
-            }
-
+            res = colon(c, pc, ctx, getenv());
             ostack_popn(ctx, 2);
             ostack_push(ctx, res);
             NEXT();
@@ -2561,24 +4141,26 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
         }
 
         INSTRUCTION(for_seq_size_) {
-            SEXP seq = ostack_at(ctx, 0);
-            // TODO: we should extract the length just once at the begining of
-            // the loop and generally have somthing more clever here...
-            SEXP value = allocVector(INTSXP, 1);
-            if (isVector(seq)) {
-                INTEGER(value)[0] = LENGTH(seq);
-            } else if (isList(seq) || isNull(seq)) {
-                INTEGER(value)[0] = Rf_length(seq);
-            } else {
-                errorcall(R_NilValue, "invalid for() loop sequence");
-            }
-            // TODO: Even when the for loop sequence is an object, R won't
-            // dispatch on it. Since in RIR we use the normals extract2_1
-            // BC on it, we would. To prevent this we strip the object
-            // flag here. What we should do instead, is use a non-dispatching
-            // extract BC.
-            SET_OBJECT(seq, 0);
-            ostack_push(ctx, value);
+            res = forSeqSize(ostack_at(ctx, 0));
+            ostack_push(ctx, res);
+            NEXT();
+        }
+
+        INSTRUCTION(for_kernel_) {
+            SEXP kernel = readConst(ctx, readImmediate());
+            advanceImmediate();
+            res = VectorKernel::run(kernel, ostack_top(ctx), getenv());
+            ostack_push(ctx, res);
+            NEXT();
+        }
+
+        INSTRUCTION(call_intrinsic_) {
+            Intrinsic i = (Intrinsic)readImmediate();
+            advanceImmediate();
+            auto& info = Intrinsics::info(i);
+            res = callIntrinsic(i, ctx, info.hasEnv ? getenv() : nullptr);
+            ostack_popn(ctx, info.nargs);
+            ostack_push(ctx, res);
             NEXT();
         }
 
@@ -2647,6 +4229,7 @@ SEXP evalRirCode(Code* c, Context* ctx, SEXP* env,
                 if (s == CTXT_BREAK)
                     pc = pc + offset;
                 PC_BOUNDSCHECK(pc, c);
+                SYNC_HANDLERS();
             }
             NEXT();
         }
@@ -1,6 +1,9 @@
 #include "interp_context.h"
 #include "runtime.h"
 
+#include <cstdlib>
+#include <iostream>
+
 void initializeResizeableList(ResizeableList* l, size_t capacity, SEXP parent,
                               size_t index) {
     l->capacity = capacity;
@@ -18,12 +21,51 @@ SEXP setterPlaceholderSym;
 SEXP getterPlaceholderSym;
 SEXP quoteSym;
 
+// R allocates its node stack before librir is loaded. RIR_STACK_SIZE replaces
+// it by one of the requested size, which is only possible while nothing points
+// into it: when librir is loaded at startup, i.e. through EXTRA_LOAD_SO.
+static bool resizeNodeStack(long slots) {
+    if (R_BCNodeStackTop != R_BCNodeStackBase || R_GlobalContext->nextcontext)
+        return false;
+    size_t size = slots + STACK_RESERVE;
+    auto base = (R_bcstack_t*)malloc(size * sizeof(R_bcstack_t));
+    if (!base)
+        return false;
+    // The old stack is not freed, R might still refer to its base
+    R_BCNodeStackBase = R_BCNodeStackTop = base;
+    R_BCNodeStackEnd = base + size;
+    R_GlobalContext->nodestack = base;
+    return true;
+}
+
+static R_bcstack_t* stackLimit() {
+    if (const char* size = getenv("RIR_STACK_SIZE")) {
+        long slots = atol(size);
+        if (slots > 0 &&
+            (slots + STACK_RESERVE <= R_BCNodeStackEnd - R_BCNodeStackBase ||
+             resizeNodeStack(slots)))
+            return R_BCNodeStackBase + slots;
+        std::cerr << "RIR_STACK_SIZE=" << size << " ignored, the node stack "
+                  << "can only grow when librir is loaded at startup\n";
+    }
+    R_bcstack_t* limit = R_BCNodeStackEnd;
+    if (limit - R_BCNodeStackBase > 2 * STACK_RESERVE)
+        limit -= STACK_RESERVE;
+    return limit;
+}
+
+void ostack_overflow(Context* c) {
+    Rf_errorcall(R_NilValue, "operand stack overflow (%ld slots)",
+                 (long)(c->stackLimit - R_BCNodeStackBase));
+}
+
 Context* context_create(CompilerCallback compiler,
                         OptimizerCallback optimizer) {
     Context* c = new Context;
     c->list = Rf_allocVector(VECSXP, 2);
     c->optimizer = optimizer;
     c->compiler = compiler;
+    c->stackLimit = stackLimit();
     R_PreserveObject(c->list);
     initializeResizeableList(&c->cp, POOL_CAPACITY, c->list, CONTEXT_INDEX_CP);
     initializeResizeableList(&c->src, POOL_CAPACITY, c->list,
@@ -22,7 +22,8 @@ extern "C" {
 #endif
 
 #define POOL_CAPACITY 4096
-#define STACK_CAPACITY 4096
+// Slots at the end of R's node stack which are kept free for error handlers
+#define STACK_RESERVE 4096
 
 /** Resizeable R list.
 
@@ -54,6 +55,9 @@ typedef struct {
     ResizeableList src;
     CompilerCallback compiler;
     OptimizerCallback optimizer;
+    // End of the part of R's node stack the interpreter uses for its operand
+    // stack, see ostack_ensureSize
+    R_bcstack_t* stackLimit;
 } Context;
 
 // Some symbols
@@ -163,11 +167,58 @@ RIR_INLINE void rl_append(ResizeableList* l, SEXP val, SEXP parent,
     } while (0)
 #endif
 
+// Copies whole stack cells, such that unboxed values keep their tag
+#define ostack_push_cell(c, cell)                                              \
+    do {                                                                       \
+        R_bcstack_t tmp = (cell);                                              \
+        *R_BCNodeStackTop = tmp;                                               \
+        ++R_BCNodeStackTop;                                                    \
+    } while (0)
+
+// Unboxed int and real scalars (see unbox_ and box_). The typed node stack
+// stores them in the cell, the GC does not scan cells with a type tag.
+// Otherwise they stay boxed as scalars without attributes.
+#ifdef TYPED_STACK
+#define ostack_cell_type(cell) ((cell)->tag)
+#define ostack_cell_int(cell) ((cell)->u.ival)
+#define ostack_cell_real(cell) ((cell)->u.dval)
+#define ostack_push_int(c, v)                                                  \
+    do {                                                                       \
+        int tmp = (v);                                                         \
+        R_BCNodeStackTop->u.ival = tmp;                                        \
+        R_BCNodeStackTop->tag = INTSXP;                                        \
+        ++R_BCNodeStackTop;                                                    \
+    } while (0)
+#define ostack_push_real(c, v)                                                 \
+    do {                                                                       \
+        double tmp = (v);                                                      \
+        R_BCNodeStackTop->u.dval = tmp;                                        \
+        R_BCNodeStackTop->tag = REALSXP;                                       \
+        ++R_BCNodeStackTop;                                                    \
+    } while (0)
+#else
+#define ostack_cell_type(cell) TYPEOF(*(cell))
+#define ostack_cell_int(cell) (INTEGER(*(cell))[0])
+#define ostack_cell_real(cell) (REAL(*(cell))[0])
+#define ostack_push_int(c, v) ostack_push(c, Rf_ScalarInteger(v))
+#define ostack_push_real(c, v) ostack_push(c, Rf_ScalarReal(v))
+#endif
+
+// Signals the R error "operand stack overflow"
+void ostack_overflow(Context* c);
+
+/** The operand stack is R's node stack, which cannot move: stack args, Locals
+ and the contexts of R point into it. Every frame therefore reserves the
+ space for its locals and stack at entry, pushes are unchecked.
+
+ The limit is the end of R's node stack less STACK_RESERVE slots, such that
+ error handlers still find room. The environment variable RIR_STACK_SIZE sets
+ it to the given number of slots. To raise it, librir has to be loaded at
+ startup, where the node stack is reallocated.
+ */
 RIR_INLINE void ostack_ensureSize(Context* c, unsigned minFree) {
-    if ((R_BCNodeStackTop + minFree) >= R_BCNodeStackEnd) {
-        // TODO....
-        assert(false);
-    }
+    if ((R_BCNodeStackTop + minFree) >= c->stackLimit)
+        ostack_overflow(c);
 }
 
 class Locals final {
@@ -184,25 +235,11 @@ class Locals final {
 
     ~Locals() { R_BCNodeStackTop -= localsCount; }
 
-    SEXP load(unsigned offset) {
+    // Locals can also hold unboxed values, see ostack_push_cell
+    R_bcstack_t& cell(unsigned offset) {
         assert(offset < localsCount &&
-               "Attempt to load invalid local variable.");
-#ifdef TYPED_STACK
-        return (base + offset)->u.sxpval;
-#else
+               "Attempt to access invalid local variable.");
         return base[offset];
-#endif
-    }
-
-    void store(unsigned offset, SEXP val) {
-        assert(offset < localsCount &&
-               "Attempt to store invalid local variable.");
-#ifdef TYPED_STACK
-        (base + offset)->u.sxpval = val;
-        (base + offset)->tag = 0;
-#else
-        base[offset] = val;
-#endif
     }
 
     Locals(Locals const&) = delete;
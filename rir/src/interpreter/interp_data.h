@@ -17,6 +17,12 @@
 #  define THREADED_CODE
 #endif
 
+// Dispatches through a per function table of handler addresses, instead of
+// decoding the opcode and indexing the handler table of the interpreter
+#if defined(THREADED_CODE) && (! defined(NO_DIRECT_THREADED_CODE))
+#  define DIRECT_THREADED_CODE
+#endif
+
 typedef rir::Code Code;
 typedef rir::Function Function;
 typedef rir::DispatchTable DispatchTable;
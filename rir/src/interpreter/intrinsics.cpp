@@ -0,0 +1,29 @@
+#include "intrinsics.h"
+
+#include <cassert>
+
+namespace rir {
+
+namespace {
+enum class Access { None, Capture, Read, Write, Leak };
+}
+
+#define V(name, nargs, ...)                                                    \
+    static_assert(nargs <= Intrinsics::MaxArgs, "too many args for " #name);
+RIR_INTRINSICS(V)
+#undef V
+
+static const IntrinsicInfo table[] = {
+#define V(name, nargs, effect, access, result, args)                           \
+    {#name, nargs, Access::access != Access::None,                             \
+     [](const SEXP* a, SEXP env) -> SEXP { return intrinsic::name args; }},
+    RIR_INTRINSICS(V)
+#undef V
+};
+
+const IntrinsicInfo& Intrinsics::info(Intrinsic i) {
+    assert(i < Intrinsic::num_of);
+    return table[(size_t)i];
+}
+
+} // namespace rir
@@ -0,0 +1,61 @@
+#ifndef RIR_INTRINSICS_H
+#define RIR_INTRINSICS_H
+
+#include "R/r.h"
+#include "intrinsics_list.h"
+
+#include <cstdint>
+
+namespace rir {
+
+/*
+ * Typed runtime helpers for the common slow paths. They are called with their
+ * arguments on the stack, by the call_intrinsic_ instruction, the native code
+ * (see TemplateJit) and PIR (CallIntrinsic). Unlike an opaque call to a
+ * builtin, the effects of every intrinsic are known to the optimizer.
+ *
+ * The declarations below are annotated with the effects of the intrinsic
+ * (see Effect and EnvAccess in compiler/pir/instruction.h) and the PIR type
+ * of the result. intrinsics_list.h is generated from them by
+ *
+ *   python3 tools/intrinsicsGenerator.py rir/src/interpreter/intrinsics.h
+ *
+ * All arguments are SEXPs. An intrinsic accessing the environment takes it as
+ * its last argument `env`, which is not passed on the stack. The
+ * implementations are in interp.cpp.
+ */
+namespace intrinsic {
+
+//@intrinsic effect Error
+// vec[idx] of a vector without attributes, which does not dispatch
+SEXP subset1Plain(SEXP vec, SEXP idx);
+
+} // namespace intrinsic
+
+enum class Intrinsic : uint32_t {
+#define V(name, ...) name,
+    RIR_INTRINSICS(V)
+#undef V
+        num_of
+};
+
+// Calls the intrinsic with the stack arguments a and the env
+typedef SEXP (*IntrinsicInvoker)(const SEXP* a, SEXP env);
+
+struct IntrinsicInfo {
+    const char* name;
+    unsigned nargs;
+    bool hasEnv;
+    IntrinsicInvoker invoke;
+};
+
+class Intrinsics {
+  public:
+    static const unsigned MaxArgs = 2;
+
+    static const IntrinsicInfo& info(Intrinsic i);
+};
+
+} // namespace rir
+
+#endif
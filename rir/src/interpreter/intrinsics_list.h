@@ -0,0 +1,11 @@
+#ifndef RIR_INTRINSICS_LIST_H
+#define RIR_INTRINSICS_LIST_H
+
+// Generated by tools/intrinsicsGenerator.py from intrinsics.h, do not edit.
+//
+// V(name, nargs, effect, env, result, invokeArgs)
+
+#define RIR_INTRINSICS(V)                                                      \
+    V(subset1Plain, 2, Error, None, val, (a[0], a[1]))
+
+#endif
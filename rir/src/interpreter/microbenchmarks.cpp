@@ -0,0 +1,276 @@
+#include "microbenchmarks.h"
+#include "R/Protect.h"
+#include "R/RList.h"
+#include "R_ext/Parse.h"
+#include "api.h"
+#include "interpreter/interp.h"
+#include "interpreter/interp_context.h"
+#include "ir/BC.h"
+#include "ir/CodeStream.h"
+#include "utils/FunctionWriter.h"
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+extern "C" SEXP Rf_NewEnvironment(SEXP, SEXP, SEXP);
+
+namespace rir {
+
+namespace {
+
+struct Microbenchmark {
+    const char* opcode;
+    const char* operands;
+    // R code evaluated in the environment of the benchmark. Closures defined
+    // here are compiled to rir.
+    const char* setup;
+    // Pushes the `inputs` operands of the instruction
+    std::function<void(CodeStream&)> load;
+    size_t inputs;
+    // The instruction under test, leaving `outputs` values on the stack
+    std::function<void(CodeStream&)> instruction;
+    size_t outputs;
+};
+
+// Every code object executes the instruction that many times in straight
+// line code, to make the dispatch of evalRirCode negligible.
+const size_t Unroll = 100;
+
+SEXP sym(const char* name) { return Rf_install(name); }
+
+Microbenchmark binop(const char* opcode, const char* operands,
+                     const char* setup, BC (*op)()) {
+    return {opcode,
+            operands,
+            setup,
+            [](CodeStream& cs) {
+                cs << BC::ldvar(sym("a")) << BC::ldvar(sym("b"));
+            },
+            2,
+            [op](CodeStream& cs) { cs << op(); },
+            1};
+}
+
+// The operands are unboxed as part of the load
+Microbenchmark unboxedBinop(const char* opcode, const char* operands,
+                            const char* setup, uint32_t type, BC (*op)()) {
+    return {opcode,
+            operands,
+            setup,
+            [type](CodeStream& cs) {
+                cs << BC::ldvar(sym("a")) << BC::unbox(type)
+                   << BC::ldvar(sym("b")) << BC::unbox(type);
+            },
+            2,
+            [op](CodeStream& cs) { cs << op(); },
+            1};
+}
+
+Microbenchmark extract(const char* opcode, const char* operands,
+                       const char* setup, BC (*op)()) {
+    return {opcode,
+            operands,
+            setup,
+            [](CodeStream& cs) {
+                cs << BC::ldvar(sym("v")) << BC::ldvar(sym("i"));
+            },
+            2,
+            [op](CodeStream& cs) { cs << op(); },
+            1};
+}
+
+// The setup has to leave v unshared, e.g. by assigning an element of it,
+// otherwise the instruction measures copying v
+Microbenchmark subassign2(const char* operands, const char* setup) {
+    return {"subassign2_",
+            operands,
+            setup,
+            [](CodeStream& cs) {
+                cs << BC::ldvar(sym("v")) << BC::ldvar(sym("i"))
+                   << BC::ldvar(sym("x"));
+            },
+            3,
+            [](CodeStream& cs) { cs << BC::subassign2(sym("v")); },
+            1};
+}
+
+Microbenchmark call(const char* operands, const char* setup) {
+    // The benchmarks are rebuilt on every run, the ast is kept for good
+    static SEXP ast = nullptr;
+    if (!ast) {
+        ast = Rf_lang2(sym("f"), sym("x"));
+        R_PreserveObject(ast);
+    }
+    return {"call_",
+            operands,
+            setup,
+            [](CodeStream& cs) {
+                cs << BC::ldfun(sym("f")) << BC::ldvar(sym("x"));
+            },
+            2,
+            [ast](CodeStream& cs) { cs << BC::call(1, ast); },
+            1};
+}
+
+std::vector<Microbenchmark> benchmarks() {
+    static const char* scalars = "a <- 1L; b <- 2L";
+    static const char* doubles = "a <- 1.5; b <- 2.5";
+    static const char* mixed = "a <- 1L; b <- 2.5";
+    static const char* vectors = "a <- as.numeric(1:10); b <- a";
+    return {
+        {"push_", "integer", "", [](CodeStream&) {}, 0,
+         [](CodeStream& cs) { cs << BC::push(42); }, 1},
+        {"ldvar_", "integer", "x <- 1L", [](CodeStream&) {}, 0,
+         [](CodeStream& cs) { cs << BC::ldvar(sym("x")); }, 1},
+        {"ldvar_", "forced promise", "delayedAssign('x', 1L)",
+         [](CodeStream&) {}, 0,
+         [](CodeStream& cs) { cs << BC::ldvar(sym("x")); }, 1},
+        {"stvar_", "integer", "x <- 1L",
+         [](CodeStream& cs) { cs << BC::push(1); }, 1,
+         [](CodeStream& cs) { cs << BC::stvar(sym("x")); }, 0},
+        {"ldfun_", "closure", "f <- function(x) x", [](CodeStream&) {}, 0,
+         [](CodeStream& cs) { cs << BC::ldfun(sym("f")); }, 1},
+        {"ldfun_", "builtin", "", [](CodeStream&) {}, 0,
+         [](CodeStream& cs) { cs << BC::ldfun(sym("length")); }, 1},
+        binop("add_", "integer, integer", scalars, BC::add),
+        binop("add_", "double, double", doubles, BC::add),
+        binop("add_", "integer, double", mixed, BC::add),
+        binop("add_", "double[10], double[10]", vectors, BC::add),
+        binop("sub_", "double, double", doubles, BC::sub),
+        binop("mul_", "double, double", doubles, BC::mul),
+        binop("lt_", "integer, integer", scalars, BC::lt),
+        binop("lt_", "double, double", doubles, BC::lt),
+        binop("eq_", "integer, integer", scalars, BC::eq),
+        unboxedBinop("nadd_", "i32, i32", scalars, INTSXP, BC::nadd),
+        unboxedBinop("nadd_", "f64, f64", doubles, REALSXP, BC::nadd),
+        unboxedBinop("nlt_", "f64, f64", doubles, REALSXP, BC::nlt),
+        {"asbool_", "logical", "x <- TRUE",
+         [](CodeStream& cs) { cs << BC::ldvar(sym("x")); }, 1,
+         [](CodeStream& cs) { cs << BC::asbool(); }, 1},
+        {"length_", "double[10]", "x <- as.numeric(1:10)",
+         [](CodeStream& cs) { cs << BC::ldvar(sym("x")); }, 1,
+         [](CodeStream& cs) { cs << BC::length(); }, 1},
+        extract("extract1_1_", "double[10], integer",
+                "v <- as.numeric(1:10); i <- 3L", BC::extract1_1),
+        extract("extract2_1_", "double[10], integer",
+                "v <- as.numeric(1:10); i <- 3L", BC::extract2_1),
+        extract("extract2_1_", "double[10], double",
+                "v <- as.numeric(1:10); i <- 3", BC::extract2_1),
+        extract("extract2_1_", "integer[10], integer", "v <- 1:10; i <- 3L",
+                BC::extract2_1),
+        extract("extract2_1_", "list[10], integer",
+                "v <- as.list(1:10); i <- 3L", BC::extract2_1),
+        extract("extract2_1_", "named double[10], integer",
+                "v <- c(a = 1, b = 2, c = 3); i <- 3L", BC::extract2_1),
+        extract("extract2_1_unchecked_", "double[10], integer",
+                "v <- as.numeric(1:10); i <- 3L", BC::extract2_1Unchecked),
+        extract("extract2_1_unchecked_", "list[10], integer",
+                "v <- as.list(1:10); i <- 3L", BC::extract2_1Unchecked),
+        subassign2("double[10], integer, double",
+                   "v <- as.numeric(1:10); v[[1]] <- 1; i <- 3L; x <- 0.5"),
+        subassign2("integer[10], integer, integer",
+                   "v <- 1:10 + 0L; v[[1]] <- 1L; i <- 3L; x <- 7L"),
+        subassign2("list[10], integer, double",
+                   "v <- as.list(1:10); v[[1]] <- 1L; i <- 3L; x <- 0.5"),
+        call("rir closure", "f <- function(x) x; x <- 1"),
+        call("builtin", "f <- length; x <- 1"),
+        call("special", "f <- quote; x <- 1"),
+    };
+}
+
+SEXP setupEnvironment(const char* setup) {
+    Protect p;
+    SEXP env = p(Rf_NewEnvironment(R_NilValue, R_NilValue, R_GlobalEnv));
+
+    ParseStatus status;
+    SEXP str = p(Rf_mkString(setup));
+    SEXP exprs = p(R_ParseVector(str, -1, &status, R_NilValue));
+    if (status != PARSE_OK)
+        Rf_error("microbenchmark setup does not parse: %s", setup);
+    for (int i = 0; i < Rf_length(exprs); ++i)
+        Rf_eval(VECTOR_ELT(exprs, i), env);
+
+    SEXP names = p(R_lsInternal(env, TRUE));
+    for (int i = 0; i < Rf_length(names); ++i) {
+        SEXP name = Rf_install(CHAR(STRING_ELT(names, i)));
+        SEXP val = Rf_findVarInFrame(env, name);
+        if (TYPEOF(val) == CLOSXP)
+            Rf_defineVar(name, rir_compile(val, env), env);
+    }
+    return env;
+}
+
+// Executes `code` and returns the time per instruction in ns
+double measure(Code* code, SEXP env, size_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; ++i)
+        evalRirCode(code, globalContext(), &env, nullptr);
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() /
+           (iterations * Unroll);
+}
+
+double runBenchmark(const Microbenchmark& b, size_t iterations) {
+    Protect p;
+    SEXP env = p(setupEnvironment(b.setup));
+
+    auto compile = [&](bool withInstruction) {
+        FunctionWriter function = FunctionWriter::create();
+        CodeStream cs(function, R_NilValue);
+        for (size_t i = 0; i < Unroll; ++i) {
+            b.load(cs);
+            if (withInstruction)
+                b.instruction(cs);
+            for (size_t j = 0; j < (withInstruction ? b.outputs : b.inputs);
+                 ++j)
+                cs << BC::pop();
+        }
+        cs << BC::push(R_NilValue) << BC::ret();
+        cs.finalize(false, 0);
+        return p(function.function->container());
+    };
+    Code* full = Function::unpack(compile(true))->body();
+    Code* loads = Function::unpack(compile(false))->body();
+
+    // warm up (binding caches, inline caches, compilation of callees)
+    measure(full, env, iterations / 10 + 1);
+    measure(loads, env, iterations / 10 + 1);
+
+    double res =
+        measure(full, env, iterations) - measure(loads, env, iterations);
+    return res < 0 ? 0 : res;
+}
+
+} // namespace
+
+SEXP Microbenchmarks::run(size_t iterations, const std::string& filter) {
+    std::vector<Microbenchmark> selected;
+    for (auto& b : benchmarks())
+        if (std::string(b.opcode).find(filter) != std::string::npos)
+            selected.push_back(b);
+
+    Protect p;
+    size_t n = selected.size();
+    SEXP opcode = p(Rf_allocVector(STRSXP, n));
+    SEXP operands = p(Rf_allocVector(STRSXP, n));
+    SEXP ns = p(Rf_allocVector(REALSXP, n));
+    for (size_t i = 0; i < n; ++i) {
+        SET_STRING_ELT(opcode, i, Rf_mkChar(selected[i].opcode));
+        SET_STRING_ELT(operands, i, Rf_mkChar(selected[i].operands));
+        REAL(ns)[i] = runBenchmark(selected[i], iterations);
+    }
+
+    SEXP res = p(Rf_allocVector(VECSXP, 3));
+    SEXP names = p(Rf_allocVector(STRSXP, 3));
+    SET_VECTOR_ELT(res, 0, opcode);
+    SET_STRING_ELT(names, 0, Rf_mkChar("opcode"));
+    SET_VECTOR_ELT(res, 1, operands);
+    SET_STRING_ELT(names, 1, Rf_mkChar("operands"));
+    SET_VECTOR_ELT(res, 2, ns);
+    SET_STRING_ELT(names, 2, Rf_mkChar("ns"));
+    Rf_setAttrib(res, R_NamesSymbol, names);
+    return res;
+}
+
+} // namespace rir
@@ -0,0 +1,25 @@
+#ifndef RIR_MICROBENCHMARKS_H
+#define RIR_MICROBENCHMARKS_H
+
+#include "R/r.h"
+
+#include <string>
+
+namespace rir {
+
+/*
+ * Measures the cost of single interpreter instructions. Every benchmark is a
+ * synthetic code object, which executes the instruction under test many times
+ * on fixed operands. The cost of loading the operands is measured separately
+ * and subtracted.
+ */
+class Microbenchmarks {
+  public:
+    // Runs all benchmarks whose opcode contains `filter`. Returns a list with
+    // the columns opcode, operands and ns (per executed instruction).
+    static SEXP run(size_t iterations, const std::string& filter);
+};
+
+} // namespace rir
+
+#endif
@@ -0,0 +1,539 @@
+#include "template_jit.h"
+#include "interp.h"
+#include "ir/BC.h"
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+extern "C" Rboolean R_Visible;
+
+namespace rir {
+
+bool TemplateJit::enabled() {
+    static bool enabled = getenv("RIR_JIT") && *getenv("RIR_JIT") == '1';
+    return enabled;
+}
+
+NativeCode TemplateJit::native(Function* fun) {
+    SEXP native = fun->native();
+    if (!native) {
+        if (!enabled() || fun->invocationCount < Threshold)
+            return nullptr;
+        compile(fun);
+        native = fun->native();
+    }
+    if (TYPEOF(native) != EXTPTRSXP)
+        return nullptr;
+    return (NativeCode)((uintptr_t)R_ExternalPtrAddr(native) + sizeof(size_t));
+}
+
+#if defined(__x86_64__)
+
+namespace {
+
+enum Reg : uint8_t {
+    rax = 0,
+    rcx,
+    rdx,
+    rbx,
+    rsp,
+    rbp,
+    rsi,
+    rdi,
+    r8,
+    r9,
+    r10,
+    r11,
+    r12,
+    r13,
+};
+
+enum Xmm : uint8_t { xmm0 = 0 };
+
+// Just the encodings the templates need. All memory operands are
+// [base + disp32].
+class Assembler {
+  public:
+    std::vector<uint8_t> buf;
+
+    size_t pos() const { return buf.size(); }
+
+    void mov(Reg dst, uint64_t imm) {
+        rex(true, rax, dst);
+        byte(0xB8 + (dst & 7));
+        imm64(imm);
+    }
+
+    void mov(Reg dst, Reg src) {
+        rex(true, src, dst);
+        byte(0x89);
+        byte(0xC0 | ((src & 7) << 3) | (dst & 7));
+    }
+
+    void load(Reg dst, Reg base, int32_t disp) {
+        rex(true, dst, base);
+        byte(0x8B);
+        mem(dst, base, disp);
+    }
+
+    void store(Reg base, int32_t disp, Reg src) {
+        rex(true, src, base);
+        byte(0x89);
+        mem(src, base, disp);
+    }
+
+    void store32(Reg base, int32_t disp, int32_t imm) {
+        rex(false, rax, base);
+        byte(0xC7);
+        mem(rax, base, disp);
+        imm32(imm);
+    }
+
+    void cmp32(Reg base, int32_t disp, int32_t imm) {
+        rex(false, rax, base);
+        byte(0x81);
+        mem((Reg)7, base, disp);
+        imm32(imm);
+    }
+
+    void test8(Reg r) {
+        rex(false, r, r);
+        byte(0x84);
+        byte(0xC0 | ((r & 7) << 3) | (r & 7));
+    }
+
+    // Scalar double ops, op is the second opcode byte (0x10 load, 0x11
+    // store, 0x58 add, 0x59 mul, 0x5C sub)
+    void sd(uint8_t op, Xmm x, Reg base, int32_t disp) {
+        byte(0xF2);
+        rex(false, (Reg)x, base);
+        byte(0x0F);
+        byte(op);
+        mem((Reg)x, base, disp);
+    }
+
+    void add(Reg dst, int32_t imm) {
+        rex(true, rax, dst);
+        byte(0x81);
+        byte(0xC0 | (dst & 7));
+        imm32(imm);
+    }
+
+    void sub(Reg dst, int32_t imm) {
+        rex(true, rax, dst);
+        byte(0x81);
+        byte(0xE8 | (dst & 7));
+        imm32(imm);
+    }
+
+    void cmp(Reg a, Reg b) {
+        rex(true, b, a);
+        byte(0x39);
+        byte(0xC0 | ((b & 7) << 3) | (a & 7));
+    }
+
+    void call(Reg target) {
+        rex(false, rax, target);
+        byte(0xFF);
+        byte(0xD0 | (target & 7));
+    }
+
+    void push(Reg r) {
+        rex(false, rax, r);
+        byte(0x50 + (r & 7));
+    }
+
+    void pop(Reg r) {
+        rex(false, rax, r);
+        byte(0x58 + (r & 7));
+    }
+
+    void ret() { byte(0xC3); }
+
+    // Jumps return the position of their rel32, to be patched later
+    size_t jmp() {
+        byte(0xE9);
+        imm32(0);
+        return pos() - 4;
+    }
+
+    size_t je() { return jcc(0x84); }
+
+    size_t jne() { return jcc(0x85); }
+
+    void patch(size_t at, size_t target) {
+        int32_t rel = target - (at + 4);
+        memcpy(&buf[at], &rel, sizeof(rel));
+    }
+
+  private:
+    void byte(uint8_t b) { buf.push_back(b); }
+
+    size_t jcc(uint8_t cc) {
+        byte(0x0F);
+        byte(cc);
+        imm32(0);
+        return pos() - 4;
+    }
+
+    void imm32(int32_t v) {
+        uint8_t b[4];
+        memcpy(b, &v, sizeof(v));
+        buf.insert(buf.end(), b, b + 4);
+    }
+
+    void imm64(uint64_t v) {
+        uint8_t b[8];
+        memcpy(b, &v, sizeof(v));
+        buf.insert(buf.end(), b, b + 8);
+    }
+
+    void rex(bool wide, Reg reg, Reg base) {
+        uint8_t r = (wide << 3) | ((reg >> 3) << 2) | (base >> 3);
+        if (r)
+            byte(0x40 | r);
+    }
+
+    void mem(Reg reg, Reg base, int32_t disp) {
+        byte(0x80 | ((reg & 7) << 3) | (base & 7));
+        if ((base & 7) == rsp)
+            byte(0x24);
+        imm32(disp);
+    }
+};
+
+// Layout of the node stack cells (see ostack_push in interp_context.h)
+#ifdef TYPED_STACK
+const int32_t CellSize = sizeof(R_bcstack_t);
+const int32_t ValueOffset = offsetof(R_bcstack_t, u);
+const int32_t TagOffset = offsetof(R_bcstack_t, tag);
+#else
+const int32_t CellSize = sizeof(R_bcstack_t);
+const int32_t ValueOffset = 0;
+#endif
+static_assert(CellSize % 8 == 0, "stack cells are copied by words");
+
+// Register usage: rbx holds the JitFrame, r12 the address of the stack top,
+// r13 the locals, rax, rcx, rdx and xmm0 are scratch.
+class Templates {
+  public:
+    Assembler a;
+
+    void prologue() {
+        // three pushes keep rsp 16 byte aligned for the calls
+        a.push(rbx);
+        a.push(r12);
+        a.push(r13);
+        a.mov(rbx, rdi);
+        a.mov(r12, (uintptr_t)&R_BCNodeStackTop);
+        a.load(r13, rbx, offsetof(JitFrame, locals));
+    }
+
+    void epilogue() {
+        a.pop(r13);
+        a.pop(r12);
+        a.pop(rbx);
+        a.ret();
+    }
+
+    void push(SEXP val) {
+        loadTop();
+        a.mov(rcx, (uintptr_t)val);
+        a.mov(rdx, 0);
+        for (int32_t w = 0; w < CellSize; w += 8)
+            a.store(rax, w, w == ValueOffset ? rcx : rdx);
+        adjustTop(1);
+        visible(true);
+    }
+
+    void pop() {
+        loadTop();
+        adjustTop(-1);
+    }
+
+    // Copies the cell at depth i (0 is the top) on top of the stack
+    void pull(int32_t i) {
+        loadTop();
+        copyCell(-(i + 1) * CellSize, 0);
+        adjustTop(1);
+    }
+
+    void swap() {
+        loadTop();
+        for (int32_t w = 0; w < CellSize; w += 8) {
+            a.load(rcx, rax, w - CellSize);
+            a.load(rdx, rax, w - 2 * CellSize);
+            a.store(rax, w - CellSize, rdx);
+            a.store(rax, w - 2 * CellSize, rcx);
+        }
+    }
+
+    void ldloc(int32_t i) {
+        loadTop();
+        for (int32_t w = 0; w < CellSize; w += 8) {
+            a.load(rcx, r13, i * CellSize + w);
+            a.store(rax, w, rcx);
+        }
+        adjustTop(1);
+    }
+
+    void stloc(int32_t i) {
+        loadTop();
+        for (int32_t w = 0; w < CellSize; w += 8) {
+            a.load(rcx, rax, w - CellSize);
+            a.store(r13, i * CellSize + w, rcx);
+        }
+        adjustTop(-1);
+    }
+
+    void movloc(int32_t target, int32_t source) {
+        for (int32_t w = 0; w < CellSize; w += 8) {
+            a.load(rcx, r13, source * CellSize + w);
+            a.store(r13, target * CellSize + w, rcx);
+        }
+    }
+
+#ifdef TYPED_STACK
+    // Unboxed doubles are combined in a register, ints (which need an
+    // overflow check) go to the helper
+    void unboxedBinop(uint8_t op, JitHelper slowPath, Opcode* pc) {
+        loadTop();
+        a.cmp32(rax, TagOffset - 2 * CellSize, REALSXP);
+        size_t slow = a.jne();
+        a.sd(0x10, xmm0, rax, ValueOffset - 2 * CellSize);
+        a.sd(op, xmm0, rax, ValueOffset - CellSize);
+        a.sd(0x11, xmm0, rax, ValueOffset - 2 * CellSize);
+        adjustTop(-1);
+        size_t done = a.jmp();
+        a.patch(slow, a.pos());
+        helper(slowPath, pc);
+        a.patch(done, a.pos());
+    }
+#endif
+
+    // Leaves the native code with the result on top of the stack, if the exit
+    // is taken
+    void exit(JitExit e, Opcode* pc) {
+        helper((JitHelper)e, pc);
+        a.test8(rax);
+        size_t stay = a.je();
+        ret();
+        a.patch(stay, a.pos());
+    }
+
+    void visible(bool v) {
+        a.mov(rcx, (uintptr_t)&R_Visible);
+        a.store32(rcx, 0, v);
+    }
+
+    // Pops the top of stack and jumps if it is `val`
+    size_t branchIf(SEXP val) {
+        popValue();
+        a.mov(rcx, (uintptr_t)val);
+        a.cmp(rax, rcx);
+        return a.je();
+    }
+
+    size_t branch() { return a.jmp(); }
+
+    void ret() {
+        popValue();
+        epilogue();
+    }
+
+    void helper(JitHelper h, Opcode* pc) {
+        a.mov(rdi, rbx);
+        a.mov(rsi, (uintptr_t)pc);
+        a.mov(rax, (uintptr_t)h);
+        a.call(rax);
+    }
+
+  private:
+    void loadTop() { a.load(rax, r12, 0); }
+
+    // The stack top is in rax
+    void adjustTop(int32_t cells) {
+        if (cells > 0)
+            a.add(rax, cells * CellSize);
+        else
+            a.sub(rax, -cells * CellSize);
+        a.store(r12, 0, rax);
+    }
+
+    void copyCell(int32_t from, int32_t to) {
+        for (int32_t w = 0; w < CellSize; w += 8) {
+            a.load(rcx, rax, from + w);
+            a.store(rax, to + w, rcx);
+        }
+    }
+
+    // Pops the top of stack into rax
+    void popValue() {
+        loadTop();
+        adjustTop(-1);
+        a.load(rax, rax, ValueOffset);
+    }
+};
+
+bool inlined(Opcode op) {
+    switch (op) {
+    case Opcode::nop_:
+    case Opcode::push_:
+    case Opcode::pop_:
+    case Opcode::dup_:
+    case Opcode::pull_:
+    case Opcode::swap_:
+    case Opcode::br_:
+    case Opcode::brtrue_:
+    case Opcode::brfalse_:
+    case Opcode::visible_:
+    case Opcode::invisible_:
+    case Opcode::ret_:
+    case Opcode::ldloc_:
+    case Opcode::stloc_:
+    case Opcode::movloc_:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void freeNative(SEXP ptr) {
+    void* mem = R_ExternalPtrAddr(ptr);
+    if (!mem)
+        return;
+    munmap(mem, *(size_t*)mem);
+    R_ClearExternalPtr(ptr);
+}
+
+// Copies the code into executable memory, which starts with its size
+SEXP install(const std::vector<uint8_t>& code) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t size = (sizeof(size_t) + code.size() + page - 1) / page * page;
+    void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED)
+        return nullptr;
+    *(size_t*)mem = size;
+    memcpy((uint8_t*)mem + sizeof(size_t), code.data(), code.size());
+    if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(mem, size);
+        return nullptr;
+    }
+    SEXP ptr = R_MakeExternalPtr(mem, R_NilValue, R_NilValue);
+    R_RegisterCFinalizer(ptr, freeNative);
+    return ptr;
+}
+
+} // namespace
+
+bool TemplateJit::compile(Function* fun) {
+    Code* c = fun->body();
+    fun->native(R_NilValue);
+    for (Opcode* pc = c->code(); pc < c->endCode(); pc += BC::size(pc))
+        if (!inlined(*pc) && !helper(*pc) && !exit(*pc))
+            return false;
+
+    Templates t;
+    std::unordered_map<Opcode*, size_t> labels;
+    std::vector<std::pair<size_t, Opcode*>> jumps;
+
+    t.prologue();
+    Opcode* pc = c->code();
+    while (pc < c->endCode()) {
+        labels[pc] = t.a.pos();
+        BC bc = BC::decode(pc);
+        switch (bc.bc) {
+        case Opcode::nop_:
+            break;
+        case Opcode::push_:
+            t.push(cp_pool_at(globalContext(), bc.immediate.pool));
+            break;
+        case Opcode::pop_:
+            t.pop();
+            break;
+        case Opcode::dup_:
+            t.pull(0);
+            break;
+        case Opcode::pull_:
+            t.pull(bc.immediate.i);
+            break;
+        case Opcode::swap_:
+            t.swap();
+            break;
+        case Opcode::br_:
+            jumps.push_back({t.branch(), BC::jmpTarget(pc)});
+            break;
+        case Opcode::brtrue_:
+            jumps.push_back({t.branchIf(R_TrueValue), BC::jmpTarget(pc)});
+            break;
+        case Opcode::brfalse_:
+            jumps.push_back({t.branchIf(R_FalseValue), BC::jmpTarget(pc)});
+            break;
+        case Opcode::visible_:
+            t.visible(true);
+            break;
+        case Opcode::invisible_:
+            t.visible(false);
+            break;
+        case Opcode::ret_:
+            t.ret();
+            break;
+        case Opcode::ldloc_:
+            t.ldloc(bc.immediate.loc);
+            break;
+        case Opcode::stloc_:
+            t.stloc(bc.immediate.loc);
+            break;
+        case Opcode::movloc_:
+            t.movloc(bc.immediate.loc_cpy.target, bc.immediate.loc_cpy.source);
+            break;
+#ifdef TYPED_STACK
+        case Opcode::nadd_:
+            t.unboxedBinop(0x58, helper(bc.bc), pc + 1);
+            break;
+        case Opcode::nsub_:
+            t.unboxedBinop(0x5C, helper(bc.bc), pc + 1);
+            break;
+        case Opcode::nmul_:
+            t.unboxedBinop(0x59, helper(bc.bc), pc + 1);
+            break;
+#endif
+        case Opcode::deopt_:
+        case Opcode::guard_env_:
+            t.exit(exit(bc.bc), pc + 1);
+            break;
+        default:
+            t.helper(helper(bc.bc), pc + 1);
+            break;
+        }
+        pc += bc.size();
+    }
+    for (auto& j : jumps)
+        t.a.patch(j.first, labels.at(j.second));
+
+    SEXP native = install(t.a.buf);
+    if (!native)
+        return false;
+    fun->native(native);
+    return true;
+}
+
+#else
+
+bool TemplateJit::compile(Function* fun) {
+    fun->native(R_NilValue);
+    return false;
+}
+
+#endif
+
+} // namespace rir
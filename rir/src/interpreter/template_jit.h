@@ -0,0 +1,78 @@
+#ifndef RIR_TEMPLATE_JIT_H
+#define RIR_TEMPLATE_JIT_H
+
+#include "interp_context.h"
+#include "ir/BC_inc.h"
+#include "runtime/Function.h"
+
+struct CallContext;
+
+namespace rir {
+
+// The state of a native frame. The native code keeps a pointer to it in a
+// callee saved register and passes it on to the helpers.
+struct JitFrame {
+    Code* code;
+    Context* ctx;
+    SEXP* env;
+    const CallContext* callCtxt;
+    void* bindingCache;
+    R_bcstack_t* locals;
+};
+
+typedef SEXP (*NativeCode)(JitFrame*);
+
+// Runs one instruction, pc points after the opcode (as in the interpreter)
+typedef void (*JitHelper)(JitFrame*, Opcode* pc);
+
+// Like a helper, but may leave the native code (e.g. for deoptimization). In
+// that case the rest of the frame ran in the interpreter, its result is on
+// top of the stack and true is returned.
+typedef bool (*JitExit)(JitFrame*, Opcode* pc);
+
+/*
+ * A baseline template JIT for x86-64. The body of a Function is translated
+ * instruction by instruction into machine code: stack shuffling, constants,
+ * branches and visibility are stitched together from small templates, which
+ * operate directly on the node stack. Every other instruction becomes a call
+ * to a helper, which shares its implementation with the interpreter (see
+ * TemplateJit::helper in interp.cpp). The native code uses the same node
+ * stack, binding cache and bytecode (for immediates, feedback and sources) as
+ * the interpreter, it only removes the dispatch.
+ *
+ * Bodies with instructions without template or helper (e.g. loop contexts)
+ * are not compiled and keep running in the interpreter.
+ *
+ * Optimized code (the output of Pir2Rir) additionally keeps its locals on the
+ * node stack, unboxed arithmetic on doubles is done in registers and deopt_
+ * and guard_env_ exit to the baseline code in the interpreter.
+ *
+ * The JIT is disabled by default, RIR_JIT=1 compiles every baseline body after
+ * Threshold invocations.
+ */
+class TemplateJit {
+  public:
+    static const unsigned Threshold = 2;
+
+    static bool enabled();
+
+    // Compiles the body of fun and installs the native code in fun. Returns
+    // false if the body has to stay in the interpreter.
+    static bool compile(Function* fun);
+
+    // The native code of the body of fun, compiling it if due. nullptr if fun
+    // runs in the interpreter.
+    static NativeCode native(Function* fun);
+
+    // The helper of an instruction, nullptr if the instruction is not
+    // supported by native code. Defined in interp.cpp.
+    static JitHelper helper(Opcode op);
+
+    // The exit of an instruction, nullptr if it has none. Defined in
+    // interp.cpp.
+    static JitExit exit(Opcode op);
+};
+
+} // namespace rir
+
+#endif
@@ -0,0 +1,356 @@
+#include "vector_kernel.h"
+#include "R/Protect.h"
+#include "R/Symbols.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+namespace rir {
+
+// The kernel is a VECSXP with the target symbol, the program (an INTSXP of
+// opcode, argument pairs in postfix order), the double constants and the
+// symbols of the variables the program loads.
+enum Slot { Target, Program, Constants, Operands, NumSlots };
+
+enum class KernelOp : int {
+    Constant, // push constants[arg]
+    Scalar,   // push the value of the scalar operands[arg]
+    Element,  // push operands[arg][i]
+    Neg,
+    Add,
+    Sub,
+    Mul,
+    Div,
+};
+
+static const int MaxDepth = 8;
+static const R_xlen_t BlockSize = 256;
+
+// The call has n arguments, which are not named, missing or dots
+static bool plainArgs(SEXP call, int n) {
+    int i = 0;
+    for (SEXP a = CDR(call); a != R_NilValue; a = CDR(a), ++i) {
+        if (TAG(a) != R_NilValue || CAR(a) == R_MissingArg ||
+            CAR(a) == R_DotsSymbol)
+            return false;
+    }
+    return i == n;
+}
+
+static bool isVariable(SEXP e, SEXP loopVar) {
+    return TYPEOF(e) == SYMSXP && e != loopVar && e != R_DotsSymbol &&
+           e != R_MissingArg && !DDVAL(e) && strlen(CHAR(PRINTNAME(e)));
+}
+
+namespace {
+
+class Recognizer {
+  public:
+    std::vector<int> program;
+    std::vector<double> constants;
+    std::vector<SEXP> operands;
+
+    Recognizer(SEXP loopVar, SEXP target, std::vector<SEXP>& primitives)
+        : loopVar(loopVar), target(target), primitives(primitives) {}
+
+    bool expr(SEXP e) {
+        switch (TYPEOF(e)) {
+        case REALSXP:
+            if (XLENGTH(e) != 1 || ATTRIB(e) != R_NilValue)
+                return false;
+            constants.push_back(REAL(e)[0]);
+            return load(KernelOp::Constant, constants.size() - 1);
+        case SYMSXP:
+            // The target is a vector, it can only be used as y[i]
+            if (!isVariable(e, loopVar) || e == target)
+                return false;
+            return load(KernelOp::Scalar, operand(e));
+        case LANGSXP:
+            break;
+        default:
+            return false;
+        }
+
+        SEXP fun = CAR(e);
+        if (fun == symbol::Parenthesis && plainArgs(e, 1)) {
+            primitives.push_back(fun);
+            return expr(CADR(e));
+        }
+
+        if (fun == symbol::Bracket && plainArgs(e, 2)) {
+            if (!isVariable(CADR(e), loopVar) || CADDR(e) != loopVar)
+                return false;
+            primitives.push_back(fun);
+            return load(KernelOp::Element, operand(CADR(e)));
+        }
+
+        if ((fun == symbol::Add || fun == symbol::Sub) && plainArgs(e, 1)) {
+            primitives.push_back(fun);
+            if (!expr(CADR(e)))
+                return false;
+            if (fun == symbol::Sub)
+                emit(KernelOp::Neg, 0);
+            return true;
+        }
+
+        KernelOp op;
+        if (fun == symbol::Add)
+            op = KernelOp::Add;
+        else if (fun == symbol::Sub)
+            op = KernelOp::Sub;
+        else if (fun == symbol::Mul)
+            op = KernelOp::Mul;
+        else if (fun == symbol::Div)
+            op = KernelOp::Div;
+        else
+            return false;
+        if (!plainArgs(e, 2))
+            return false;
+
+        primitives.push_back(fun);
+        if (!expr(CADR(e)) || !expr(CADDR(e)))
+            return false;
+        emit(op, 0);
+        depth--;
+        return true;
+    }
+
+  private:
+    SEXP loopVar;
+    SEXP target;
+    std::vector<SEXP>& primitives;
+    int depth = 0;
+
+    void emit(KernelOp op, int arg) {
+        program.push_back((int)op);
+        program.push_back(arg);
+    }
+
+    bool load(KernelOp op, int arg) {
+        if (++depth > MaxDepth)
+            return false;
+        emit(op, arg);
+        return true;
+    }
+
+    int operand(SEXP sym) {
+        auto o = std::find(operands.begin(), operands.end(), sym);
+        if (o != operands.end())
+            return o - operands.begin();
+        operands.push_back(sym);
+        return operands.size() - 1;
+    }
+};
+
+} // namespace
+
+SEXP VectorKernel::compile(SEXP sym, SEXP seq, SEXP body,
+                           std::vector<SEXP>& primitives) {
+    // The range is contiguous, `:` itself is guarded by the compiled seq
+    if (TYPEOF(seq) != LANGSXP || CAR(seq) != symbol::Colon ||
+        !plainArgs(seq, 2))
+        return nullptr;
+
+    std::vector<SEXP> used;
+    while (TYPEOF(body) == LANGSXP && CAR(body) == symbol::Block &&
+           plainArgs(body, 1)) {
+        used.push_back(symbol::Block);
+        body = CADR(body);
+    }
+
+    // y[i] <- expr
+    if (TYPEOF(body) != LANGSXP ||
+        (CAR(body) != symbol::Assign && CAR(body) != symbol::Assign2) ||
+        !plainArgs(body, 2))
+        return nullptr;
+    used.push_back(CAR(body));
+    SEXP lhs = CADR(body);
+    if (TYPEOF(lhs) != LANGSXP || CAR(lhs) != symbol::Bracket ||
+        !plainArgs(lhs, 2) || CADDR(lhs) != sym)
+        return nullptr;
+    SEXP target = CADR(lhs);
+    if (!isVariable(target, sym))
+        return nullptr;
+    used.push_back(symbol::AssignBracket);
+
+    Recognizer r(sym, target, used);
+    if (!r.expr(CADDR(body)))
+        return nullptr;
+
+    Protect p;
+    SEXP kernel = p(Rf_allocVector(VECSXP, NumSlots));
+    SET_VECTOR_ELT(kernel, Target, target);
+
+    SEXP program = Rf_allocVector(INTSXP, r.program.size());
+    SET_VECTOR_ELT(kernel, Program, program);
+    std::copy(r.program.begin(), r.program.end(), INTEGER(program));
+
+    SEXP constants = Rf_allocVector(REALSXP, r.constants.size());
+    SET_VECTOR_ELT(kernel, Constants, constants);
+    std::copy(r.constants.begin(), r.constants.end(), REAL(constants));
+
+    SEXP operands = Rf_allocVector(VECSXP, r.operands.size());
+    SET_VECTOR_ELT(kernel, Operands, operands);
+    for (size_t i = 0; i < r.operands.size(); ++i)
+        SET_VECTOR_ELT(operands, i, r.operands[i]);
+
+    for (auto f : used)
+        if (std::find(primitives.begin(), primitives.end(), f) ==
+            primitives.end())
+            primitives.push_back(f);
+    return kernel;
+}
+
+SEXP VectorKernel::target(SEXP kernel) {
+    return VECTOR_ELT(kernel, Target);
+}
+
+// The value of sym, as long as it can be read without side effects, i.e. it is
+// not an active binding or a promise, which is not forced yet. `local` is set
+// if the value is bound directly in env.
+static SEXP lookup(SEXP sym, SEXP env, bool& local) {
+    for (SEXP rho = env; rho != R_EmptyEnv; rho = ENCLOS(rho)) {
+        if (!R_existsVarInFrame(rho, sym))
+            continue;
+        if (R_BindingIsActive(sym, rho))
+            return nullptr;
+        SEXP val = Rf_findVarInFrame(rho, sym);
+        local = rho == env;
+        if (TYPEOF(val) == PROMSXP) {
+            local = false;
+            val = PRVALUE(val);
+        }
+        if (val == R_UnboundValue || val == R_MissingArg)
+            return nullptr;
+        return val;
+    }
+    return nullptr;
+}
+
+static bool isPlainDoubles(SEXP v) {
+    return TYPEOF(v) == REALSXP && ATTRIB(v) == R_NilValue;
+}
+
+SEXP VectorKernel::run(SEXP kernel, SEXP seq, SEXP env) {
+    if (TYPEOF(env) != ENVSXP ||
+        (TYPEOF(seq) != INTSXP && TYPEOF(seq) != REALSXP) ||
+        ATTRIB(seq) != R_NilValue || XLENGTH(seq) == 0)
+        return R_NilValue;
+
+    // The loop covers the indices [from, to) of all vectors
+    R_xlen_t n = XLENGTH(seq);
+    double first, last;
+    if (TYPEOF(seq) == INTSXP) {
+        if (INTEGER(seq)[0] == NA_INTEGER || INTEGER(seq)[n - 1] == NA_INTEGER)
+            return R_NilValue;
+        first = INTEGER(seq)[0];
+        last = INTEGER(seq)[n - 1];
+    } else {
+        first = REAL(seq)[0];
+        last = REAL(seq)[n - 1];
+        if (first != std::floor(first))
+            return R_NilValue;
+    }
+    if (first < 1 || last != first + (n - 1) || last > R_XLEN_T_MAX)
+        return R_NilValue;
+    R_xlen_t from = first - 1;
+    R_xlen_t to = last;
+
+    SEXP operands = VECTOR_ELT(kernel, Operands);
+    std::vector<SEXP> values(XLENGTH(operands));
+    for (size_t i = 0; i < values.size(); ++i) {
+        bool local;
+        values[i] = lookup(VECTOR_ELT(operands, i), env, local);
+        if (!values[i] || !isPlainDoubles(values[i]))
+            return R_NilValue;
+    }
+
+    SEXP program = VECTOR_ELT(kernel, Program);
+    const int* code = INTEGER(program);
+    R_xlen_t length = XLENGTH(program);
+    for (R_xlen_t pc = 0; pc < length; pc += 2) {
+        KernelOp op = (KernelOp)code[pc];
+        SEXP v = values[code[pc + 1]];
+        if ((op == KernelOp::Scalar && XLENGTH(v) != 1) ||
+            (op == KernelOp::Element && XLENGTH(v) < to))
+            return R_NilValue;
+    }
+
+    // Like y[i] <- v, the target is updated in place if it is a local
+    // variable, which is not shared. Otherwise it is copied and the copy is
+    // then bound locally.
+    Protect p;
+    SEXP sym = VECTOR_ELT(kernel, Target);
+    bool local = false;
+    SEXP y = lookup(sym, env, local);
+    if (!y || !isPlainDoubles(y) || XLENGTH(y) < to ||
+        (local && R_BindingIsLocked(sym, env)))
+        return R_NilValue;
+    // Alias check: the other operands must not see the updates
+    bool aliased = false;
+    for (size_t i = 0; i < values.size(); ++i)
+        if (values[i] == y && VECTOR_ELT(operands, i) != sym)
+            aliased = true;
+    if (!local || aliased || MAYBE_SHARED(y))
+        y = p(Rf_duplicate(y));
+
+    const double* constants = REAL(VECTOR_ELT(kernel, Constants));
+    double* out = REAL(y);
+    double buffers[MaxDepth][BlockSize];
+    const double* stack[MaxDepth];
+
+    for (R_xlen_t b = from; b < to; b += BlockSize) {
+        R_xlen_t len = std::min(BlockSize, to - b);
+        int sp = 0;
+        for (R_xlen_t pc = 0; pc < length; pc += 2) {
+            int arg = code[pc + 1];
+            switch ((KernelOp)code[pc]) {
+            case KernelOp::Constant:
+                std::fill(buffers[sp], buffers[sp] + len, constants[arg]);
+                stack[sp] = buffers[sp];
+                sp++;
+                break;
+            case KernelOp::Scalar:
+                std::fill(buffers[sp], buffers[sp] + len, REAL(values[arg])[0]);
+                stack[sp] = buffers[sp];
+                sp++;
+                break;
+            case KernelOp::Element:
+                stack[sp++] = REAL(values[arg]) + b;
+                break;
+            case KernelOp::Neg: {
+                const double* a = stack[sp - 1];
+                double* r = buffers[sp - 1];
+                for (R_xlen_t j = 0; j < len; ++j)
+                    r[j] = -a[j];
+                stack[sp - 1] = r;
+                break;
+            }
+#define BINOP(Op, op)                                                          \
+    case KernelOp::Op: {                                                       \
+        const double* a = stack[sp - 2];                                       \
+        const double* c = stack[sp - 1];                                       \
+        double* r = buffers[sp - 2];                                           \
+        for (R_xlen_t j = 0; j < len; ++j)                                     \
+            r[j] = a[j] op c[j];                                               \
+        stack[sp - 2] = r;                                                     \
+        sp--;                                                                  \
+        break;                                                                 \
+    }
+                BINOP(Add, +);
+                BINOP(Sub, -);
+                BINOP(Mul, *);
+                BINOP(Div, /);
+#undef BINOP
+            }
+        }
+        assert(sp == 1);
+        if (stack[0] != out + b)
+            memcpy(out + b, stack[0], len * sizeof(double));
+    }
+    return y;
+}
+
+} // namespace rir
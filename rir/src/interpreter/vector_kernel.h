@@ -0,0 +1,45 @@
+#ifndef RIR_VECTOR_KERNEL_H
+#define RIR_VECTOR_KERNEL_H
+
+#include "R/r.h"
+
+#include <vector>
+
+namespace rir {
+
+/*
+ * Element-wise for loops, i.e.
+ *
+ *   for (i in lo:hi) y[i] <- a * x[i] + y[i]
+ *
+ * where the right hand side is built from double constants, scalar variables,
+ * elements x[i] of vectors at the loop index and the operators + - * / and
+ * unary minus. Since every iteration only reads and writes index i, the loop
+ * can be evaluated as a whole. The kernel evaluates the expression blockwise
+ * into buffers, with one tight loop per operator, and stores the result into
+ * y.
+ *
+ * The kernel only runs if all vectors are plain doubles without attributes,
+ * covering the whole range of the loop, and the variables are bound to values
+ * (unforced promises and active bindings are not touched). Otherwise the
+ * compiler falls back to the scalar loop.
+ */
+class VectorKernel {
+  public:
+    // The kernel for `for (sym in seq) body`, nullptr if the loop is not
+    // element-wise. `primitives` are the symbols of the functions, which are
+    // assumed to be the builtin primitives.
+    static SEXP compile(SEXP sym, SEXP seq, SEXP body,
+                        std::vector<SEXP>& primitives);
+
+    // Runs the loop over `seq` in `env`. Returns the new value of the target
+    // vector (which might be the old one, updated in place) or R_NilValue if
+    // the scalar loop has to run instead.
+    static SEXP run(SEXP kernel, SEXP seq, SEXP env);
+
+    static SEXP target(SEXP kernel);
+};
+
+} // namespace rir
+
+#endif
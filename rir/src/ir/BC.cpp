@@ -9,8 +9,7 @@
 #include "R/Printing.h"
 #include "R/RList.h"
 #include "R/r.h"
-
-#include "interpreter/deoptimizer.h"
+#include "interpreter/vector_kernel.h"
 
 namespace rir {
 
@@ -26,13 +25,16 @@ void BC::write(CodeStream& cs) const {
     case Opcode::ldvar_noforce_super_:
     case Opcode::ldlval_:
     case Opcode::stvar_:
+    case Opcode::starg_:
     case Opcode::stvar_super_:
     case Opcode::missing_:
     case Opcode::subassign2_:
+    case Opcode::for_kernel_:
         cs.insert(immediate.pool);
         return;
 
     case Opcode::guard_env_:
+    case Opcode::deopt_:
         cs.insert(immediate.guard_id);
         return;
 
@@ -83,7 +85,10 @@ void BC::write(CodeStream& cs) const {
 
     case Opcode::pick_:
     case Opcode::pull_:
+    case Opcode::call_intrinsic_:
     case Opcode::is_:
+    case Opcode::istype_:
+    case Opcode::unbox_:
     case Opcode::put_:
     case Opcode::alloc_:
         cs.insert(immediate.i);
@@ -167,6 +172,18 @@ void BC::write(CodeStream& cs) const {
     case Opcode::subassign1_:
     case Opcode::isobj_:
     case Opcode::check_missing_:
+    case Opcode::box_:
+    case Opcode::extract2_1_unchecked_:
+    case Opcode::in_bounds_:
+    case Opcode::nadd_:
+    case Opcode::nsub_:
+    case Opcode::nmul_:
+    case Opcode::nlt_:
+    case Opcode::ngt_:
+    case Opcode::nle_:
+    case Opcode::nge_:
+    case Opcode::neq_:
+    case Opcode::nne_:
         return;
 
     case Opcode::invalid_:
@@ -258,10 +275,15 @@ void BC::print() const {
     case Opcode::ldlval_:
     case Opcode::ldddvar_:
     case Opcode::stvar_:
+    case Opcode::starg_:
     case Opcode::stvar_super_:
     case Opcode::missing_:
         Rprintf(" %s", CHAR(PRINTNAME((immediateConst()))));
         break;
+    case Opcode::for_kernel_:
+        Rprintf(" %s[]",
+                CHAR(PRINTNAME(VectorKernel::target(immediateConst()))));
+        break;
     case Opcode::guard_fun_: {
         SEXP name = Pool::get(immediate.guard_fun_args.name);
         Rprintf(" %s == %p", CHAR(PRINTNAME(name)),
@@ -273,6 +295,9 @@ void BC::print() const {
     case Opcode::put_:
         Rprintf(" %i", immediate.i);
         break;
+    case Opcode::call_intrinsic_:
+        Rprintf(" %s", Intrinsics::info((Intrinsic)immediate.i).name);
+        break;
     case Opcode::ldarg_:
         Rprintf(" %u", immediate.arg_idx);
         break;
@@ -286,11 +311,18 @@ void BC::print() const {
         break;
     case Opcode::is_:
     case Opcode::alloc_:
+    case Opcode::unbox_:
         Rprintf(" %s", type2char(immediate.i));
         break;
+    case Opcode::istype_: {
+        auto t = RecordedType::unpack(immediate.i);
+        Rprintf(" %s(%s%s%s)", Rf_type2char(t.sexptype), t.object ? "o" : "",
+                t.attribs ? "a" : "", t.scalar ? "s" : "");
+        break;
+    }
     case Opcode::guard_env_:
-        Deoptimizer_print(immediate.guard_id);
-        Rprintf("\n");
+    case Opcode::deopt_:
+        Rprintf(" d#%u", immediate.guard_id);
         break;
 
     case Opcode::record_call_: {
@@ -387,6 +419,18 @@ void BC::print() const {
     case Opcode::subassign2_:
     case Opcode::isobj_:
     case Opcode::check_missing_:
+    case Opcode::box_:
+    case Opcode::extract2_1_unchecked_:
+    case Opcode::in_bounds_:
+    case Opcode::nadd_:
+    case Opcode::nsub_:
+    case Opcode::nmul_:
+    case Opcode::nlt_:
+    case Opcode::ngt_:
+    case Opcode::nle_:
+    case Opcode::nge_:
+    case Opcode::neq_:
+    case Opcode::nne_:
         break;
     case Opcode::promise_:
     case Opcode::push_code_:
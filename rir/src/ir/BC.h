@@ -117,6 +117,11 @@ BC BC::guardEnv(uint32_t id) {
     i.guard_id = id;
     return BC(Opcode::guard_env_, i);
 }
+BC BC::deopt(uint32_t id) {
+    ImmediateArguments i;
+    i.guard_id = id;
+    return BC(Opcode::deopt_, i);
+}
 BC BC::guardName(SEXP sym, SEXP expected) {
     ImmediateArguments i;
     i.guard_fun_args = {Pool::insert(sym), Pool::insert(expected),
@@ -157,6 +162,13 @@ BC BC::stvar(SEXP sym) {
     i.pool = Pool::insert(sym);
     return BC(Opcode::stvar_, i);
 }
+BC BC::starg(SEXP sym) {
+    assert(TYPEOF(sym) == SYMSXP);
+    assert(strlen(CHAR(PRINTNAME(sym))));
+    ImmediateArguments i;
+    i.pool = Pool::insert(sym);
+    return BC(Opcode::starg_, i);
+}
 BC BC::stvarSuper(SEXP sym) {
     assert(TYPEOF(sym) == SYMSXP);
     assert(strlen(CHAR(PRINTNAME(sym))));
@@ -223,6 +235,17 @@ BC BC::inc() { return BC(Opcode::inc_); }
 BC BC::close() { return BC(Opcode::close_); }
 BC BC::dup2() { return BC(Opcode::dup2_); }
 BC BC::forSeqSize() { return BC(Opcode::for_seq_size_); }
+BC BC::forKernel(SEXP kernel) {
+    assert(TYPEOF(kernel) == VECSXP);
+    ImmediateArguments i;
+    i.pool = Pool::insert(kernel);
+    return BC(Opcode::for_kernel_, i);
+}
+BC BC::callIntrinsic(Intrinsic i) {
+    ImmediateArguments im;
+    im.i = (uint32_t)i;
+    return BC(Opcode::call_intrinsic_, im);
+}
 BC BC::add() { return BC(Opcode::add_); }
 BC BC::mul() { return BC(Opcode::mul_); }
 BC BC::div() { return BC(Opcode::div_); }
@@ -240,11 +263,29 @@ BC BC::ge() { return BC(Opcode::ge_); }
 BC BC::eq() { return BC(Opcode::eq_); }
 BC BC::identical() { return BC(Opcode::identical_); }
 BC BC::ne() { return BC(Opcode::ne_); }
+BC BC::unbox(uint32_t type) {
+    assert(type == INTSXP || type == REALSXP);
+    ImmediateArguments im;
+    im.i = type;
+    return BC(Opcode::unbox_, im);
+}
+BC BC::box() { return BC(Opcode::box_); }
+BC BC::nadd() { return BC(Opcode::nadd_); }
+BC BC::nsub() { return BC(Opcode::nsub_); }
+BC BC::nmul() { return BC(Opcode::nmul_); }
+BC BC::nlt() { return BC(Opcode::nlt_); }
+BC BC::ngt() { return BC(Opcode::ngt_); }
+BC BC::nle() { return BC(Opcode::nle_); }
+BC BC::nge() { return BC(Opcode::nge_); }
+BC BC::neq() { return BC(Opcode::neq_); }
+BC BC::nne() { return BC(Opcode::nne_); }
 BC BC::invisible() { return BC(Opcode::invisible_); }
 BC BC::visible() { return BC(Opcode::visible_); }
 BC BC::extract1_1() { return BC(Opcode::extract1_1_); }
 BC BC::extract1_2() { return BC(Opcode::extract1_2_); }
 BC BC::extract2_1() { return BC(Opcode::extract2_1_); }
+BC BC::extract2_1Unchecked() { return BC(Opcode::extract2_1_unchecked_); }
+BC BC::inBounds() { return BC(Opcode::in_bounds_); }
 BC BC::extract2_2() { return BC(Opcode::extract2_2_); }
 BC BC::swap() { return BC(Opcode::swap_); }
 BC BC::int3() { return BC(Opcode::int3_); }
@@ -269,6 +310,11 @@ BC BC::is(uint32_t i) {
     im.i = i;
     return BC(Opcode::is_, im);
 }
+BC BC::isType(RecordedType t) {
+    ImmediateArguments im;
+    im.i = t.pack();
+    return BC(Opcode::istype_, im);
+}
 BC BC::put(uint32_t i) {
     ImmediateArguments im;
     im.i = i;
@@ -12,6 +12,7 @@
 #include <array>
 #include <vector>
 
+#include "interpreter/intrinsics.h"
 #include "ir/RuntimeFeedback.h"
 
 // type  for constant & ast pool indices
@@ -192,12 +193,14 @@ class BC {
     }
 
     inline size_t popCount() {
-        // return also is a leave
-        assert(bc != Opcode::return_);
-        if (bc == Opcode::call_)
+        // return and deopt leave the code with all of the stack
+        assert(bc != Opcode::return_ && bc != Opcode::deopt_);
+        if (bc == Opcode::call_ || bc == Opcode::named_call_)
             return immediate.callFixedArgs.nargs + 1;
         if (bc == Opcode::static_call_)
             return immediate.staticCallFixedArgs.nargs;
+        if (bc == Opcode::call_intrinsic_)
+            return Intrinsics::info((Intrinsic)immediate.i).nargs;
         return popCount(bc);
     }
     inline size_t pushCount() { return pushCount(bc); }
@@ -323,6 +326,7 @@ class BC {
     inline static BC force();
     inline static BC asast();
     inline static BC stvar(SEXP sym);
+    inline static BC starg(SEXP sym);
     inline static BC stvarSuper(SEXP sym);
     inline static BC missing(SEXP sym);
     inline static BC checkMissing();
@@ -343,6 +347,8 @@ class BC {
     inline static BC dup();
     inline static BC dup2();
     inline static BC forSeqSize();
+    inline static BC forKernel(SEXP kernel);
+    inline static BC callIntrinsic(Intrinsic i);
     inline static BC inc();
     inline static BC close();
     inline static BC add();
@@ -362,6 +368,17 @@ class BC {
     inline static BC eq();
     inline static BC identical();
     inline static BC ne();
+    inline static BC unbox(uint32_t type);
+    inline static BC box();
+    inline static BC nadd();
+    inline static BC nsub();
+    inline static BC nmul();
+    inline static BC nlt();
+    inline static BC ngt();
+    inline static BC nle();
+    inline static BC nge();
+    inline static BC neq();
+    inline static BC nne();
     inline static BC seq();
     inline static BC colon();
     inline static BC makeUnique();
@@ -372,18 +389,22 @@ class BC {
     inline static BC guardName(SEXP, SEXP);
     inline static BC guardNamePrimitive(SEXP);
     inline static BC guardEnv(uint32_t id);
+    inline static BC deopt(uint32_t id);
     inline static BC isfun();
     inline static BC invisible();
     inline static BC visible();
     inline static BC extract1_1();
     inline static BC extract1_2();
     inline static BC extract2_1();
+    inline static BC extract2_1Unchecked();
+    inline static BC inBounds();
     inline static BC extract2_2();
     inline static BC swap();
     inline static BC put(uint32_t);
     inline static BC pick(uint32_t);
     inline static BC pull(uint32_t);
     inline static BC is(uint32_t);
+    inline static BC isType(RecordedType);
     inline static BC isObj();
     inline static BC return_();
     inline static BC int3();
@@ -480,9 +501,11 @@ class BC {
         case Opcode::ldlval_:
         case Opcode::ldddvar_:
         case Opcode::stvar_:
+        case Opcode::starg_:
         case Opcode::stvar_super_:
         case Opcode::missing_:
         case Opcode::subassign2_:
+        case Opcode::for_kernel_:
             immediate.pool = *(PoolIdx*)pc;
             break;
         case Opcode::call_implicit_:
@@ -495,6 +518,7 @@ class BC {
             immediate.staticCallFixedArgs = *(StaticCallFixedArgs*)pc;
             break;
         case Opcode::guard_env_:
+        case Opcode::deopt_:
             immediate.guard_id = *(uint32_t*)pc;
             break;
         case Opcode::guard_fun_:
@@ -514,7 +538,10 @@ class BC {
             break;
         case Opcode::pick_:
         case Opcode::pull_:
+        case Opcode::call_intrinsic_:
         case Opcode::is_:
+        case Opcode::istype_:
+        case Opcode::unbox_:
         case Opcode::put_:
         case Opcode::alloc_:
             immediate.i = *(uint32_t*)pc;
@@ -554,6 +581,18 @@ class BC {
         case Opcode::asbool_:
         case Opcode::dup_:
         case Opcode::dup2_:
+        case Opcode::box_:
+        case Opcode::extract2_1_unchecked_:
+        case Opcode::in_bounds_:
+        case Opcode::nadd_:
+        case Opcode::nsub_:
+        case Opcode::nmul_:
+        case Opcode::nlt_:
+        case Opcode::ngt_:
+        case Opcode::nle_:
+        case Opcode::nge_:
+        case Opcode::neq_:
+        case Opcode::nne_:
         case Opcode::swap_:
         case Opcode::int3_:
         case Opcode::make_unique_:
@@ -47,7 +47,7 @@ class State {
 
     void advance() {
         BC bc = BC::advance(&pc);
-        if (bc.bc == Opcode::return_)
+        if (bc.bc == Opcode::return_ || bc.bc == Opcode::deopt_)
             ostack = 0;
         else
             ostack -= bc.popCount();
@@ -92,6 +92,9 @@ static Sources hasSources(Opcode bc) {
     case Opcode::eq_:
     case Opcode::ne_:
     case Opcode::colon_:
+    case Opcode::nadd_:
+    case Opcode::nsub_:
+    case Opcode::nmul_:
         return Sources::Required;
 
     case Opcode::inc_:
@@ -107,6 +110,7 @@ static Sources hasSources(Opcode bc) {
     case Opcode::ldvar_noforce_super_:
     case Opcode::ldlval_:
     case Opcode::stvar_:
+    case Opcode::starg_:
     case Opcode::stvar_super_:
     case Opcode::guard_env_:
     case Opcode::guard_fun_:
@@ -125,6 +129,13 @@ static Sources hasSources(Opcode bc) {
     case Opcode::pick_:
     case Opcode::pull_:
     case Opcode::is_:
+    case Opcode::istype_:
+    case Opcode::unbox_:
+    case Opcode::box_:
+    case Opcode::extract2_1_unchecked_:
+    case Opcode::in_bounds_:
+    case Opcode::for_kernel_:
+    case Opcode::call_intrinsic_:
     case Opcode::put_:
     case Opcode::alloc_:
     case Opcode::ldarg_:
@@ -137,6 +148,7 @@ static Sources hasSources(Opcode bc) {
     case Opcode::parent_env_:
     case Opcode::set_env_:
     case Opcode::ret_:
+    case Opcode::deopt_:
     case Opcode::length_:
     case Opcode::names_:
     case Opcode::set_names_:
@@ -167,6 +179,12 @@ static Sources hasSources(Opcode bc) {
     case Opcode::asbool_:
     case Opcode::missing_:
     case Opcode::int3_:
+    case Opcode::nlt_:
+    case Opcode::ngt_:
+    case Opcode::nle_:
+    case Opcode::nge_:
+    case Opcode::neq_:
+    case Opcode::nne_:
         return Sources::May;
 
     case Opcode::invalid_:
@@ -204,7 +222,8 @@ void CodeVerifier::calculateAndVerifyStack(Code* code) {
             BC cur = BC::decode(pc);
             i.advance();
             max.updateMax(i);
-            if (cur.bc == Opcode::ret_ || cur.bc == Opcode::return_) {
+            if (cur.bc == Opcode::ret_ || cur.bc == Opcode::return_ ||
+                cur.bc == Opcode::deopt_) {
                 i.checkClear();
                 break;
             } else if (cur.bc == Opcode::br_) {
@@ -286,14 +305,16 @@ void CodeVerifier::verifyFunctionLayout(SEXP sexp, ::Context* ctx) {
                 assert(cptr + cur.size() + off >= start &&
                        cptr + cur.size() + off < end);
             }
-            if (*cptr == Opcode::guard_env_) {
+            if (*cptr == Opcode::guard_env_ || *cptr == Opcode::deopt_) {
                 unsigned deoptId = *reinterpret_cast<Immediate*>(cptr + 1);
-                Opcode* deoptPc = (Opcode*)Deoptimizer_pc(deoptId);
-                assert(f->origin());
-                Function* deoptFun = Function::unpack(f->origin());
-                Code* deoptCode = deoptFun->body();
-                assert(deoptPc >= deoptCode->code() &&
-                       deoptPc < deoptCode->endCode());
+                assert(deoptId < DeoptTable::size(f->deoptTable()) &&
+                       "Invalid deoptimization point");
+                auto frames = DeoptTable::frames(f->deoptTable(), deoptId);
+                if (*cptr == Opcode::guard_env_)
+                    assert(frames.size() == 1 && frames[0].stackSize == 0);
+                for (auto& frame : frames)
+                    assert(frame.pc >= frame.code->code() &&
+                           frame.pc < frame.code->endCode());
             }
             if (*cptr == Opcode::ldvar_) {
                 unsigned* argsIndex = reinterpret_cast<Immediate*>(cptr + 1);
@@ -351,7 +372,8 @@ void CodeVerifier::verifyFunctionLayout(SEXP sexp, ::Context* ctx) {
                 }
             }
 
-            if ((cur.isJmp() && cur.immediate.offset < 0) || cur.isReturn())
+            if ((cur.isJmp() && cur.immediate.offset < 0) || cur.isReturn() ||
+                cur.bc == Opcode::deopt_)
                 sawReturnOrBackjump = true;
             else if (cur.bc != Opcode::nop_)
                 sawReturnOrBackjump = false;
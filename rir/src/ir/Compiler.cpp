@@ -10,6 +10,7 @@
 #include "R/Funtab.h"
 
 #include "utils/Pool.h"
+#include "interpreter/vector_kernel.h"
 
 #include "CodeVerifier.h"
 
@@ -682,6 +683,7 @@ bool compileSpecialCall(Context& ctx, SEXP ast, SEXP fun, SEXP args_) {
 
             compileExpr(ctx, *idx);
             if (args.length() == 2) {
+                cs << BC::recordBinop();
                 if (fun == symbol::DoubleBracket)
                     cs << BC::extract2_1();
                 else
@@ -800,6 +802,27 @@ bool compileSpecialCall(Context& ctx, SEXP ast, SEXP fun, SEXP args_) {
         ctx.pushLoop(loopBranch, breakBranch);
 
         compileExpr(ctx, seq);
+
+        // Element-wise loops are run as a whole by a vector kernel. If the
+        // kernel fails, we fall back to the scalar loop.
+        std::vector<SEXP> primitives;
+        SEXP kernel = VectorKernel::compile(sym, seq, body, primitives);
+        BC::Label scalarBranch = cs.mkLabel();
+        BC::Label doneBranch = cs.mkLabel();
+        if (kernel) {
+            Protect p(kernel);
+            for (auto prim : primitives)
+                cs << BC::guardNamePrimitive(prim);
+            cs << BC::forKernel(kernel) << BC::dup() << BC::is(NILSXP)
+               << BC::brtrue(scalarBranch)
+               << BC::stvar(VectorKernel::target(kernel));
+            // The loop variable is left at the last element
+            cs << BC::forSeqSize() << BC::extract2_1();
+            cs.addSrc(R_NilValue);
+            cs << BC::stvar(sym) << BC::push(R_NilValue) << BC::invisible()
+               << BC::br(doneBranch) << scalarBranch << BC::pop();
+        }
+
         cs << BC::setShared() << BC::forSeqSize() << BC::push((int)0);
 
         std::vector<unsigned> pcs;
@@ -853,6 +876,9 @@ bool compileSpecialCall(Context& ctx, SEXP ast, SEXP fun, SEXP args_) {
         cs << BC::pop() << BC::pop() << BC::pop() << BC::push(R_NilValue)
            << BC::invisible();
 
+        if (kernel)
+            cs << doneBranch;
+
         ctx.popLoop();
 
         return true;
@@ -50,6 +50,19 @@ struct RecordedType {
     bool operator==(const RecordedType& other) {
         return memcmp(this, &other, sizeof(RecordedType)) == 0;
     }
+
+    // As immediate of istype_
+    uint32_t pack() const {
+        return sexptype | scalar << 5 | object << 6 | attribs << 7;
+    }
+    static RecordedType unpack(uint32_t i) {
+        RecordedType t;
+        t.sexptype = i & 0x1f;
+        t.scalar = (i >> 5) & 1;
+        t.object = (i >> 6) & 1;
+        t.attribs = (i >> 7) & 1;
+        return t;
+    }
 };
 static_assert(sizeof(CallFeedback) == 7 * sizeof(uint32_t),
               "Size needs to fit inside a record_ bc immediate args");
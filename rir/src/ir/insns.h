@@ -86,6 +86,12 @@ DEF_INSTR(ldloc_, 1, 0, 1, 1)
  */
 DEF_INSTR(stvar_, 1, 1, 0, 0)
 
+/**
+ * starg_:: assign tos to the immediate symbol, which is a missing formal
+ *          bound to its default argument: the binding stays marked missing
+ */
+DEF_INSTR(starg_, 1, 1, 0, 0)
+
 /**
  * stvar_super_:: assign tos to the immediate symbol, lookup starts in the
  * enclosing environment
@@ -279,11 +285,48 @@ DEF_INSTR(asbool_, 0, 1, 1, 0)
  */
 DEF_INSTR(asast_, 0, 1, 1, 1)
 
+/**
+ * unbox_:: immediate type tag (INTSXP or REALSXP), pop a scalar int or real
+ *          without attributes and push it unboxed as that type. Unboxed
+ *          values are only consumed by the n*_ instructions and box_.
+ */
+DEF_INSTR(unbox_, 1, 1, 1, 1)
+
+/**
+ * box_:: pop an unboxed int or real and push it as a scalar vector
+ */
+DEF_INSTR(box_, 0, 1, 1, 1)
+
+/**
+ * nadd_, nsub_, nmul_:: arithmetic on two unboxed scalars of the same type,
+ *                       pushes the unboxed result
+ */
+DEF_INSTR(nadd_, 0, 2, 1, 0)
+DEF_INSTR(nsub_, 0, 2, 1, 0)
+DEF_INSTR(nmul_, 0, 2, 1, 0)
+
+/**
+ * nlt_, ngt_, nle_, nge_, neq_, nne_:: compare two unboxed scalars of the
+ *                                      same type, push T/F/NA
+ */
+DEF_INSTR(nlt_, 0, 2, 1, 1)
+DEF_INSTR(ngt_, 0, 2, 1, 1)
+DEF_INSTR(nle_, 0, 2, 1, 1)
+DEF_INSTR(nge_, 0, 2, 1, 1)
+DEF_INSTR(neq_, 0, 2, 1, 1)
+DEF_INSTR(nne_, 0, 2, 1, 1)
+
 /**
  * is_:: immediate type tag (SEXPTYPE), push T/F
  */
 DEF_INSTR(is_, 1, 1, 1, 1)
 
+/**
+ * istype_:: immediate RecordedType, check if TOS has exactly that type (see
+ * RuntimeFeedback.h), push T/F
+ */
+DEF_INSTR(istype_, 1, 1, 1, 1)
+
 /**
  * isobj_:: check if TOS is any kind of object, push T/F
  */
@@ -339,6 +382,21 @@ DEF_INSTR(subassign1_, 0, 3, 1, 1)
  */
 DEF_INSTR(extract2_1_, 0, 2, 1, 1)
 
+/**
+ * extract2_1_unchecked_:: do a[[b]] without checking b, which the compiler
+ *                         proved to be a non-NA int or real scalar in bounds
+ *                         of a. Does not dispatch.
+ */
+DEF_INSTR(extract2_1_unchecked_, 0, 2, 1, 1)
+
+/**
+ * in_bounds_:: check if a is an int, real, logical or list vector without
+ *              attributes and all elements of the index vectors b and c are
+ *              valid indices of a, push T/F. A forced promise a is checked by
+ *              its value, a promise that is not forced yet fails the check.
+ */
+DEF_INSTR(in_bounds_, 0, 3, 1, 1)
+
 /**
  * extract2_2_:: do a[[b,c]], where a, b and c are on the stack and a is no obj
  */
@@ -353,8 +411,21 @@ DEF_INSTR(subassign2_, 1, 3, 1, 1)
  * guard_fun_:: takes symbol, target, id, checks findFun(symbol) == target
  */
 DEF_INSTR(guard_fun_, 3, 0, 0, 1)
+
+/**
+ * guard_env_:: deoptimizes if the current env was changed or leaked. The
+ *              immediate is a deoptimization point without stack values, see
+ *              interpreter/deoptimizer.h
+ */
 DEF_INSTR(guard_env_, 1, 0, 0, 1)
 
+/**
+ * deopt_:: continues in the baseline code of the deoptimization point given by
+ *          the immediate. Takes the frame states of all its frames from the
+ *          stack, see interpreter/deoptimizer.h
+ */
+DEF_INSTR(deopt_, 1, -1, 0, 0)
+
 /**
  * seq_ :: seq(scalar, scalar, scalar)
  */
@@ -390,6 +461,21 @@ DEF_INSTR(length_, 0, 1, 1, 1)
  */
 DEF_INSTR(for_seq_size_, 0, 0, 1, 0)
 
+/**
+ * for_kernel_ :: run an element-wise for loop over the sequence tos as a
+ *                whole. Immediate is the VectorKernel. Pushes the new value of
+ *                the target vector, or nil if the loop has to be run by the
+ *                scalar code.
+ */
+DEF_INSTR(for_kernel_, 1, 0, 1, 0)
+
+/**
+ * call_intrinsic_ :: call an intrinsic (see intrinsics.h) with its arguments
+ *                    on the stack and push the result. Immediate is the
+ *                    intrinsic.
+ */
+DEF_INSTR(call_intrinsic_, 1, -1, 1, 0)
+
 /**
  * visible_:: reset invisible flag
  */
@@ -50,17 +50,22 @@ struct Function {
   public:
     Function() {
         info.gc_area_start = sizeof(rir_header); // just after the header
-        info.gc_area_length = 2;                 // origin, next
+        info.gc_area_length = 5; // origin, next, threaded, deoptTable, native
         info.magic = FUNCTION_MAGIC;
         origin_ = nullptr;
         next_ = nullptr;
+        threaded_ = nullptr;
+        deoptTable_ = nullptr;
+        native_ = nullptr;
         size = sizeof(Function);
         signature = nullptr;
         invocationCount = 0;
+        reoptimizeAt = 0;
         envLeaked = false;
         envChanged = false;
         deopt = false;
         markOpt = false;
+        reoptimizations = 0;
         codeLength = 0;
         foffset = 0;
     }
@@ -123,6 +128,22 @@ struct Function {
         EXTERNALSXP_SET_ENTRY(container(), 1, s->container());
     }
 
+    SEXP threaded() { return threaded_; }
+
+    void threaded(SEXP handlers) {
+        EXTERNALSXP_SET_ENTRY(container(), 2, handlers);
+    }
+
+    SEXP deoptTable() { return deoptTable_; }
+
+    void deoptTable(SEXP table) {
+        EXTERNALSXP_SET_ENTRY(container(), 3, table);
+    }
+
+    SEXP native() { return native_; }
+
+    void native(SEXP code) { EXTERNALSXP_SET_ENTRY(container(), 4, code); }
+
     void registerInvocation() {
         if (invocationCount < UINT_MAX)
             invocationCount++;
@@ -133,7 +154,13 @@ struct Function {
   private:
     FunctionSEXP origin_; /// Same Function with fewer optimizations,
                           //   NULL if original
-    FunctionSEXP next_;
+    FunctionSEXP next_; /// Deoptimized optimized version replaced by this
+                        //   one, kept alive since it might still run
+    SEXP threaded_; /// RAWSXP with the handler address of every instruction,
+                    //   see ThreadedCode in interp.cpp
+    SEXP deoptTable_; /// Deoptimization metadata, see DeoptTable
+    SEXP native_; /// Machine code of the body, see TemplateJit. R_NilValue
+                  //   if the body cannot be compiled
 
   public:
     unsigned size; /// Size, in bytes, of the function and its data
@@ -141,12 +168,14 @@ struct Function {
     FunctionSignature* signature; /// pointer to this version's signature
 
     unsigned invocationCount;
+    unsigned reoptimizeAt; /// see Reoptimizer, only used in baseline versions
 
     unsigned envLeaked : 1;
     unsigned envChanged : 1;
     unsigned deopt : 1;
     unsigned markOpt : 1;
-    unsigned spare : 28;
+    unsigned reoptimizations : 3; /// number of deoptimized optimized versions
+    unsigned spare : 25;
 
     unsigned codeLength; /// number of Code objects in the Function
 
@@ -4,12 +4,14 @@
 #include "configurations.h"
 
 #include "../compiler/opt/cleanup.h"
+#include "../compiler/opt/constant_fold.h"
 #include "../compiler/opt/delay_env.h"
 #include "../compiler/opt/delay_instr.h"
 #include "../compiler/opt/elide_env.h"
 #include "../compiler/opt/force_dominance.h"
 #include "../compiler/opt/inline.h"
 #include "../compiler/opt/scope_resolution.h"
+#include "../compiler/opt/use_intrinsics.h"
 
 namespace rir {
 
@@ -29,6 +31,8 @@ void Configurations::parseINIFile() {
     read(reader, "delayInstructions");
     read(reader, "elideEnvironments");
     read(reader, "delayEnvironments");
+    read(reader, "useIntrinsics");
+    read(reader, "constantFold");
     string cleanups = reader.Get("optimizations", "cleanup", "UNKNOWN");
     if (cleanups != "UNKNOWN") {
         std::stringstream data(cleanups);
@@ -43,11 +47,14 @@ void Configurations::parseINIFile() {
 void Configurations::defaultOptimizations() {
     optimizations.insert(new Optimization(new pir::ForceDominance(), 1));
     optimizations.insert(new Optimization(new pir::ScopeResolution(), 2));
+    optimizations.insert(new Optimization(new pir::ConstantFold(), 3));
     optimizations.insert(new Optimization(new pir::Cleanup(), 3));
+    optimizations.insert(new Optimization(new pir::UseIntrinsics(), 4));
     optimizations.insert(new Optimization(new pir::Cleanup(), 4));
     optimizations.insert(new Optimization(new pir::DelayInstr(), 5));
     optimizations.insert(new Optimization(new pir::ElideEnv(), 6));
     optimizations.insert(new Optimization(new pir::DelayEnv(), 7));
+    optimizations.insert(new Optimization(new pir::ConstantFold(), 8));
     optimizations.insert(new Optimization(new pir::Cleanup(), 8));
 }
 
@@ -70,6 +77,12 @@ void Configurations::read(INIReader& reader, string optimizationName) {
             optimizations.insert(new Optimization(new pir::ElideEnv(), order));
         } else if (optimizationName == "delayEnvironments") {
             optimizations.insert(new Optimization(new pir::DelayEnv(), order));
+        } else if (optimizationName == "useIntrinsics") {
+            optimizations.insert(
+                new Optimization(new pir::UseIntrinsics(), order));
+        } else if (optimizationName == "constantFold") {
+            optimizations.insert(
+                new Optimization(new pir::ConstantFold(), order));
         }
     }
 }
@@ -2,22 +2,23 @@ import os
 import sys
 
 
+EFFECTS = ["None", "Warn", "Error", "Print", "Any"]
+ENV_ACCESS = ["None", "Capture", "Read", "Write", "Leak"]
+RESULTS = ["val", "any", "env"]
 
 
 class Intrinsic:
-    """ Single intrinsic. 
+    """ Single intrinsic.
 
-    Contains the intrinsic name, argument names and argument types and comments to the intrinsic if any. 
-
-    TODO in the future, it also contains the annotations used with the intrinsic so that we can fine-tune its behavior. 
+    Contains the intrinsic name, argument names and argument types, the comment
+    to the intrinsic if any and the effects declared by its annotation.
     """
 
     def __init__(self, annotations, declaration, comment = ""):
         """ Creates the intrinsic from the annotations and declaration lines. """
         self.returnType, declaration = declaration.split(" ", 1)
         self.name, args = declaration.strip()[:-1].split("(")
-        # CamelCase the name
-        self.className = self.name[0].upper() + self.name[1:]
+        self.name = self.name.strip()
         if (args):
             args = [ x.strip() for x in args.split(",") ]
             self.argTypes = [ x.split(" ")[0].strip() for x in args]
@@ -25,147 +26,88 @@ class Intrinsic:
         else:
             self.argTypes = []
             self.argNames = []
-        # ignore the annotation for now as it does not tell us anything atm
-        # keep the comment, if any, we will add it to the C++ wrapper classfor better clarity
         self.comment = comment
-        a = [ x.strip() for x in annotations.split(" ") ]
+        self.effect = "Any"
+        self.env = "None"
+        self.result = "val"
+        a = [ x.strip() for x in annotations.split(" ") if x.strip() ]
         i = 1
         while (i < len(a)):
-            if (a[i] == "cp"):
-                self.markAsConstantPool(a[i + 1])
-                i = i + 2
-                continue
+            if (a[i] == "effect" and a[i + 1] in EFFECTS):
+                self.effect = a[i + 1]
+            elif (a[i] == "env" and a[i + 1] in ENV_ACCESS):
+                self.env = a[i + 1]
+            elif (a[i] == "result" and a[i + 1] in RESULTS):
+                self.result = a[i + 1]
             else:
                 print("Unknown intrinsic annotation modifier {0}".format(a[i]))
-                exit()
-
-    def markAsConstantPool(self, argName):
-        for i in range(0, len(self.argNames)):
-            if (self.argNames[i] == argName):
-                self.argTypes[i] = "cp " + self.argTypes[i]
-                break;
-
-    def outputArgType(self, index):
-        x = self.argTypes[index]
-        if (x == "cp SEXP"):
-            return "SEXP"
-        elif (x == "int"):
-            return "int"
-        else:
-            return "llvm::Value *"
-
-    def argGetterFunction(self, index):
-        x = self.argTypes[index]
-        if (x == "cp SEXP"):
-            return "getValueSEXP"
-        elif (x == "int"):
-            return "getValueInt"
-        else:
-            return "getValue"
-
-    def typeToIr(self, type):
-        if (type == "SEXP" or type == "cp SEXP"):
-            return "t::SEXP"
-        elif (type == "int"):
-            return "t::Int"
-        elif (type == "void"):
-            return "t::Void";
-        elif (type == "Rboolean"):
-            return "t::Int"
-        elif (type == "bool"):
-            return "t::Bool"
-        else:
-            print("Unknown type {0}".format(type))
-            exit()
-
-    def irArgTypes(self):
-        """ Returns the IR types for the arguments """
-        result = ""
+                sys.exit(-1)
+            i = i + 2
+        self.check()
+
+    def check(self):
+        """ Intrinsics are called from the stack, thus all arguments are SEXPs.
+        An intrinsic with env access takes the env as its last argument. """
+        if (self.returnType != "SEXP"):
+            print("Intrinsic {0} must return a SEXP".format(self.name))
+            sys.exit(-1)
         for t in self.argTypes:
-            if (result != ""):
-                result += ", "
-            result += self.typeToIr(t)
-        return result
-
-
-    def headerCode(self):
-        """ Emits the C++ code for the intrinsic that is to be placed in the header - the intrinsic class definition and methods. """
-        result = "{0}\nclass {1}: public Intrinsic {{\npublic:\n".format(self.comment, self.className)
-        # argument getters
-        for i in range(0, len(self.argNames)):
-            result += "    " + self.argumentGetterCode(i)
-            result += "\n\n"
-        # constructor from existing llvm::CallInst instruction
-        result += "    {0}(llvm::Instruction * ins):\n        Intrinsic(ins) {{\n    }}\n\n".format(self.className)
-        # static constructor
-        result += self.staticConstructor()
-        # name as returned from static function
-        result += "    static char const * intrinsicName() {{\n        return \"{0}\";\n    }}\n\n".format(self.name)
-        # type returned from static function as well
-        result += "    static llvm::FunctionType * intrinsicType() { \n"
-        result += "        return llvm::FunctionType::get({0}, {{ {1} }}, false);\n".format(self.typeToIr(self.returnType), self.irArgTypes())
-        result += "    }\n\n"
-
-        result += "};"
-        return result
-
-    
-    def convertArgumentToValue(self, index):
-        x = self.argTypes[index]
-        if (x == "cp SEXP"):
-            return "Builder::constantPoolSexp({0})".format(self.argNames[index])
-        elif (x == "int"):
-            return "Builder::integer({0})".format(self.argNames[index])
-        else:
-            return self.argNames[index];
-
-
-    def staticConstructor(self):
-        """ Returns the c++ code for the static constructor method for the intrinsic call."""
-        result = "    static {0} create(Builder & b".format(self.className)
-        # signature
-        for i in range(0, len(self.argNames)):
-            result += ", "
-            result += self.outputArgType(i) + " " + self.argNames[i]
-        result += ") {\n"
-        # any argument that is not llvm::Value must be converted to llvm::Value
-        result += "        std::vector<llvm::Value *> args_;\n"
-        for i in range(0, len(self.argNames)):
-            result +="        args_.push_back({0});\n".format(self.convertArgumentToValue(i))
-        result += "        llvm::CallInst * ins = llvm::CallInst::Create(b.intrinsic<{0}>(), args_, \"\", b);\n".format(self.className)
-        result += "        b.insertCall(ins);\n" # deal with GC
-        result += "        setIRType(ins, ::rjit::ir::Type::{0});\n".format(self.className) # set type in metadata
-        result += "        return ins;\n"
-        result += "    }\n\n"
-        return result
-
-    def argumentGetterCode(self, index):
-        return "{0} {1}() {{ return {2}({3}); }}".format(self.outputArgType(index), self.argNames[index], self.argGetterFunction(index), index)
-
-
+            if (t != "SEXP"):
+                print("Intrinsic {0} has a non SEXP argument".format(self.name))
+                sys.exit(-1)
+        hasEnv = len(self.argNames) > 0 and self.argNames[-1] == "env"
+        if (hasEnv != (self.env != "None")):
+            print("Intrinsic {0} must take the env as last argument iff it accesses the env".format(self.name))
+            sys.exit(-1)
+
+    def nargs(self):
+        """ Number of arguments on the stack, i.e. without the env. """
+        if (self.env != "None"):
+            return len(self.argNames) - 1
+        return len(self.argNames)
+
+    def invokeArgs(self):
+        """ Arguments of the call in the invoker, which gets the stack
+        arguments in the array a. """
+        args = [ "a[{0}]".format(i) for i in range(0, self.nargs()) ]
+        if (self.env != "None"):
+            args.append("env")
+        return "(" + ", ".join(args) + ")"
+
+    def listEntry(self):
+        """ Returns the X-macro entry of the intrinsic. """
+        return "    V({0}, {1}, {2}, {3}, {4}, {5})".format(
+            self.name, self.nargs(), self.effect, self.env, self.result,
+            self.invokeArgs())
 
 
 def emit(intrinsics, targetDir):
-    """ Extracts all intrinsics that we have into specified header and cpp files. """
-    header = open(os.path.join(targetDir, "intrinsics.h"), "w")
-    irt = open(os.path.join(targetDir, "irTypes.h"), "w")
-    print("#ifndef INTRINSICS_H_\n#define INTRINSICS_H_\n\n#include \"ir.h\"\n#include \"Builder.h\"\n\nnamespace rjit {\nnamespace ir {\n", file = header)
-    for i in intrinsics:
-        print(i.headerCode(), file = header)
-        print("{0}, ".format(i.className), file = irt)
-
-    print("} // namespace ir\n} // namespace rjit\n#endif // INTRINSICS_H_\n", file = header)
+    """ Emits the list of all intrinsics into intrinsics_list.h """
+    header = open(os.path.join(targetDir, "intrinsics_list.h"), "w")
+    print("#ifndef RIR_INTRINSICS_LIST_H\n#define RIR_INTRINSICS_LIST_H\n", file = header)
+    print("// Generated by tools/intrinsicsGenerator.py from intrinsics.h, do not edit.", file = header)
+    print("//", file = header)
+    print("// V(name, nargs, effect, env, result, invokeArgs)\n", file = header)
+    entries = [ i.listEntry() for i in intrinsics ]
+    lines = [ "#define RIR_INTRINSICS(V)" ] + entries
+    for i in range(0, len(lines)):
+        line = lines[i]
+        if (i < len(lines) - 1):
+            line = line.ljust(79) + "\\"
+        print(line, file = header)
+    print("\n#endif", file = header)
     header.close()
-    irt.close()
-
 
 
 def extractIntrinsics(file, intrinsics):
-    """ Extracts the C intrinsic functions from given file, together with their types and any other annotations. 
-    
-    All annotations are given in C comments blocks starting with /*@ and as of now the following annotations are allowed:
+    """ Extracts the C intrinsic functions from given file, together with their types and any other annotations.
+
+    All annotations are given in C comments blocks starting with /*@ or //@ and as of now the following annotations are allowed:
 
-    intrinsic - an intrinsic to be analyzed. 
+    intrinsic - an intrinsic to be analyzed, optionally followed by
+        effect None|Warn|Error|Print|Any (default Any)
+        env None|Capture|Read|Write|Leak (default None)
+        result val|any|env (default val)
 
     """
     with open(file, "r") as f:
@@ -218,24 +160,25 @@ def extractIntrinsics(file, intrinsics):
                 if (line[-2:] == "*/"):
                     state = PARSE_COMMENT_OR_DECLARATION
             elif (state == PARSE_DECLARATION):
-                if (line.find("{") != 0):
-                    line = line[:line.find("{")]
+                # declarations end with ; and definitions with {
+                end = min([ x for x in [line.find("{"), line.find(";")] if x != -1 ] or [-1])
+                if (end != -1):
+                    line = line[:end]
                     state = SEARCH
                     declaration = declaration + line + " "
-                    intrinsics.append(Intrinsic(intrinsic, declaration, comment.strip()))
+                    intrinsics.append(Intrinsic(intrinsic, declaration.strip(), comment.strip()))
                 else:
-                    declaration = declaration + line
+                    declaration = declaration + line + " "
         return intrinsics
 
 if (len(sys.argv) == 1):
-    print("No files to look for intrinsics specified. Exitting. ")
+    print("Usage: intrinsicsGenerator.py rir/src/interpreter/intrinsics.h")
     sys.exit(-1)
 # load intrinsics from the files specified.
 intrinsics = []
 for f in sys.argv[1:]:
     intrinsics = extractIntrinsics(f, intrinsics)
 print("Found {0} intrinsic(s) in {1} files...".format(len(intrinsics), len(sys.argv) - 1))
-# now create the header and cpp files with the intrinsic definitions
-emit(intrinsics, "../rjit/src/ir")
-print("intrinsics.cpp, intrinsics.h and irTypes.h generated")
-
+# the list is generated next to the first file
+emit(intrinsics, os.path.dirname(os.path.abspath(sys.argv[1])))
+print("intrinsics_list.h generated")
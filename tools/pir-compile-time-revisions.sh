@@ -0,0 +1,41 @@
+#!/bin/bash -e
+
+# Compares the PIR compile time of two revisions (default: the parent of
+# HEAD and HEAD) with benchmarks/pir_compile_time.r. Run it from a build
+# directory, e.g.
+#
+#     ../tools/pir-compile-time-revisions.sh 65607bb^ 65607bb base stats
+
+if [[ $(git diff --shortstat 2> /dev/null | tail -n1) != "" ]]; then
+    echo "repo is dirty"
+    exit 1
+fi
+
+SCRIPTPATH=`cd $(dirname "$0") && pwd`
+BASE=`cd $SCRIPTPATH/.. && pwd`
+OLD=${1:-HEAD^}
+NEW=${2:-HEAD}
+shift $(( $# < 2 ? $# : 2 ))
+OUT="benchmark-out/compile-time"
+ORIG=`git rev-parse --abbrev-ref HEAD`
+
+mkdir -p $OUT
+
+# Resolve both names before checking out anything, HEAD^ moves otherwise
+REVS="`git rev-parse $OLD` `git rev-parse $NEW`"
+
+for rev in $REVS; do
+    echo "**************  measuring $rev"
+    git checkout -q $rev
+    cmake $BASE
+    cmake --build .
+    ${SCRIPTPATH}/Rscript ${BASE}/benchmarks/pir_compile_time.r "$@" \
+        | tee $OUT/$rev.txt
+done
+
+git checkout -q $ORIG
+
+for rev in $REVS; do
+    echo "$rev:"
+    cat $OUT/$rev.txt
+done
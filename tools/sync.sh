@@ -47,7 +47,7 @@ function build_r {
             # Mac OSX
             F77="gfortran -arch x86_64" FC="gfortran -arch x86_64" CXXFLAGS="-g3 -O2" CFLAGS="-g3 -O2" ./configure --enable-R-shlib --without-internal-tzcode --with-ICU=no || cat config.log
         else
-            CXXFLAGS="-g3 -O2" CFLAGS="-g3 -O2" ./configure --with-ICU=no
+            CXXFLAGS="-g3 -O2" CFLAGS="-g3 -O2 ${TYPED_STACK:+-DTYPED_STACK}" ./configure --with-ICU=no
         fi
     fi
     